@@ -0,0 +1,626 @@
+/*
+ * DB6502 Emulator - Conditional breakpoints and watchpoints
+ *
+ * Each entry is parsed once, and its condition is compiled into a short
+ * program for a small stack machine, with constant subexpressions folded.
+ * Checking a condition then costs a few dispatches, not a parse.
+ *
+ * Breakpoints arm their address in the CPU device, which only asks for the
+ * condition when it reaches an armed address. Watchpoints mark their pages
+ * on the bus. Those pages lose their direct host pointers and take the
+ * device path, where each access is reported here. Every other page keeps
+ * the fast path, so watching one byte only slows down accesses to its page.
+ */
+
+#include "breakpoints.h"
+#include "hbc56emu.h"
+#include "devices/6502_device.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define BP_MAX_CODE     128
+#define BP_MAX_STACK    16
+
+#define FLAG_C  0x01
+#define FLAG_Z  0x02
+#define FLAG_I  0x04
+#define FLAG_D  0x08
+#define FLAG_V  0x40
+#define FLAG_N  0x80
+
+/* stack machine. OP_CONST is followed by a 32 bit little endian value,
+ * OP_FLAG by a status register mask */
+typedef enum
+{
+  OP_END,
+  OP_CONST,
+  OP_A, OP_X, OP_Y, OP_SP, OP_P, OP_PC, OP_FLAG,
+  OP_VALUE, OP_ADDR,
+  OP_MEM,
+  OP_NOT, OP_NEG, OP_INV,
+  OP_MUL, OP_DIV, OP_MOD, OP_ADD, OP_SUB, OP_SHL, OP_SHR,
+  OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+  OP_AND, OP_XOR, OP_OR, OP_LAND, OP_LOR
+} BpOp;
+
+/* what a condition can look at */
+typedef struct
+{
+  HBC56CpuRegs  regs;
+  uint16_t      addr;     /* watches: the address accessed */
+  uint8_t       value;    /* watches: the byte read or written */
+} BpContext;
+
+typedef struct
+{
+  char      spec[BP_MAX_SPEC];  /* as entered */
+  uint8_t   watch;              /* HBC56_WATCH_* bits, 0 for a breakpoint */
+  uint16_t  start;
+  uint16_t  end;                /* inclusive */
+  int       hasCond;
+  uint8_t   code[BP_MAX_CODE];
+  uint64_t  hits;
+} BpEntry;
+
+static BpEntry entries[BP_MAX_ENTRIES];
+static int entryCount = 0;
+static uint8_t watchPages[0x100];
+static char lastHit[BP_MAX_HIT] = "";
+
+static HBC56Device* bpCpuDevice = NULL;
+
+
+/* ---- evaluation ---- */
+
+static int32_t constValue(const uint8_t* code)
+{
+  return (int32_t)((uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24));
+}
+
+#define BINARY_OP(op, expr) case op: --sp; stack[sp - 1] = (expr); break
+
+/* programs are checked for stack depth when compiled. ctx may be NULL
+ * for constant programs (folding) */
+static int32_t bpRun(const uint8_t* code, const BpContext* ctx)
+{
+  int32_t stack[BP_MAX_STACK];
+  int sp = 0;
+
+  for (;;)
+  {
+    switch (*code++)
+    {
+      case OP_END:    return stack[0];
+      case OP_CONST:  stack[sp++] = constValue(code); code += 4; break;
+      case OP_A:      stack[sp++] = ctx->regs.a; break;
+      case OP_X:      stack[sp++] = ctx->regs.x; break;
+      case OP_Y:      stack[sp++] = ctx->regs.y; break;
+      case OP_SP:     stack[sp++] = ctx->regs.sp; break;
+      case OP_P:      stack[sp++] = ctx->regs.p; break;
+      case OP_PC:     stack[sp++] = ctx->regs.pc; break;
+      case OP_FLAG:   stack[sp++] = (ctx->regs.p & *code++) != 0; break;
+      case OP_VALUE:  stack[sp++] = ctx->value; break;
+      case OP_ADDR:   stack[sp++] = ctx->addr; break;
+      case OP_MEM:    stack[sp - 1] = hbc56MemRead((uint16_t)stack[sp - 1], true); break;
+      case OP_NOT:    stack[sp - 1] = !stack[sp - 1]; break;
+      case OP_NEG:    stack[sp - 1] = (int32_t)(0u - (uint32_t)stack[sp - 1]); break;
+      case OP_INV:    stack[sp - 1] = ~stack[sp - 1]; break;
+      BINARY_OP(OP_MUL, (int32_t)((uint32_t)stack[sp - 1] * (uint32_t)stack[sp]));
+      BINARY_OP(OP_DIV, stack[sp] ? stack[sp - 1] / stack[sp] : 0);
+      BINARY_OP(OP_MOD, stack[sp] ? stack[sp - 1] % stack[sp] : 0);
+      BINARY_OP(OP_ADD, (int32_t)((uint32_t)stack[sp - 1] + (uint32_t)stack[sp]));
+      BINARY_OP(OP_SUB, (int32_t)((uint32_t)stack[sp - 1] - (uint32_t)stack[sp]));
+      BINARY_OP(OP_SHL, (int32_t)((uint32_t)stack[sp - 1] << (stack[sp] & 31)));
+      BINARY_OP(OP_SHR, stack[sp - 1] >> (stack[sp] & 31));
+      BINARY_OP(OP_LT,  stack[sp - 1] < stack[sp]);
+      BINARY_OP(OP_LE,  stack[sp - 1] <= stack[sp]);
+      BINARY_OP(OP_GT,  stack[sp - 1] > stack[sp]);
+      BINARY_OP(OP_GE,  stack[sp - 1] >= stack[sp]);
+      BINARY_OP(OP_EQ,  stack[sp - 1] == stack[sp]);
+      BINARY_OP(OP_NE,  stack[sp - 1] != stack[sp]);
+      BINARY_OP(OP_AND, stack[sp - 1] & stack[sp]);
+      BINARY_OP(OP_XOR, stack[sp - 1] ^ stack[sp]);
+      BINARY_OP(OP_OR,  stack[sp - 1] | stack[sp]);
+      BINARY_OP(OP_LAND, stack[sp - 1] && stack[sp]);
+      BINARY_OP(OP_LOR, stack[sp - 1] || stack[sp]);
+      default:        return 0;
+    }
+  }
+}
+
+
+/* ---- compiler ----
+ *
+ * Recursive descent with C precedence. Each parse function returns where
+ * its code starts, so an operator whose operands both compiled to a single
+ * OP_CONST can replace them with the folded result */
+
+typedef struct
+{
+  const char* src;
+  const char* pos;
+  uint8_t*    code;
+  int         len;
+  int         depth;
+  int         watch;      /* VALUE and ADDR are allowed */
+  const char* error;      /* first error, NULL if none */
+  const char* errorPos;
+} BpCompiler;
+
+typedef struct
+{
+  const char* token;
+  uint8_t     op;
+} BpOperator;
+
+/* binary operators, lowest precedence first */
+#define BP_LEVELS  10
+static const BpOperator operators[BP_LEVELS][5] = {
+  { { "||", OP_LOR } },
+  { { "&&", OP_LAND } },
+  { { "|", OP_OR } },
+  { { "^", OP_XOR } },
+  { { "&", OP_AND } },
+  { { "==", OP_EQ }, { "!=", OP_NE }, { "=", OP_EQ } },
+  { { "<=", OP_LE }, { ">=", OP_GE }, { "<", OP_LT }, { ">", OP_GT } },
+  { { "<<", OP_SHL }, { ">>", OP_SHR } },
+  { { "+", OP_ADD }, { "-", OP_SUB } },
+  { { "*", OP_MUL }, { "/", OP_DIV }, { "%", OP_MOD } },
+};
+
+typedef struct
+{
+  const char* name;
+  uint8_t     op;
+  uint8_t     mask;     /* OP_FLAG */
+} BpName;
+
+static const BpName names[] = {
+  { "A", OP_A, 0 }, { "X", OP_X, 0 }, { "Y", OP_Y, 0 }, { "SP", OP_SP, 0 }, { "S", OP_SP, 0 },
+  { "P", OP_P, 0 }, { "PC", OP_PC, 0 }, { "VALUE", OP_VALUE, 0 }, { "ADDR", OP_ADDR, 0 },
+  { "C", OP_FLAG, FLAG_C }, { "Z", OP_FLAG, FLAG_Z }, { "I", OP_FLAG, FLAG_I },
+  { "D", OP_FLAG, FLAG_D }, { "V", OP_FLAG, FLAG_V }, { "N", OP_FLAG, FLAG_N },
+};
+
+static int parseExpr(BpCompiler* c, int level);
+
+static void fail(BpCompiler* c, const char* error)
+{
+  if (c->error) return;
+  c->error = error;
+  c->errorPos = c->pos;
+}
+
+static void skipSpace(const char** pos)
+{
+  while (**pos == ' ' || **pos == '\t') ++*pos;
+}
+
+/* one byte is always kept for the OP_END */
+static void emit(BpCompiler* c, uint8_t byte)
+{
+  if (c->len >= BP_MAX_CODE - 1)
+  {
+    fail(c, "condition too long");
+    return;
+  }
+  c->code[c->len++] = byte;
+}
+
+/* track the stack depth each instruction leaves */
+static void push(BpCompiler* c, int count)
+{
+  c->depth += count;
+  if (c->depth > BP_MAX_STACK) fail(c, "condition too deeply nested");
+}
+
+static void emitConst(BpCompiler* c, int32_t value)
+{
+  emit(c, OP_CONST);
+  for (int i = 0; i < 4; ++i) emit(c, (uint8_t)((uint32_t)value >> (i * 8)));
+  push(c, 1);
+}
+
+static int isConstAt(BpCompiler* c, int start, int end)
+{
+  return end - start == 5 && c->code[start] == OP_CONST;
+}
+
+/* emit an operator on the operands starting at lhs (and rhs), or fold it */
+static void emitOp(BpCompiler* c, uint8_t op, int lhs, int rhs)
+{
+  int operands = (rhs < 0) ? 1 : 2;
+  if (c->error) return;
+
+  if ((operands == 1 && isConstAt(c, lhs, c->len)) ||
+      (operands == 2 && isConstAt(c, lhs, rhs) && isConstAt(c, rhs, c->len)))
+  {
+    uint8_t program[12];
+    memcpy(program, c->code + lhs, c->len - lhs);
+    program[c->len - lhs] = op;
+    program[c->len - lhs + 1] = OP_END;
+
+    c->len = lhs;
+    push(c, -operands);
+    emitConst(c, bpRun(program, NULL));
+    return;
+  }
+
+  emit(c, op);
+  push(c, 1 - operands);
+}
+
+/* $hex, 0xhex, %binary or decimal */
+static int parseNumber(const char** pos, uint32_t* value)
+{
+  const char* p = *pos;
+  int base = 10;
+  if (*p == '$')
+  {
+    base = 16;
+    ++p;
+  }
+  else if (*p == '%')
+  {
+    base = 2;
+    ++p;
+  }
+  else if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+  {
+    base = 16;
+    p += 2;
+  }
+
+  char* end;
+  unsigned long v = strtoul(p, &end, base);
+  if (end == p || !isxdigit((unsigned char)*p)) return 0;
+  if (isalnum((unsigned char)*end)) return 0;   /* e.g. $12G4 or 12AB */
+
+  *value = (uint32_t)v;
+  *pos = end;
+  return 1;
+}
+
+static int parsePrimary(BpCompiler* c)
+{
+  int start = c->len;
+  skipSpace(&c->pos);
+  char ch = *c->pos;
+
+  if (ch == '(' || ch == '[')
+  {
+    ++c->pos;
+    parseExpr(c, 0);
+    skipSpace(&c->pos);
+    if (*c->pos != (ch == '(' ? ')' : ']'))
+    {
+      fail(c, ch == '(' ? "expected ')'" : "expected ']'");
+      return start;
+    }
+    ++c->pos;
+    if (ch == '[')
+    {
+      emit(c, OP_MEM);    /* never folded: memory changes */
+    }
+    return start;
+  }
+
+  if (ch == '!' || ch == '-' || ch == '~')
+  {
+    ++c->pos;
+    parsePrimary(c);
+    emitOp(c, ch == '!' ? OP_NOT : (ch == '-' ? OP_NEG : OP_INV), start, -1);
+    return start;
+  }
+
+  uint32_t value;
+  if (isdigit((unsigned char)ch) || ch == '$' || ch == '%')
+  {
+    if (!parseNumber(&c->pos, &value)) fail(c, "bad number");
+    else emitConst(c, (int32_t)value);
+    return start;
+  }
+
+  if (isalpha((unsigned char)ch))
+  {
+    char name[8];
+    size_t len = 0;
+    while (isalnum((unsigned char)c->pos[len]) && len < sizeof(name) - 1)
+    {
+      name[len] = (char)toupper((unsigned char)c->pos[len]);
+      ++len;
+    }
+    name[len] = 0;
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+      if (strcmp(name, names[i].name) != 0 || isalnum((unsigned char)c->pos[len])) continue;
+
+      if ((names[i].op == OP_VALUE || names[i].op == OP_ADDR) && !c->watch)
+      {
+        fail(c, "VALUE and ADDR are only known in watches");
+        return start;
+      }
+      c->pos += len;
+      emit(c, names[i].op);
+      if (names[i].op == OP_FLAG) emit(c, names[i].mask);
+      push(c, 1);
+      return start;
+    }
+    fail(c, "unknown name");
+    return start;
+  }
+
+  fail(c, ch ? "expected a value" : "unexpected end of condition");
+  return start;
+}
+
+/* a one character operator mustn't match the start of a two character one
+ * ('|' in "||", '<' in "<<") */
+static int matchOperator(const char* pos, const char* token)
+{
+  size_t len = strlen(token);
+  if (strncmp(pos, token, len) != 0) return 0;
+  if (len == 1 && strchr("|&<>=", token[0]) && pos[1] == token[0]) return 0;
+  return 1;
+}
+
+static int parseExpr(BpCompiler* c, int level)
+{
+  if (level == BP_LEVELS) return parsePrimary(c);
+
+  int start = parseExpr(c, level + 1);
+  while (!c->error)
+  {
+    skipSpace(&c->pos);
+
+    const BpOperator* op = NULL;
+    for (int i = 0; i < 5 && operators[level][i].token; ++i)
+    {
+      if (matchOperator(c->pos, operators[level][i].token))
+      {
+        op = &operators[level][i];
+        break;
+      }
+    }
+    if (!op) break;
+
+    c->pos += strlen(op->token);
+    int rhs = parseExpr(c, level + 1);
+    emitOp(c, op->op, start, rhs);
+  }
+  return start;
+}
+
+/* compile cond into code. returns 0 with a message in error on failure */
+static int bpCompile(const char* cond, int watch, uint8_t* code, char* error, size_t errorSize)
+{
+  BpCompiler c;
+  memset(&c, 0, sizeof(c));
+  c.src = cond;
+  c.pos = cond;
+  c.code = code;
+  c.watch = watch;
+
+  parseExpr(&c, 0);
+  skipSpace(&c.pos);
+  if (!c.error && *c.pos) fail(&c, "unexpected text");
+  c.code[c.len] = OP_END;
+
+  if (c.error)
+  {
+    if (error) snprintf(error, errorSize, "%s at column %d of the condition", c.error, (int)(c.errorPos - c.src) + 1);
+    return 0;
+  }
+  return 1;
+}
+
+
+/* ---- registry ---- */
+
+static int matchWord(const char** pos, const char* word)
+{
+  size_t len = strlen(word);
+  const char* p = *pos;
+  for (size_t i = 0; i < len; ++i)
+  {
+    if (tolower((unsigned char)p[i]) != word[i]) return 0;
+  }
+  if (isalnum((unsigned char)p[len])) return 0;
+  *pos = p + len;
+  skipSpace(pos);
+  return 1;
+}
+
+/* arm the breakpoint addresses and watched pages again */
+static void bpApply()
+{
+  uint8_t pages[0x100] = { 0 };
+
+  clear6502CondBreakpoints(bpCpuDevice);
+  for (int i = 0; i < entryCount; ++i)
+  {
+    BpEntry* entry = &entries[i];
+    if (!entry->watch)
+    {
+      set6502CondBreakpoint(bpCpuDevice, entry->start, 1);
+      continue;
+    }
+    for (int page = entry->start >> 8; page <= entry->end >> 8; ++page)
+    {
+      pages[page] |= entry->watch;
+    }
+  }
+
+  for (int page = 0; page < 0x100; ++page)
+  {
+    if (pages[page] != watchPages[page])
+    {
+      watchPages[page] = pages[page];
+      hbc56WatchPage((uint8_t)page, pages[page]);
+    }
+  }
+}
+
+/* the CPU has reached an armed address */
+static int bpBreakCondition(uint16_t addr, const HBC56CpuRegs* regs)
+{
+  BpContext ctx;
+  ctx.regs = *regs;
+  ctx.addr = addr;
+  ctx.value = 0;
+
+  for (int i = 0; i < entryCount; ++i)
+  {
+    BpEntry* entry = &entries[i];
+    if (entry->watch || entry->start != addr) continue;
+    if (entry->hasCond && !bpRun(entry->code, &ctx)) continue;
+
+    ++entry->hits;
+    snprintf(lastHit, sizeof(lastHit), "Breakpoint %s", entry->spec);
+    return 1;
+  }
+  return 0;
+}
+
+/* the CPU has accessed a watched page */
+static int bpWatchAccess(uint16_t addr, uint8_t val, bool write)
+{
+  uint8_t access = write ? HBC56_WATCH_WRITE : HBC56_WATCH_READ;
+  BpContext ctx;
+  int haveRegs = 0;
+
+  for (int i = 0; i < entryCount; ++i)
+  {
+    BpEntry* entry = &entries[i];
+    if (!(entry->watch & access) || addr < entry->start || addr > entry->end) continue;
+
+    if (!haveRegs)
+    {
+      get6502Registers(bpCpuDevice, &ctx.regs);
+      ctx.regs.pc = get6502InstructionPC(bpCpuDevice);
+      ctx.addr = addr;
+      ctx.value = val;
+      haveRegs = 1;
+    }
+    if (entry->hasCond && !bpRun(entry->code, &ctx)) continue;
+
+    ++entry->hits;
+    snprintf(lastHit, sizeof(lastHit), "Watch %s: %s $%04X %s $%02X at PC $%04X", entry->spec,
+      write ? "write" : "read", addr, write ? "<-" : "->", val, ctx.regs.pc);
+    return 1;
+  }
+  return 0;
+}
+
+void bpInit(HBC56Device* cpuDevice)
+{
+  bpCpuDevice = cpuDevice;
+  set6502BreakCondition(cpuDevice, bpBreakCondition);
+  hbc56SetWatchHandler(bpWatchAccess);
+  bpClear();
+}
+
+int bpAdd(const char* spec, char* error, size_t errorSize)
+{
+  if (entryCount >= BP_MAX_ENTRIES)
+  {
+    if (error) snprintf(error, errorSize, "no more than %d breakpoints and watches", BP_MAX_ENTRIES);
+    return -1;
+  }
+
+  BpEntry* entry = &entries[entryCount];
+  memset(entry, 0, sizeof(*entry));
+
+  const char* p = spec;
+  skipSpace(&p);
+  strncpy(entry->spec, p, sizeof(entry->spec) - 1);
+  size_t len = strlen(entry->spec);
+  while (len && isspace((unsigned char)entry->spec[len - 1])) entry->spec[--len] = 0;
+
+  if (matchWord(&p, "read")) entry->watch = HBC56_WATCH_READ;
+  else if (matchWord(&p, "write")) entry->watch = HBC56_WATCH_WRITE;
+  else if (matchWord(&p, "access")) entry->watch = HBC56_WATCH_READ | HBC56_WATCH_WRITE;
+
+  uint32_t start, end;
+  if (!parseNumber(&p, &start) || start > 0xffff)
+  {
+    if (error) snprintf(error, errorSize, "expected an address ($0000-$FFFF)");
+    return -1;
+  }
+  end = start;
+
+  skipSpace(&p);
+  if (entry->watch && *p == '-')
+  {
+    ++p;
+    skipSpace(&p);
+    if (!parseNumber(&p, &end) || end > 0xffff || end < start)
+    {
+      if (error) snprintf(error, errorSize, "expected an end address after '-'");
+      return -1;
+    }
+    skipSpace(&p);
+  }
+  entry->start = (uint16_t)start;
+  entry->end = (uint16_t)end;
+
+  if (*p)
+  {
+    if (!matchWord(&p, "if") || !*p)
+    {
+      if (error) snprintf(error, errorSize, "expected 'if <condition>' after the address");
+      return -1;
+    }
+    if (!bpCompile(p, entry->watch != 0, entry->code, error, errorSize)) return -1;
+    entry->hasCond = 1;
+  }
+
+  ++entryCount;
+  bpApply();
+  return entryCount - 1;
+}
+
+void bpRemove(int index)
+{
+  if (index < 0 || index >= entryCount) return;
+
+  memmove(&entries[index], &entries[index + 1], (entryCount - index - 1) * sizeof(entries[0]));
+  --entryCount;
+  bpApply();
+}
+
+void bpClear()
+{
+  entryCount = 0;
+  lastHit[0] = 0;
+  bpApply();
+}
+
+int bpCount()
+{
+  return entryCount;
+}
+
+const char* bpGet(int index, uint64_t* hits)
+{
+  if (index < 0 || index >= entryCount) return NULL;
+  if (hits) *hits = entries[index].hits;
+  return entries[index].spec;
+}
+
+const char* bpLastHit()
+{
+  return lastHit;
+}
+
+void bpPrintStats(FILE* out)
+{
+  for (int i = 0; i < entryCount; ++i)
+  {
+    fprintf(out, "  %-5s %-40s: %llu hits\n", entries[i].watch ? "watch" : "break", entries[i].spec,
+      (unsigned long long)entries[i].hits);
+  }
+}
@@ -0,0 +1,86 @@
+/*
+ * DB6502 Emulator - Conditional breakpoints and watchpoints
+ *
+ * Breakpoints with a condition, and memory watches, given as text and
+ * compiled once into bytecode. Conditions are only evaluated when the CPU
+ * reaches an armed address or touches a watched page.
+ */
+
+#ifndef _DB6502_BREAKPOINTS_H_
+#define _DB6502_BREAKPOINTS_H_
+
+#include "devices/device.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define BP_MAX_ENTRIES  32
+#define BP_MAX_SPEC     96    /* spec length, with its terminator */
+#define BP_MAX_HIT      192   /* bpLastHit() length, with its terminator */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Function:  bpInit
+ * --------------------
+ * route the CPU device's break conditions and the bus watches to the
+ * registry
+ */
+void bpInit(HBC56Device* cpuDevice);
+
+/* Function:  bpAdd
+ * --------------------
+ * add a breakpoint or watchpoint:
+ *   <addr> [if <cond>]                          e.g. $E03A if A==$0D
+ *   read|write|access <addr>[-<end>] [if <cond>]  e.g. write $8400
+ * cond is a C-style expression over A X Y SP P PC, the flags C Z I D V N,
+ * memory bytes [addr] and, in watches, VALUE and ADDR of the access.
+ * returns the new entry's index, or -1 with a message in error
+ */
+int bpAdd(const char* spec, char* error, size_t errorSize);
+
+/* Function:  bpRemove
+ * --------------------
+ * remove the entry at index
+ */
+void bpRemove(int index);
+
+/* Function:  bpClear
+ * --------------------
+ * remove every entry
+ */
+void bpClear();
+
+/* Function:  bpCount
+ * --------------------
+ * number of entries
+ */
+int bpCount();
+
+/* Function:  bpGet
+ * --------------------
+ * spec of the entry at index (NULL past the last) and, in hits, how often
+ * it has stopped the CPU
+ */
+const char* bpGet(int index, uint64_t* hits);
+
+/* Function:  bpLastHit
+ * --------------------
+ * description of what last stopped the CPU ("" if nothing has)
+ */
+const char* bpLastHit();
+
+/* Function:  bpPrintStats
+ * --------------------
+ * print each entry and how often it hit
+ */
+void bpPrintStats(FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
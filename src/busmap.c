@@ -0,0 +1,125 @@
+/*
+ * DB6502 Emulator - address decoder
+ *
+ * Each 256 byte page resolves directly to the mapping that owns it (stored
+ * as mapping index + 1, so zero is unmapped). Pages shared by more than one
+ * mapping (the I/O window, where devices only occupy a few registers each)
+ * are marked BUS_SPLIT_PAGE and resolved one byte at a time through
+ * busByteMap. busFallbackMap holds, per byte, the mapping under the owner.
+ */
+
+#include "busmap.h"
+
+#include <string.h>
+
+#define BUS_UNMAPPED      0x00
+#define BUS_SPLIT_PAGE    0xff
+
+static BusMapping busMappings[HBC56_MAX_DEVICES];
+static int busMappingCount = 0;
+static uint8_t busPageMap[BUS_PAGE_COUNT];
+static uint8_t busByteMap[0x10000];
+static uint8_t busFallbackMap[0x10000];
+
+
+static const BusMapping* busMapping(uint8_t index)
+{
+  return (index == BUS_UNMAPPED) ? NULL : &busMappings[index - 1];
+}
+
+/* the best mapping of addr, passing over one (or none, if skip is zero).
+ * mappings are kept in the order they were added, so only a strictly
+ * higher priority takes over */
+static void busResolve(uint8_t* map, uint8_t* priority, const uint8_t* skip)
+{
+  memset(map, BUS_UNMAPPED, 0x10000);
+  memset(priority, 0, 0x10000);
+
+  for (int m = 0; m < busMappingCount; ++m)
+  {
+    BusMapping* mapping = &busMappings[m];
+    for (uint32_t addr = mapping->startAddr; addr < mapping->endAddr; ++addr)
+    {
+      if (skip && skip[addr] == m + 1) continue;
+      if (map[addr] == BUS_UNMAPPED || mapping->priority > priority[addr])
+      {
+        map[addr] = (uint8_t)(m + 1);
+        priority[addr] = mapping->priority;
+      }
+    }
+  }
+}
+
+static void busRebuild()
+{
+  static uint8_t busPriority[0x10000];
+
+  busResolve(busByteMap, busPriority, NULL);
+  busResolve(busFallbackMap, busPriority, busByteMap);
+
+  /* collapse pages with a single owner */
+  for (int page = 0; page < BUS_PAGE_COUNT; ++page)
+  {
+    const uint8_t* pageOwners = busByteMap + (page << 8);
+    busPageMap[page] = pageOwners[0];
+    for (int offset = 1; offset < 0x100; ++offset)
+    {
+      if (pageOwners[offset] != pageOwners[0])
+      {
+        busPageMap[page] = BUS_SPLIT_PAGE;
+        break;
+      }
+    }
+  }
+}
+
+void busMapReset()
+{
+  busMappingCount = 0;
+  busRebuild();
+}
+
+int busMapAdd(HBC56Device* device, uint32_t startAddr, uint32_t endAddr, uint8_t priority, uint8_t* memory, int writable)
+{
+  if (!device || busMappingCount >= HBC56_MAX_DEVICES) return 0;
+  if (endAddr > 0x10000) endAddr = 0x10000;
+  if (startAddr >= endAddr) return 0;
+
+  BusMapping* mapping = &busMappings[busMappingCount++];
+  mapping->device = device;
+  mapping->priority = priority;
+  mapping->startAddr = startAddr;
+  mapping->endAddr = endAddr;
+  mapping->memory = memory;
+  mapping->writable = writable;
+
+  busRebuild();
+  return 1;
+}
+
+const BusMapping* busMapOwner(uint16_t addr)
+{
+  uint8_t owner = busPageMap[addr >> 8];
+  if (owner == BUS_SPLIT_PAGE) owner = busByteMap[addr];
+  return busMapping(owner);
+}
+
+const BusMapping* busMapFallback(uint16_t addr)
+{
+  return busMapping(busFallbackMap[addr]);
+}
+
+const BusMapping* busMapPageOwner(int page)
+{
+  uint8_t owner = busPageMap[page];
+  return (owner == BUS_SPLIT_PAGE) ? NULL : busMapping(owner);
+}
+
+const BusMapping* busMapFind(const HBC56Device* device)
+{
+  for (int m = 0; m < busMappingCount; ++m)
+  {
+    if (busMappings[m].device == device) return &busMappings[m];
+  }
+  return NULL;
+}
@@ -0,0 +1,79 @@
+/*
+ * DB6502 Emulator - address decoder
+ *
+ * Each mapping gives a device (or a plain memory buffer) an address range
+ * and a priority. Every address resolves to its owner, the highest
+ * priority mapping that covers it, and to a fallback: the mapping it
+ * would have resolved to without its owner. A device that doesn't decode
+ * every address of its window leaves the rest to the fallback, which is
+ * how I/O windows over ROM behaved when the bus scanned every device.
+ */
+
+#ifndef _DB6502_BUSMAP_H_
+#define _DB6502_BUSMAP_H_
+
+#include "config.h"
+#include "devices/device.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BUS_PAGE_COUNT    256
+
+typedef struct
+{
+  HBC56Device*  device;
+  uint8_t       priority;
+  uint32_t      startAddr;
+  uint32_t      endAddr;
+  uint8_t*      memory;     /* host buffer of plain memory, or NULL */
+  int           writable;
+} BusMapping;
+
+/* Function:  busMapReset
+ * --------------------
+ * remove every mapping
+ */
+void busMapReset();
+
+/* Function:  busMapAdd
+ * --------------------
+ * map a device over [startAddr, endAddr). memory is its host buffer if it
+ * is plain memory. where mappings overlap, only a strictly higher priority
+ * takes an address from an earlier one. non-zero if mapped
+ */
+int busMapAdd(HBC56Device* device, uint32_t startAddr, uint32_t endAddr, uint8_t priority, uint8_t* memory, int writable);
+
+/* Function:  busMapOwner
+ * --------------------
+ * the mapping addr resolves to, or NULL
+ */
+const BusMapping* busMapOwner(uint16_t addr);
+
+/* Function:  busMapFallback
+ * --------------------
+ * the mapping addr goes to if its owner doesn't decode it, or NULL
+ */
+const BusMapping* busMapFallback(uint16_t addr);
+
+/* Function:  busMapPageOwner
+ * --------------------
+ * the mapping owning every address of the page, or NULL if the page is
+ * unmapped or shared
+ */
+const BusMapping* busMapPageOwner(int page);
+
+/* Function:  busMapFind
+ * --------------------
+ * the first mapping of the device, or NULL
+ */
+const BusMapping* busMapFind(const HBC56Device* device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
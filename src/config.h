@@ -12,9 +12,10 @@
 
 /* emulator configuration values
   -------------------------------------------------------------------------- */
-#define HBC56_HAVE_THREADS      0
+#define HBC56_HAVE_THREADS      1         /* emulation core on its own thread */
 
 #define HBC56_CLOCK_FREQ        4000000   /* 4 MHz emulation speed */
+#define HBC56_CPU_MODEL         CPU65XX_W65C02  /* see cpu/cpu65xx.h */
 #define HBC56_AUDIO_FREQ        48000
 #define HBC56_MAX_DEVICES       16
 
@@ -35,27 +36,33 @@
 #define HBC56_HAVE_TMS9918      1
 #define HBC56_TMS9918_DAT_ADDR  0x8200
 #define HBC56_TMS9918_REG_ADDR  0x8201
+#define HBC56_TMS9918_SIZE      0x02
 #define HBC56_TMS9918_IRQ       0         /* disabled - ROM doesn't handle VDP IRQs */
 
 #define HBC56_HAVE_AY_3_8910    1
 #define HBC56_AY_3_8910_COUNT   1
 #define HBC56_AY38910_A_ADDR    0x8300
+#define HBC56_AY38910_SIZE      0x04
 #define HBC56_AY38910_CLOCK     1000000   /* 1 MHz */
 
 #define HBC56_HAVE_ACIA         1
 #define HBC56_ACIA_ADDR         0x8400
+#define HBC56_ACIA_SIZE         0x04
 #define HBC56_ACIA_IRQ          2
 
 #define HBC56_HAVE_VIA2         1
 #define HBC56_VIA2_ADDR         0x8800
+#define HBC56_VIA2_SIZE         0x10
 #define HBC56_VIA2_IRQ          0         /* disabled - ROM doesn't handle VIA2 IRQs */
 
 #define HBC56_HAVE_VIA          1
 #define HBC56_VIA_ADDR          0x9000
+#define HBC56_VIA_SIZE          0x10
 #define HBC56_VIA_IRQ           0         /* disabled - ROM doesn't handle VIA1 IRQs */
 
 #define HBC56_HAVE_KB           1
-#define HBC56_KB_ADDR           0x9000    /* KB on VIA1 port A */
+#define HBC56_KB_ADDR           0x9000    /* the device's own; read through VIA1 port A */
+#define HBC56_KB_SIZE           0x02
 #define HBC56_KB_IRQ            0         /* disabled - ROM doesn't handle KB IRQs */
 
 /* disabled devices */
@@ -0,0 +1,1467 @@
+/*
+ * DB6502 Emulator - 65xx CPU core
+ *
+ * Handlers are instantiated per operation, addressing mode and CPU variant
+ * from the templates below, and each variant's opcode table gives every
+ * opcode its handler, mode and base cycles. The variant (NMOS or CMOS
+ * opcodes, bit instructions, WAI/STP, decimal mode and its extra cycle) is a
+ * template parameter, so a core has no variant tests at run time. Decoding
+ * fills a cache entry per address, so running a cached instruction costs a
+ * generation check and one indirect call.
+ *
+ * Every memory page has a generation number that the core bumps when it
+ * writes the page. A cache entry is only used while its page is still at
+ * the generation it was decoded at. The CPU can't write ROM, so ROM entries
+ * stay valid until cpu65xxInvalidateCode().
+ *
+ * cpu65xxRunBlock() goes a step further for hot code: a run of decoded
+ * instructions up to the next jump or page end is copied into a block
+ * (threaded code), which then runs as a straight sequence of handler calls.
+ * Blocks are checked against their page generation once on entry and after
+ * each instruction, and are left early after any I/O access so the caller
+ * sees device side effects (IRQs, run stops) at the same instruction
+ * boundary the interpreter would.
+ *
+ * While translating, a few hot sequences (DEX; BNE, CMP #; BEQ, the
+ * LDA (zp),Y; STA (zp),Y; INY copy step) are fused into one superinstruction
+ * entry. --cpu=interp never fuses, so it stays the reference.
+ *
+ * Cycle counts follow the W65C02S datasheet: +1 for a page crossed by an
+ * indexed read, +1 for a taken branch (+1 more across a page) and +1 for
+ * ADC/SBC in decimal mode. The NMOS 6502 has no decimal cycle, 7 cycle
+ * abs,X shifts and the JMP ($xxFF) page wrap. Its undocumented opcodes run
+ * as NOPs. Dummy accesses aren't made.
+ */
+
+#include "cpu/cpu65xx.h"
+
+#include <stdlib.h>
+
+/* with four instantiations of every handler, the compiler's inline budget
+ * runs out before the bus helpers. they must inline: they are the fast path */
+#ifdef _MSC_VER
+#define FORCE_INLINE  static __forceinline
+#else
+#define FORCE_INLINE  static inline __attribute__((always_inline))
+#endif
+
+#define FLAG_C  0x01
+#define FLAG_Z  0x02
+#define FLAG_I  0x04
+#define FLAG_D  0x08
+#define FLAG_B  0x10
+#define FLAG_U  0x20
+#define FLAG_V  0x40
+#define FLAG_N  0x80
+
+#define VECTOR_NMI    0xfffa
+#define VECTOR_RESET  0xfffc
+#define VECTOR_IRQ    0xfffe
+
+#define STACK_PAGE    0x0100
+#define PAGE_COUNT    256
+#define CACHE_SIZE    0x10000
+
+#define INTERRUPT_CYCLES  7
+
+#define OPCODE_DEY        0x88
+#define OPCODE_STA_IZY    0x91
+#define OPCODE_LDA_IZY    0xb1
+#define OPCODE_INY        0xc8
+#define OPCODE_CMP_IMM    0xc9
+#define OPCODE_DEX        0xca
+#define OPCODE_BNE        0xd0
+#define OPCODE_BEQ        0xf0
+
+#define BLOCK_MAX_INSTS   32
+#define BLOCK_HOT_COUNT   8     /* entries before an address gets a block */
+
+struct Decoded;
+struct Block;
+typedef uint8_t (*OpHandler)(Cpu65xx* cpu, const Decoded* d);
+
+/* a predecoded instruction. handlers return any cycles beyond the base */
+struct Decoded
+{
+  OpHandler handler;
+  uint64_t  gen;          /* page generation it was decoded at */
+  uint16_t  operand;      /* immediate value, address or branch target */
+  uint8_t   zp;           /* BBR/BBS: the zero page address tested */
+  uint8_t   opcode;
+  uint8_t   length;
+  uint8_t   cycles;
+  uint8_t   takenCycles;  /* branches: extra cycles when taken */
+};
+
+struct Cpu65xx
+{
+  uint16_t  pc;
+  uint8_t   a, x, y, sp, p;
+
+  bool      irq;
+  bool      nmi;
+  bool      nmiPending;
+  bool      waiting;      /* WAI */
+  bool      stopped;      /* STP */
+
+  uint16_t  instPc;       /* address of the last instruction run */
+  uint8_t   currentOpcode;
+  uint8_t   accessCycle;
+  uint32_t  runCycles;    /* cycles of a block run before this instruction */
+  bool      ioAccess;
+
+  uint8_t   scratchSp;
+  bool      writeSeen;
+
+  Cpu65xxMemRead        memRead;
+  Cpu65xxMemWrite       memWrite;
+  const uint8_t* const* readPages;
+  uint8_t* const*       writePages;
+
+  uint64_t  fusionCounts[CPU65XX_FUSION_COUNT];
+
+  uint64_t  pageGen[PAGE_COUNT];
+  Decoded   scratch;      /* an instruction that can't be cached */
+  Decoded*  cache;
+
+  /* threaded code. allocated by the first cpu65xxRunBlock() */
+  Block**         blocks;
+  uint8_t*        heat;
+  uint32_t        blockEpoch;
+  Cpu65xxBlockEndFn blockEnd;
+
+  Cpu65xxEventFn  eventHook;
+
+  Cpu65xxModel    model;  /* picks the instantiation to run */
+};
+
+/* a straight run of instructions from one memory page. only the last can
+ * transfer control or change the interrupt mask */
+struct Block
+{
+  uint64_t  gen;
+  uint32_t  epoch;
+  uint16_t  maxCycles;    /* with every page crossing and branch taken */
+  uint8_t   count;
+  Decoded   insts[BLOCK_MAX_INSTS];
+};
+
+enum Mode { IMP, ACC, IMM, ZP, ZPX, ZPY, ABS, ABX, ABY, IND, IAX, IZX, IZY, IZP, REL, ZPR };
+
+/* what a core is compiled for */
+template <bool CMOS_, bool BITOPS_, bool WDC_, bool BCD_, bool DECIMAL_CYCLE_>
+struct Variant
+{
+  static const bool CMOS = CMOS_;                   /* 65C02 opcodes and fixes */
+  static const bool BITOPS = BITOPS_;               /* RMB/SMB/BBR/BBS */
+  static const bool WDC = WDC_;                     /* WAI/STP */
+  static const bool BCD = BCD_;                     /* decimal mode */
+  static const bool DECIMAL_CYCLE = DECIMAL_CYCLE_; /* +1 cycle for ADC/SBC with D set */
+};
+
+typedef Variant<false, false, false, true,  false> Nmos6502;
+typedef Variant<false, false, false, false, false> Nmos6502NoBcd;
+typedef Variant<true,  false, false, true,  true>  Cmos65C02;
+typedef Variant<true,  true,  true,  true,  true>  Wdc65C02;
+
+static const uint8_t modeLength[] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 2, 2, 2, 2, 3 };
+
+
+/* bus access. cycle is the access's cycle within the instruction */
+FORCE_INLINE uint8_t busRead(Cpu65xx* cpu, uint16_t addr, uint8_t cycle)
+{
+  const uint8_t* page = cpu->readPages[addr >> 8];
+  if (page) return page[addr & 0xff];
+
+  cpu->accessCycle = cycle;
+  cpu->ioAccess = true;
+  return cpu->memRead(addr, false);
+}
+
+FORCE_INLINE uint16_t busRead16(Cpu65xx* cpu, uint16_t addr, uint8_t cycle)
+{
+  return busRead(cpu, addr, cycle) | (busRead(cpu, (uint16_t)(addr + 1), cycle + 1) << 8);
+}
+
+FORCE_INLINE uint16_t zpRead16(Cpu65xx* cpu, uint8_t zp, uint8_t cycle)
+{
+  return busRead(cpu, zp, cycle) | (busRead(cpu, (uint8_t)(zp + 1), cycle + 1) << 8);
+}
+
+FORCE_INLINE void busWrite(Cpu65xx* cpu, uint16_t addr, uint8_t val, uint8_t cycle)
+{
+  uint8_t hi = addr >> 8;
+  if (hi != (STACK_PAGE >> 8) || (addr & 0xff) > cpu->scratchSp) cpu->writeSeen = true;
+
+  uint8_t* page = cpu->writePages[hi];
+  if (page)
+  {
+    page[addr & 0xff] = val;
+    ++cpu->pageGen[hi];
+    return;
+  }
+
+  cpu->accessCycle = cycle;
+  cpu->ioAccess = true;
+  cpu->memWrite(addr, val);
+}
+
+FORCE_INLINE void push(Cpu65xx* cpu, uint8_t val)
+{
+  busWrite(cpu, STACK_PAGE | cpu->sp--, val, 0);
+}
+
+FORCE_INLINE uint8_t pull(Cpu65xx* cpu)
+{
+  return busRead(cpu, STACK_PAGE | ++cpu->sp, 0);
+}
+
+FORCE_INLINE void setNZ(Cpu65xx* cpu, uint8_t val)
+{
+  cpu->p = (cpu->p & ~(FLAG_N | FLAG_Z)) | (val & FLAG_N) | (val ? 0 : FLAG_Z);
+}
+
+
+/* effective address of a memory operand. extra counts the page crossing
+ * cycle of indexed reads (NULL for writes, which always take it) */
+template <Mode M>
+static inline uint16_t address(Cpu65xx* cpu, const Decoded* d, uint8_t* extra)
+{
+  switch (M)
+  {
+    case ZP:
+    case ABS:
+      return d->operand;
+
+    case ZPX:
+      return (uint8_t)(d->operand + cpu->x);
+
+    case ZPY:
+      return (uint8_t)(d->operand + cpu->y);
+
+    case ABX:
+    case ABY:
+    {
+      uint16_t addr = (uint16_t)(d->operand + (M == ABX ? cpu->x : cpu->y));
+      if (extra && ((addr ^ d->operand) & 0xff00)) ++*extra;
+      return addr;
+    }
+
+    case IZX:
+      return zpRead16(cpu, (uint8_t)(d->operand + cpu->x), 2);
+
+    case IZY:
+    {
+      uint16_t base = zpRead16(cpu, (uint8_t)d->operand, 2);
+      uint16_t addr = (uint16_t)(base + cpu->y);
+      if (extra && ((addr ^ base) & 0xff00)) ++*extra;
+      return addr;
+    }
+
+    case IZP:
+      return zpRead16(cpu, (uint8_t)d->operand, 2);
+
+    default:
+      return 0;
+  }
+}
+
+/* the value a read instruction operates on. the read is its last cycle */
+template <Mode M>
+static inline uint8_t operand(Cpu65xx* cpu, const Decoded* d, uint8_t* extra)
+{
+  if (M == IMM) return (uint8_t)d->operand;
+
+  uint16_t addr = address<M>(cpu, d, extra);
+  return busRead(cpu, addr, d->cycles + *extra - 1);
+}
+
+
+/* ---- loads, logic and arithmetic ---- */
+
+template <Mode M>
+static uint8_t opLDA(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  cpu->a = operand<M>(cpu, d, &extra);
+  setNZ(cpu, cpu->a);
+  return extra;
+}
+
+template <Mode M>
+static uint8_t opLDX(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  cpu->x = operand<M>(cpu, d, &extra);
+  setNZ(cpu, cpu->x);
+  return extra;
+}
+
+template <Mode M>
+static uint8_t opLDY(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  cpu->y = operand<M>(cpu, d, &extra);
+  setNZ(cpu, cpu->y);
+  return extra;
+}
+
+template <Mode M>
+static uint8_t opAND(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  cpu->a &= operand<M>(cpu, d, &extra);
+  setNZ(cpu, cpu->a);
+  return extra;
+}
+
+template <Mode M>
+static uint8_t opORA(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  cpu->a |= operand<M>(cpu, d, &extra);
+  setNZ(cpu, cpu->a);
+  return extra;
+}
+
+template <Mode M>
+static uint8_t opEOR(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  cpu->a ^= operand<M>(cpu, d, &extra);
+  setNZ(cpu, cpu->a);
+  return extra;
+}
+
+static inline void compare(Cpu65xx* cpu, uint8_t reg, uint8_t val)
+{
+  cpu->p = (cpu->p & ~FLAG_C) | (reg >= val ? FLAG_C : 0);
+  setNZ(cpu, (uint8_t)(reg - val));
+}
+
+template <Mode M>
+static uint8_t opCMP(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  compare(cpu, cpu->a, operand<M>(cpu, d, &extra));
+  return extra;
+}
+
+template <Mode M>
+static uint8_t opCPX(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  compare(cpu, cpu->x, operand<M>(cpu, d, &extra));
+  return extra;
+}
+
+template <Mode M>
+static uint8_t opCPY(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  compare(cpu, cpu->y, operand<M>(cpu, d, &extra));
+  return extra;
+}
+
+/* BIT #imm only affects Z */
+template <Mode M>
+static uint8_t opBIT(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  uint8_t val = operand<M>(cpu, d, &extra);
+  uint8_t flags = cpu->p & ~FLAG_Z;
+  if (M != IMM) flags = (flags & ~(FLAG_N | FLAG_V)) | (val & (FLAG_N | FLAG_V));
+  cpu->p = flags | ((cpu->a & val) ? 0 : FLAG_Z);
+  return extra;
+}
+
+/* in decimal mode the 65C02's N and Z reflect the BCD result. the NMOS
+ * 6502 sets Z from the binary sum and N from the unadjusted high digit */
+template <class V>
+static inline void adc(Cpu65xx* cpu, uint8_t val, uint8_t* extra)
+{
+  uint8_t carry = cpu->p & FLAG_C;
+  uint8_t flags = cpu->p & ~(FLAG_C | FLAG_V);
+
+  if (V::BCD && (cpu->p & FLAG_D))
+  {
+    if (V::DECIMAL_CYCLE) ++*extra;
+    int lo = (cpu->a & 0x0f) + (val & 0x0f) + carry;
+    if (lo >= 0x0a) lo = ((lo + 0x06) & 0x0f) + 0x10;
+    int sum = (cpu->a & 0xf0) + (val & 0xf0) + lo;
+    int signedSum = (int8_t)(cpu->a & 0xf0) + (int8_t)(val & 0xf0) + lo;
+    if (signedSum < -128 || signedSum > 127) flags |= FLAG_V;
+
+    if (!V::CMOS)
+    {
+      uint8_t binary = (uint8_t)(cpu->a + val + carry);
+      flags = (flags & ~(FLAG_N | FLAG_Z)) | (sum & FLAG_N) | (binary ? 0 : FLAG_Z);
+    }
+
+    if (sum >= 0xa0) sum += 0x60;
+    if (sum >= 0x100) flags |= FLAG_C;
+    cpu->a = (uint8_t)sum;
+
+    if (!V::CMOS)
+    {
+      cpu->p = flags;
+      return;
+    }
+  }
+  else
+  {
+    unsigned sum = cpu->a + val + carry;
+    if (sum > 0xff) flags |= FLAG_C;
+    if (~(cpu->a ^ val) & (cpu->a ^ sum) & 0x80) flags |= FLAG_V;
+    cpu->a = (uint8_t)sum;
+  }
+
+  cpu->p = flags;
+  setNZ(cpu, cpu->a);
+}
+
+/* the NMOS 6502 sets every flag from the binary difference */
+template <class V>
+static inline void sbc(Cpu65xx* cpu, uint8_t val, uint8_t* extra)
+{
+  int borrow = (cpu->p & FLAG_C) ? 0 : 1;
+  int diff = cpu->a - val - borrow;
+  uint8_t flags = cpu->p & ~(FLAG_C | FLAG_V);
+  if (diff >= 0) flags |= FLAG_C;
+  if ((cpu->a ^ val) & (cpu->a ^ diff) & 0x80) flags |= FLAG_V;
+
+  if (V::BCD && (cpu->p & FLAG_D))
+  {
+    if (V::DECIMAL_CYCLE) ++*extra;
+    int lo = (cpu->a & 0x0f) - (val & 0x0f) - borrow;
+
+    if (V::CMOS)
+    {
+      if (diff < 0) diff -= 0x60;
+      if (lo < 0) diff -= 0x06;
+    }
+    else
+    {
+      cpu->p = flags;
+      setNZ(cpu, (uint8_t)diff);
+      if (lo < 0) lo = ((lo - 0x06) & 0x0f) - 0x10;
+      diff = (cpu->a & 0xf0) - (val & 0xf0) + lo;
+      if (diff < 0) diff -= 0x60;
+      cpu->a = (uint8_t)diff;
+      return;
+    }
+  }
+
+  cpu->a = (uint8_t)diff;
+  cpu->p = flags;
+  setNZ(cpu, cpu->a);
+}
+
+template <class V, Mode M>
+static uint8_t opADC(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  adc<V>(cpu, operand<M>(cpu, d, &extra), &extra);
+  return extra;
+}
+
+template <class V, Mode M>
+static uint8_t opSBC(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t extra = 0;
+  sbc<V>(cpu, operand<M>(cpu, d, &extra), &extra);
+  return extra;
+}
+
+/* the 1-3 byte NOPs still read their operand on real hardware. nothing
+ * in DB6502's I/O space cares, so they don't here */
+static uint8_t opNOP(Cpu65xx*, const Decoded*)
+{
+  return 0;
+}
+
+
+/* ---- stores ---- */
+
+template <Mode M>
+static uint8_t opSTA(Cpu65xx* cpu, const Decoded* d)
+{
+  busWrite(cpu, address<M>(cpu, d, NULL), cpu->a, d->cycles - 1);
+  return 0;
+}
+
+template <Mode M>
+static uint8_t opSTX(Cpu65xx* cpu, const Decoded* d)
+{
+  busWrite(cpu, address<M>(cpu, d, NULL), cpu->x, d->cycles - 1);
+  return 0;
+}
+
+template <Mode M>
+static uint8_t opSTY(Cpu65xx* cpu, const Decoded* d)
+{
+  busWrite(cpu, address<M>(cpu, d, NULL), cpu->y, d->cycles - 1);
+  return 0;
+}
+
+template <Mode M>
+static uint8_t opSTZ(Cpu65xx* cpu, const Decoded* d)
+{
+  busWrite(cpu, address<M>(cpu, d, NULL), 0, d->cycles - 1);
+  return 0;
+}
+
+
+/* ---- read-modify-write ---- */
+
+typedef uint8_t (*RmwFn)(Cpu65xx* cpu, uint8_t val);
+
+static uint8_t asl(Cpu65xx* cpu, uint8_t val)
+{
+  cpu->p = (cpu->p & ~FLAG_C) | (val >> 7);
+  val <<= 1;
+  setNZ(cpu, val);
+  return val;
+}
+
+static uint8_t lsr(Cpu65xx* cpu, uint8_t val)
+{
+  cpu->p = (cpu->p & ~FLAG_C) | (val & FLAG_C);
+  val >>= 1;
+  setNZ(cpu, val);
+  return val;
+}
+
+static uint8_t rol(Cpu65xx* cpu, uint8_t val)
+{
+  uint8_t result = (uint8_t)((val << 1) | (cpu->p & FLAG_C));
+  cpu->p = (cpu->p & ~FLAG_C) | (val >> 7);
+  setNZ(cpu, result);
+  return result;
+}
+
+static uint8_t ror(Cpu65xx* cpu, uint8_t val)
+{
+  uint8_t result = (uint8_t)((val >> 1) | ((cpu->p & FLAG_C) << 7));
+  cpu->p = (cpu->p & ~FLAG_C) | (val & FLAG_C);
+  setNZ(cpu, result);
+  return result;
+}
+
+static uint8_t inc(Cpu65xx* cpu, uint8_t val)
+{
+  setNZ(cpu, ++val);
+  return val;
+}
+
+static uint8_t dec(Cpu65xx* cpu, uint8_t val)
+{
+  setNZ(cpu, --val);
+  return val;
+}
+
+static uint8_t tsb(Cpu65xx* cpu, uint8_t val)
+{
+  cpu->p = (cpu->p & ~FLAG_Z) | ((cpu->a & val) ? 0 : FLAG_Z);
+  return val | cpu->a;
+}
+
+static uint8_t trb(Cpu65xx* cpu, uint8_t val)
+{
+  cpu->p = (cpu->p & ~FLAG_Z) | ((cpu->a & val) ? 0 : FLAG_Z);
+  return val & ~cpu->a;
+}
+
+template <int BIT>
+static uint8_t rmb(Cpu65xx*, uint8_t val)
+{
+  return val & ~(1 << BIT);
+}
+
+template <int BIT>
+static uint8_t smb(Cpu65xx*, uint8_t val)
+{
+  return val | (1 << BIT);
+}
+
+/* read, internal cycle, write. ASL/LSR/ROL/ROR abs,X take the page
+ * crossing cycle (PENALTY), INC/DEC abs,X always take 7 */
+template <Mode M, RmwFn F, bool PENALTY = false>
+static uint8_t opRMW(Cpu65xx* cpu, const Decoded* d)
+{
+  if (M == ACC)
+  {
+    cpu->a = F(cpu, cpu->a);
+    return 0;
+  }
+
+  uint8_t extra = 0;
+  uint16_t addr = address<M>(cpu, d, PENALTY ? &extra : NULL);
+  uint8_t cycles = d->cycles + extra;
+  busWrite(cpu, addr, F(cpu, busRead(cpu, addr, cycles - 3)), cycles - 1);
+  return extra;
+}
+
+
+/* ---- registers and flags ---- */
+
+static uint8_t opTAX(Cpu65xx* cpu, const Decoded*) { cpu->x = cpu->a; setNZ(cpu, cpu->x); return 0; }
+static uint8_t opTAY(Cpu65xx* cpu, const Decoded*) { cpu->y = cpu->a; setNZ(cpu, cpu->y); return 0; }
+static uint8_t opTXA(Cpu65xx* cpu, const Decoded*) { cpu->a = cpu->x; setNZ(cpu, cpu->a); return 0; }
+static uint8_t opTYA(Cpu65xx* cpu, const Decoded*) { cpu->a = cpu->y; setNZ(cpu, cpu->a); return 0; }
+static uint8_t opTSX(Cpu65xx* cpu, const Decoded*) { cpu->x = cpu->sp; setNZ(cpu, cpu->x); return 0; }
+static uint8_t opTXS(Cpu65xx* cpu, const Decoded*) { cpu->sp = cpu->x; return 0; }
+static uint8_t opINX(Cpu65xx* cpu, const Decoded*) { setNZ(cpu, ++cpu->x); return 0; }
+static uint8_t opINY(Cpu65xx* cpu, const Decoded*) { setNZ(cpu, ++cpu->y); return 0; }
+static uint8_t opDEX(Cpu65xx* cpu, const Decoded*) { setNZ(cpu, --cpu->x); return 0; }
+static uint8_t opDEY(Cpu65xx* cpu, const Decoded*) { setNZ(cpu, --cpu->y); return 0; }
+
+template <uint8_t FLAG, bool SET>
+static uint8_t opFlag(Cpu65xx* cpu, const Decoded*)
+{
+  cpu->p = SET ? (cpu->p | FLAG) : (cpu->p & ~FLAG);
+  return 0;
+}
+
+
+/* ---- stack ---- */
+
+static uint8_t opPHA(Cpu65xx* cpu, const Decoded*) { push(cpu, cpu->a); return 0; }
+static uint8_t opPHX(Cpu65xx* cpu, const Decoded*) { push(cpu, cpu->x); return 0; }
+static uint8_t opPHY(Cpu65xx* cpu, const Decoded*) { push(cpu, cpu->y); return 0; }
+static uint8_t opPHP(Cpu65xx* cpu, const Decoded*) { push(cpu, cpu->p | FLAG_B | FLAG_U); return 0; }
+static uint8_t opPLA(Cpu65xx* cpu, const Decoded*) { cpu->a = pull(cpu); setNZ(cpu, cpu->a); return 0; }
+static uint8_t opPLX(Cpu65xx* cpu, const Decoded*) { cpu->x = pull(cpu); setNZ(cpu, cpu->x); return 0; }
+static uint8_t opPLY(Cpu65xx* cpu, const Decoded*) { cpu->y = pull(cpu); setNZ(cpu, cpu->y); return 0; }
+static uint8_t opPLP(Cpu65xx* cpu, const Decoded*) { cpu->p = (pull(cpu) & ~FLAG_B) | FLAG_U; return 0; }
+
+
+/* ---- branches and jumps. PC already points past the instruction ---- */
+
+template <uint8_t FLAG, bool SET>
+static uint8_t opBranch(Cpu65xx* cpu, const Decoded* d)
+{
+  if (((cpu->p & FLAG) != 0) != SET) return 0;
+  cpu->pc = d->operand;
+  return d->takenCycles;
+}
+
+static uint8_t opBRA(Cpu65xx* cpu, const Decoded* d)
+{
+  cpu->pc = d->operand;
+  return d->takenCycles;
+}
+
+template <int BIT, bool SET>
+static uint8_t opBBx(Cpu65xx* cpu, const Decoded* d)
+{
+  if (((busRead(cpu, d->zp, 2) >> BIT) & 1) != SET) return 0;
+  cpu->pc = d->operand;
+  return d->takenCycles;
+}
+
+static uint8_t opJMP(Cpu65xx* cpu, const Decoded* d)
+{
+  cpu->pc = d->operand;
+  return 0;
+}
+
+/* the NMOS 6502 reads the high byte of JMP ($xxFF) from $xx00 */
+template <class V>
+static uint8_t opJMPInd(Cpu65xx* cpu, const Decoded* d)
+{
+  if (V::CMOS)
+  {
+    cpu->pc = busRead16(cpu, d->operand, 3);
+  }
+  else
+  {
+    uint16_t hiAddr = (d->operand & 0xff00) | ((d->operand + 1) & 0xff);
+    cpu->pc = busRead(cpu, d->operand, 3) | (busRead(cpu, hiAddr, 4) << 8);
+  }
+  return 0;
+}
+
+static uint8_t opJMPIndX(Cpu65xx* cpu, const Decoded* d)
+{
+  cpu->pc = busRead16(cpu, (uint16_t)(d->operand + cpu->x), 4);
+  return 0;
+}
+
+static uint8_t opJSR(Cpu65xx* cpu, const Decoded* d)
+{
+  uint16_t ret = cpu->pc - 1;
+  push(cpu, ret >> 8);
+  push(cpu, ret & 0xff);
+  cpu->pc = d->operand;
+  return 0;
+}
+
+static uint8_t opRTS(Cpu65xx* cpu, const Decoded*)
+{
+  uint16_t ret = pull(cpu);
+  ret |= pull(cpu) << 8;
+  cpu->pc = ret + 1;
+  return 0;
+}
+
+static uint8_t opRTI(Cpu65xx* cpu, const Decoded*)
+{
+  cpu->p = (pull(cpu) & ~FLAG_B) | FLAG_U;
+  uint16_t ret = pull(cpu);
+  ret |= pull(cpu) << 8;
+  cpu->pc = ret;
+  if (cpu->eventHook) cpu->eventHook(CPU65XX_EVENT_RTI);
+  return 0;
+}
+
+/* push PC and status and jump through a vector. the 65C02 clears D */
+template <class V>
+static void interrupt(Cpu65xx* cpu, uint16_t vector, uint8_t pushedFlags, Cpu65xxEvent event)
+{
+  push(cpu, cpu->pc >> 8);
+  push(cpu, cpu->pc & 0xff);
+  push(cpu, (cpu->p & ~FLAG_B) | pushedFlags);
+  cpu->p |= FLAG_I;
+  if (V::CMOS) cpu->p &= ~FLAG_D;
+  cpu->pc = busRead16(cpu, vector, 5);
+  if (cpu->eventHook) cpu->eventHook(event);
+}
+
+/* BRK is two bytes long: the return address skips its signature byte */
+template <class V>
+static uint8_t opBRK(Cpu65xx* cpu, const Decoded*)
+{
+  interrupt<V>(cpu, VECTOR_IRQ, FLAG_B | FLAG_U, CPU65XX_EVENT_BRK);
+  return 0;
+}
+
+static uint8_t opWAI(Cpu65xx* cpu, const Decoded*)
+{
+  cpu->waiting = true;
+  return 0;
+}
+
+static uint8_t opSTP(Cpu65xx* cpu, const Decoded*)
+{
+  cpu->stopped = true;
+  return 0;
+}
+
+
+/* ---- opcode table ---- */
+
+struct OpInfo
+{
+  OpHandler handler;
+  Mode      mode;
+  uint8_t   cycles;
+};
+
+#define NOP1  { opNOP, IMP, 1 }
+
+/* opcodes a variant lacks run as NOPs: the 65C02 additions keep their length
+ * and cycles on the NMOS 6502, the bit instructions and WAI/STP take 1 cycle */
+template <class V>
+static constexpr OpInfo cmos(OpHandler handler, Mode mode, uint8_t cycles)
+{
+  return { V::CMOS ? handler : opNOP, mode, cycles };
+}
+
+template <class V>
+static constexpr OpInfo bitop(OpHandler handler, Mode mode, uint8_t cycles)
+{
+  return V::BITOPS ? OpInfo{ handler, mode, cycles } : OpInfo{ opNOP, IMP, 1 };
+}
+
+template <class V>
+static constexpr OpInfo wdc(OpHandler handler, Mode mode, uint8_t cycles)
+{
+  return V::WDC ? OpInfo{ handler, mode, cycles } : OpInfo{ opNOP, IMP, 1 };
+}
+
+template <class V>
+static const OpInfo opTable[256] = {
+  /* 0x00 */ { opBRK<V>, IMM, 7 },                   { opORA<IZX>, IZX, 6 },             { opNOP, IMM, 2 },                      NOP1,
+  /* 0x04 */ cmos<V>(opRMW<ZP, tsb>, ZP, 5),         { opORA<ZP>, ZP, 3 },               { opRMW<ZP, asl>, ZP, 5 },              bitop<V>(opRMW<ZP, rmb<0> >, ZP, 5),
+  /* 0x08 */ { opPHP, IMP, 3 },                      { opORA<IMM>, IMM, 2 },             { opRMW<ACC, asl>, ACC, 2 },            NOP1,
+  /* 0x0c */ cmos<V>(opRMW<ABS, tsb>, ABS, 6),       { opORA<ABS>, ABS, 4 },             { opRMW<ABS, asl>, ABS, 6 },            bitop<V>(opBBx<0, false>, ZPR, 5),
+
+  /* 0x10 */ { opBranch<FLAG_N, false>, REL, 2 },    { opORA<IZY>, IZY, 5 },             cmos<V>(opORA<IZP>, IZP, 5),            NOP1,
+  /* 0x14 */ cmos<V>(opRMW<ZP, trb>, ZP, 5),         { opORA<ZPX>, ZPX, 4 },             { opRMW<ZPX, asl>, ZPX, 6 },            bitop<V>(opRMW<ZP, rmb<1> >, ZP, 5),
+  /* 0x18 */ { opFlag<FLAG_C, false>, IMP, 2 },      { opORA<ABY>, ABY, 4 },             cmos<V>(opRMW<ACC, inc>, ACC, 2),       NOP1,
+  /* 0x1c */ cmos<V>(opRMW<ABS, trb>, ABS, 6),       { opORA<ABX>, ABX, 4 },             { opRMW<ABX, asl, V::CMOS>, ABX, V::CMOS ? 6 : 7 }, bitop<V>(opBBx<1, false>, ZPR, 5),
+
+  /* 0x20 */ { opJSR, ABS, 6 },                      { opAND<IZX>, IZX, 6 },             { opNOP, IMM, 2 },                      NOP1,
+  /* 0x24 */ { opBIT<ZP>, ZP, 3 },                   { opAND<ZP>, ZP, 3 },               { opRMW<ZP, rol>, ZP, 5 },              bitop<V>(opRMW<ZP, rmb<2> >, ZP, 5),
+  /* 0x28 */ { opPLP, IMP, 4 },                      { opAND<IMM>, IMM, 2 },             { opRMW<ACC, rol>, ACC, 2 },            NOP1,
+  /* 0x2c */ { opBIT<ABS>, ABS, 4 },                 { opAND<ABS>, ABS, 4 },             { opRMW<ABS, rol>, ABS, 6 },            bitop<V>(opBBx<2, false>, ZPR, 5),
+
+  /* 0x30 */ { opBranch<FLAG_N, true>, REL, 2 },     { opAND<IZY>, IZY, 5 },             cmos<V>(opAND<IZP>, IZP, 5),            NOP1,
+  /* 0x34 */ cmos<V>(opBIT<ZPX>, ZPX, 4),            { opAND<ZPX>, ZPX, 4 },             { opRMW<ZPX, rol>, ZPX, 6 },            bitop<V>(opRMW<ZP, rmb<3> >, ZP, 5),
+  /* 0x38 */ { opFlag<FLAG_C, true>, IMP, 2 },       { opAND<ABY>, ABY, 4 },             cmos<V>(opRMW<ACC, dec>, ACC, 2),       NOP1,
+  /* 0x3c */ cmos<V>(opBIT<ABX>, ABX, 4),            { opAND<ABX>, ABX, 4 },             { opRMW<ABX, rol, V::CMOS>, ABX, V::CMOS ? 6 : 7 }, bitop<V>(opBBx<3, false>, ZPR, 5),
+
+  /* 0x40 */ { opRTI, IMP, 6 },                      { opEOR<IZX>, IZX, 6 },             { opNOP, IMM, 2 },                      NOP1,
+  /* 0x44 */ { opNOP, ZP, 3 },                       { opEOR<ZP>, ZP, 3 },               { opRMW<ZP, lsr>, ZP, 5 },              bitop<V>(opRMW<ZP, rmb<4> >, ZP, 5),
+  /* 0x48 */ { opPHA, IMP, 3 },                      { opEOR<IMM>, IMM, 2 },             { opRMW<ACC, lsr>, ACC, 2 },            NOP1,
+  /* 0x4c */ { opJMP, ABS, 3 },                      { opEOR<ABS>, ABS, 4 },             { opRMW<ABS, lsr>, ABS, 6 },            bitop<V>(opBBx<4, false>, ZPR, 5),
+
+  /* 0x50 */ { opBranch<FLAG_V, false>, REL, 2 },    { opEOR<IZY>, IZY, 5 },             cmos<V>(opEOR<IZP>, IZP, 5),            NOP1,
+  /* 0x54 */ { opNOP, ZPX, 4 },                      { opEOR<ZPX>, ZPX, 4 },             { opRMW<ZPX, lsr>, ZPX, 6 },            bitop<V>(opRMW<ZP, rmb<5> >, ZP, 5),
+  /* 0x58 */ { opFlag<FLAG_I, false>, IMP, 2 },      { opEOR<ABY>, ABY, 4 },             cmos<V>(opPHY, IMP, 3),                 NOP1,
+  /* 0x5c */ { opNOP, ABS, 8 },                      { opEOR<ABX>, ABX, 4 },             { opRMW<ABX, lsr, V::CMOS>, ABX, V::CMOS ? 6 : 7 }, bitop<V>(opBBx<5, false>, ZPR, 5),
+
+  /* 0x60 */ { opRTS, IMP, 6 },                      { opADC<V, IZX>, IZX, 6 },          { opNOP, IMM, 2 },                      NOP1,
+  /* 0x64 */ cmos<V>(opSTZ<ZP>, ZP, 3),              { opADC<V, ZP>, ZP, 3 },            { opRMW<ZP, ror>, ZP, 5 },              bitop<V>(opRMW<ZP, rmb<6> >, ZP, 5),
+  /* 0x68 */ { opPLA, IMP, 4 },                      { opADC<V, IMM>, IMM, 2 },          { opRMW<ACC, ror>, ACC, 2 },            NOP1,
+  /* 0x6c */ { opJMPInd<V>, IND, V::CMOS ? 6 : 5 },  { opADC<V, ABS>, ABS, 4 },          { opRMW<ABS, ror>, ABS, 6 },            bitop<V>(opBBx<6, false>, ZPR, 5),
+
+  /* 0x70 */ { opBranch<FLAG_V, true>, REL, 2 },     { opADC<V, IZY>, IZY, 5 },          cmos<V>(opADC<V, IZP>, IZP, 5),         NOP1,
+  /* 0x74 */ cmos<V>(opSTZ<ZPX>, ZPX, 4),            { opADC<V, ZPX>, ZPX, 4 },          { opRMW<ZPX, ror>, ZPX, 6 },            bitop<V>(opRMW<ZP, rmb<7> >, ZP, 5),
+  /* 0x78 */ { opFlag<FLAG_I, true>, IMP, 2 },       { opADC<V, ABY>, ABY, 4 },          cmos<V>(opPLY, IMP, 4),                 NOP1,
+  /* 0x7c */ cmos<V>(opJMPIndX, IAX, 6),             { opADC<V, ABX>, ABX, 4 },          { opRMW<ABX, ror, V::CMOS>, ABX, V::CMOS ? 6 : 7 }, bitop<V>(opBBx<7, false>, ZPR, 5),
+
+  /* 0x80 */ cmos<V>(opBRA, REL, 2),                 { opSTA<IZX>, IZX, 6 },             { opNOP, IMM, 2 },                      NOP1,
+  /* 0x84 */ { opSTY<ZP>, ZP, 3 },                   { opSTA<ZP>, ZP, 3 },               { opSTX<ZP>, ZP, 3 },                   bitop<V>(opRMW<ZP, smb<0> >, ZP, 5),
+  /* 0x88 */ { opDEY, IMP, 2 },                      cmos<V>(opBIT<IMM>, IMM, 2),        { opTXA, IMP, 2 },                      NOP1,
+  /* 0x8c */ { opSTY<ABS>, ABS, 4 },                 { opSTA<ABS>, ABS, 4 },             { opSTX<ABS>, ABS, 4 },                 bitop<V>(opBBx<0, true>, ZPR, 5),
+
+  /* 0x90 */ { opBranch<FLAG_C, false>, REL, 2 },    { opSTA<IZY>, IZY, 6 },             cmos<V>(opSTA<IZP>, IZP, 5),            NOP1,
+  /* 0x94 */ { opSTY<ZPX>, ZPX, 4 },                 { opSTA<ZPX>, ZPX, 4 },             { opSTX<ZPY>, ZPY, 4 },                 bitop<V>(opRMW<ZP, smb<1> >, ZP, 5),
+  /* 0x98 */ { opTYA, IMP, 2 },                      { opSTA<ABY>, ABY, 5 },             { opTXS, IMP, 2 },                      NOP1,
+  /* 0x9c */ cmos<V>(opSTZ<ABS>, ABS, 4),            { opSTA<ABX>, ABX, 5 },             cmos<V>(opSTZ<ABX>, ABX, 5),            bitop<V>(opBBx<1, true>, ZPR, 5),
+
+  /* 0xa0 */ { opLDY<IMM>, IMM, 2 },                 { opLDA<IZX>, IZX, 6 },             { opLDX<IMM>, IMM, 2 },                 NOP1,
+  /* 0xa4 */ { opLDY<ZP>, ZP, 3 },                   { opLDA<ZP>, ZP, 3 },               { opLDX<ZP>, ZP, 3 },                   bitop<V>(opRMW<ZP, smb<2> >, ZP, 5),
+  /* 0xa8 */ { opTAY, IMP, 2 },                      { opLDA<IMM>, IMM, 2 },             { opTAX, IMP, 2 },                      NOP1,
+  /* 0xac */ { opLDY<ABS>, ABS, 4 },                 { opLDA<ABS>, ABS, 4 },             { opLDX<ABS>, ABS, 4 },                 bitop<V>(opBBx<2, true>, ZPR, 5),
+
+  /* 0xb0 */ { opBranch<FLAG_C, true>, REL, 2 },     { opLDA<IZY>, IZY, 5 },             cmos<V>(opLDA<IZP>, IZP, 5),            NOP1,
+  /* 0xb4 */ { opLDY<ZPX>, ZPX, 4 },                 { opLDA<ZPX>, ZPX, 4 },             { opLDX<ZPY>, ZPY, 4 },                 bitop<V>(opRMW<ZP, smb<3> >, ZP, 5),
+  /* 0xb8 */ { opFlag<FLAG_V, false>, IMP, 2 },      { opLDA<ABY>, ABY, 4 },             { opTSX, IMP, 2 },                      NOP1,
+  /* 0xbc */ { opLDY<ABX>, ABX, 4 },                 { opLDA<ABX>, ABX, 4 },             { opLDX<ABY>, ABY, 4 },                 bitop<V>(opBBx<3, true>, ZPR, 5),
+
+  /* 0xc0 */ { opCPY<IMM>, IMM, 2 },                 { opCMP<IZX>, IZX, 6 },             { opNOP, IMM, 2 },                      NOP1,
+  /* 0xc4 */ { opCPY<ZP>, ZP, 3 },                   { opCMP<ZP>, ZP, 3 },               { opRMW<ZP, dec>, ZP, 5 },              bitop<V>(opRMW<ZP, smb<4> >, ZP, 5),
+  /* 0xc8 */ { opINY, IMP, 2 },                      { opCMP<IMM>, IMM, 2 },             { opDEX, IMP, 2 },                      wdc<V>(opWAI, IMP, 3),
+  /* 0xcc */ { opCPY<ABS>, ABS, 4 },                 { opCMP<ABS>, ABS, 4 },             { opRMW<ABS, dec>, ABS, 6 },            bitop<V>(opBBx<4, true>, ZPR, 5),
+
+  /* 0xd0 */ { opBranch<FLAG_Z, false>, REL, 2 },    { opCMP<IZY>, IZY, 5 },             cmos<V>(opCMP<IZP>, IZP, 5),            NOP1,
+  /* 0xd4 */ { opNOP, ZPX, 4 },                      { opCMP<ZPX>, ZPX, 4 },             { opRMW<ZPX, dec>, ZPX, 6 },            bitop<V>(opRMW<ZP, smb<5> >, ZP, 5),
+  /* 0xd8 */ { opFlag<FLAG_D, false>, IMP, 2 },      { opCMP<ABY>, ABY, 4 },             cmos<V>(opPHX, IMP, 3),                 wdc<V>(opSTP, IMP, 3),
+  /* 0xdc */ { opNOP, ABS, 4 },                      { opCMP<ABX>, ABX, 4 },             { opRMW<ABX, dec>, ABX, 7 },            bitop<V>(opBBx<5, true>, ZPR, 5),
+
+  /* 0xe0 */ { opCPX<IMM>, IMM, 2 },                 { opSBC<V, IZX>, IZX, 6 },          { opNOP, IMM, 2 },                      NOP1,
+  /* 0xe4 */ { opCPX<ZP>, ZP, 3 },                   { opSBC<V, ZP>, ZP, 3 },            { opRMW<ZP, inc>, ZP, 5 },              bitop<V>(opRMW<ZP, smb<6> >, ZP, 5),
+  /* 0xe8 */ { opINX, IMP, 2 },                      { opSBC<V, IMM>, IMM, 2 },          { opNOP, IMP, 2 },                      NOP1,
+  /* 0xec */ { opCPX<ABS>, ABS, 4 },                 { opSBC<V, ABS>, ABS, 4 },          { opRMW<ABS, inc>, ABS, 6 },            bitop<V>(opBBx<6, true>, ZPR, 5),
+
+  /* 0xf0 */ { opBranch<FLAG_Z, true>, REL, 2 },     { opSBC<V, IZY>, IZY, 5 },          cmos<V>(opSBC<V, IZP>, IZP, 5),         NOP1,
+  /* 0xf4 */ { opNOP, ZPX, 4 },                      { opSBC<V, ZPX>, ZPX, 4 },          { opRMW<ZPX, inc>, ZPX, 6 },            bitop<V>(opRMW<ZP, smb<7> >, ZP, 5),
+  /* 0xf8 */ { opFlag<FLAG_D, true>, IMP, 2 },       { opSBC<V, ABY>, ABY, 4 },          cmos<V>(opPLX, IMP, 4),                 NOP1,
+  /* 0xfc */ { opNOP, ABS, 4 },                      { opSBC<V, ABX>, ABX, 4 },          { opRMW<ABX, inc>, ABX, 7 },            bitop<V>(opBBx<7, true>, ZPR, 5),
+};
+
+
+/* decode the instruction at pc into d. page is its host memory page, or
+ * NULL to fetch it through the bus */
+template <class V>
+static void decodeInto(Cpu65xx* cpu, uint16_t pc, const uint8_t* page, Decoded* d)
+{
+  uint8_t opcode = page ? page[pc & 0xff] : busRead(cpu, pc, 0);
+  const OpInfo* info = &opTable<V>[opcode];
+  uint8_t length = modeLength[info->mode];
+
+  uint8_t bytes[3] = { opcode, 0, 0 };
+  for (uint8_t i = 1; i < length; ++i)
+  {
+    bytes[i] = page ? page[(pc & 0xff) + i] : busRead(cpu, (uint16_t)(pc + i), i);
+  }
+
+  d->handler = info->handler;
+  d->gen = cpu->pageGen[pc >> 8];
+  d->opcode = opcode;
+  d->length = length;
+  d->cycles = info->cycles;
+  d->operand = (length == 3) ? (uint16_t)(bytes[1] | (bytes[2] << 8)) : bytes[1];
+  d->zp = 0;
+  d->takenCycles = 0;
+
+  if (info->mode == REL || info->mode == ZPR)
+  {
+    uint16_t next = (uint16_t)(pc + length);
+    uint16_t target = (uint16_t)(next + (int8_t)bytes[length - 1]);
+    d->zp = bytes[1];
+    d->operand = target;
+    d->takenCycles = ((next ^ target) & 0xff00) ? 2 : 1;
+  }
+}
+
+/* an instruction can be cached if it lies within one memory page */
+template <class V>
+static const uint8_t* cacheablePage(Cpu65xx* cpu, uint16_t pc)
+{
+  const uint8_t* page = cpu->readPages[pc >> 8];
+  if (!page) return NULL;
+
+  uint8_t length = modeLength[opTable<V>[page[pc & 0xff]].mode];
+  return ((pc & 0xff) + length <= 0x100) ? page : NULL;
+}
+
+/* decode the instruction at pc into its cache entry. instructions outside
+ * memory pages or running over a page boundary are decoded every time */
+template <class V>
+static const Decoded* decode(Cpu65xx* cpu, uint16_t pc)
+{
+  const uint8_t* page = cacheablePage<V>(cpu, pc);
+  Decoded* d = page ? &cpu->cache[pc] : &cpu->scratch;
+  decodeInto<V>(cpu, pc, page, d);
+  return d;
+}
+
+
+/* ---- superinstructions ----
+ *
+ * Each runs its whole sequence as one block entry, with the cycles and flags
+ * of the separate instructions. The entry's base cycles are those of the
+ * first instruction, and the handler adds the rest. Afterwards instPc and
+ * currentOpcode describe the last instruction, as if it had run alone. */
+
+enum Fusion { FUSION_DEX_BNE, FUSION_DEY_BNE, FUSION_CMP_BEQ, FUSION_CMP_BNE, FUSION_COPY_INY };
+
+static const char* const fusionNames[CPU65XX_FUSION_COUNT] = {
+  "DEX; BNE", "DEY; BNE", "CMP #; BEQ", "CMP #; BNE", "LDA (zp),Y; STA (zp),Y; INY" };
+
+/* DEX; BNE or DEY; BNE (operand: branch target) */
+template <bool Y>
+static uint8_t opDecBne(Cpu65xx* cpu, const Decoded* d)
+{
+  uint8_t val = Y ? --cpu->y : --cpu->x;
+  setNZ(cpu, val);
+
+  ++cpu->fusionCounts[Y ? FUSION_DEY_BNE : FUSION_DEX_BNE];
+  cpu->instPc = (uint16_t)(cpu->instPc + 1);
+  cpu->currentOpcode = OPCODE_BNE;
+
+  if (!val) return 2;
+  cpu->pc = d->operand;
+  return 2 + d->takenCycles;
+}
+
+/* CMP #; BEQ or CMP #; BNE (zp: the immediate, operand: branch target) */
+template <bool EQ>
+static uint8_t opCmpBranch(Cpu65xx* cpu, const Decoded* d)
+{
+  compare(cpu, cpu->a, d->zp);
+
+  ++cpu->fusionCounts[EQ ? FUSION_CMP_BEQ : FUSION_CMP_BNE];
+  cpu->instPc = (uint16_t)(cpu->instPc + 2);
+  cpu->currentOpcode = EQ ? OPCODE_BEQ : OPCODE_BNE;
+
+  if (((cpu->p & FLAG_Z) != 0) != EQ) return 2;
+  cpu->pc = d->operand;
+  return 2 + d->takenCycles;
+}
+
+/* LDA (src),Y; STA (dst),Y; INY (operand: src, zp: dst). a copy to or
+ * from anything but RAM runs the LDA alone, so a device access still ends
+ * the block between instructions */
+static uint8_t opCopyIny(Cpu65xx* cpu, const Decoded* d)
+{
+  uint16_t srcBase = zpRead16(cpu, (uint8_t)d->operand, 2);
+  uint16_t src = (uint16_t)(srcBase + cpu->y);
+  uint16_t dst = (uint16_t)(zpRead16(cpu, d->zp, 2) + cpu->y);
+  uint8_t extra = ((src ^ srcBase) & 0xff00) ? 1 : 0;
+
+  const uint8_t* srcPage = cpu->readPages[src >> 8];
+  if (!srcPage || !cpu->writePages[dst >> 8])
+  {
+    cpu->a = busRead(cpu, src, d->cycles + extra - 1);
+    setNZ(cpu, cpu->a);
+    cpu->pc = (uint16_t)(cpu->instPc + 2);
+    cpu->ioAccess = true;   /* leave the block. the STA is next */
+    return extra;
+  }
+
+  cpu->a = srcPage[src & 0xff];
+  busWrite(cpu, dst, cpu->a, 0);
+  ++cpu->fusionCounts[FUSION_COPY_INY];
+
+  /* the STA overwrote the INY. the block ends on the page write */
+  if (dst == (uint16_t)(cpu->instPc + 4))
+  {
+    setNZ(cpu, cpu->a);
+    cpu->pc = dst;
+    cpu->instPc = (uint16_t)(cpu->instPc + 2);
+    cpu->currentOpcode = OPCODE_STA_IZY;
+    return extra + 6;
+  }
+
+  setNZ(cpu, ++cpu->y);
+  cpu->instPc = (uint16_t)(cpu->instPc + 4);
+  cpu->currentOpcode = OPCODE_INY;
+  return extra + 6 + 2;
+}
+
+
+/* ---- threaded code ---- */
+
+/* instructions that end a block: anything that can change the PC other
+ * than by falling through, stop the CPU or unmask interrupts */
+static bool endsBlock(uint8_t opcode)
+{
+  switch (opcode)
+  {
+    case 0x00: case 0x20: case 0x40: case 0x4c: case 0x60: case 0x6c: case 0x7c:  /* BRK JSR RTI JMP RTS */
+    case 0x80: case 0xcb: case 0xdb:                                              /* BRA WAI STP */
+    case 0x28: case 0x58:                                                         /* PLP CLI */
+      return true;
+    default:
+      return (opcode & 0x1f) == 0x10 || (opcode & 0x0f) == 0x0f;                 /* Bxx, BBR/BBS */
+  }
+}
+
+/* the most cycles d can take */
+template <class V>
+static uint8_t maxCycles(const Decoded* d)
+{
+  Mode mode = opTable<V>[d->opcode].mode;
+  uint8_t cycles = d->cycles + d->takenCycles;
+  if (mode == ABX || mode == ABY || mode == IZY) ++cycles;
+  if ((d->opcode & 0x63) == 0x61 || d->opcode == 0x72 || d->opcode == 0xf2) ++cycles;  /* ADC/SBC in decimal mode */
+  return cycles;
+}
+
+/* turn d (decoded at addr) into a superinstruction if it starts one. the
+ * sequence must lie on d's page and not run through a breakpoint. returns
+ * the opcode of the last instruction in d and adds the cycles of any fused
+ * instructions to *blockMaxCycles */
+template <class V>
+static uint8_t fuse(Cpu65xx* cpu, uint16_t addr, const uint8_t* page, Decoded* d, uint16_t* blockMaxCycles)
+{
+  int parts;
+  switch (d->opcode)
+  {
+    case OPCODE_DEX: case OPCODE_DEY: case OPCODE_CMP_IMM: parts = 1; break;
+    case OPCODE_LDA_IZY: parts = 2; break;
+    default: return d->opcode;
+  }
+
+  Decoded next[2];
+  uint16_t nextAddr = (uint16_t)(addr + d->length);
+  for (int i = 0; i < parts; ++i)
+  {
+    if ((nextAddr >> 8) != (addr >> 8) || !cacheablePage<V>(cpu, nextAddr)) return d->opcode;
+    if (cpu->blockEnd && cpu->blockEnd(nextAddr)) return d->opcode;
+    decodeInto<V>(cpu, nextAddr, page, &next[i]);
+    nextAddr += next[i].length;
+  }
+
+  switch (d->opcode)
+  {
+    case OPCODE_DEX:
+    case OPCODE_DEY:
+      if (next[0].opcode != OPCODE_BNE) return d->opcode;
+      d->handler = (d->opcode == OPCODE_DEX) ? opDecBne<false> : opDecBne<true>;
+      d->operand = next[0].operand;
+      d->takenCycles = next[0].takenCycles;
+      break;
+
+    case OPCODE_CMP_IMM:
+      if (next[0].opcode != OPCODE_BEQ && next[0].opcode != OPCODE_BNE) return d->opcode;
+      d->handler = (next[0].opcode == OPCODE_BEQ) ? opCmpBranch<true> : opCmpBranch<false>;
+      d->zp = (uint8_t)d->operand;
+      d->operand = next[0].operand;
+      d->takenCycles = next[0].takenCycles;
+      break;
+
+    default:
+      if (next[0].opcode != OPCODE_STA_IZY || next[1].opcode != OPCODE_INY) return d->opcode;
+      d->handler = opCopyIny;
+      d->zp = (uint8_t)next[0].operand;
+      break;
+  }
+
+  for (int i = 0; i < parts; ++i)
+  {
+    d->length += next[i].length;
+    *blockMaxCycles += maxCycles<V>(&next[i]);
+  }
+  return next[parts - 1].opcode;
+}
+
+/* translate the instructions from pc into a block. NULL if the first one
+ * can't be cached */
+template <class V>
+static Block* translate(Cpu65xx* cpu, uint16_t pc)
+{
+  Block* block = cpu->blocks[pc];
+  if (!block)
+  {
+    block = (Block*)calloc(1, sizeof(Block));
+    if (!block) return NULL;
+    cpu->blocks[pc] = block;
+  }
+
+  block->gen = cpu->pageGen[pc >> 8];
+  block->epoch = cpu->blockEpoch;
+  block->maxCycles = 0;
+  block->count = 0;
+
+  uint16_t addr = pc;
+  while (block->count < BLOCK_MAX_INSTS)
+  {
+    /* stop before the page ends and before a debugger breakpoint */
+    if ((addr >> 8) != (pc >> 8)) break;
+    if (block->count && cpu->blockEnd && cpu->blockEnd(addr)) break;
+
+    const uint8_t* page = cacheablePage<V>(cpu, addr);
+    if (!page) break;
+
+    Decoded* d = &block->insts[block->count++];
+    decodeInto<V>(cpu, addr, page, d);
+    block->maxCycles += maxCycles<V>(d);
+    uint8_t lastOpcode = fuse<V>(cpu, addr, page, d, &block->maxCycles);
+    addr += d->length;
+
+    if (endsBlock(lastOpcode)) break;
+  }
+
+  /* nothing to run: don't leave an empty block that looks current */
+  if (!block->count) block->epoch = cpu->blockEpoch - 1;
+  return block->count ? block : NULL;
+}
+
+
+template <class V>
+static uint8_t instCycle(Cpu65xx* cpu)
+{
+  if (cpu->stopped) return 1;
+
+  if (cpu->nmiPending)
+  {
+    cpu->nmiPending = false;
+    cpu->waiting = false;
+    cpu->instPc = cpu->pc;
+    cpu->currentOpcode = 0x00;
+    interrupt<V>(cpu, VECTOR_NMI, FLAG_U, CPU65XX_EVENT_NMI);
+    cpu->accessCycle = 0;
+    return INTERRUPT_CYCLES;
+  }
+
+  /* an IRQ ends WAI even while masked. execution then just carries on */
+  if (cpu->irq)
+  {
+    cpu->waiting = false;
+    if (!(cpu->p & FLAG_I))
+    {
+      cpu->instPc = cpu->pc;
+      cpu->currentOpcode = 0x00;
+      interrupt<V>(cpu, VECTOR_IRQ, FLAG_U, CPU65XX_EVENT_IRQ);
+      cpu->accessCycle = 0;
+      return INTERRUPT_CYCLES;
+    }
+  }
+
+  if (cpu->waiting) return 1;
+
+  uint16_t pc = cpu->pc;
+  const Decoded* d = &cpu->cache[pc];
+  if (d->gen != cpu->pageGen[pc >> 8]) d = decode<V>(cpu, pc);
+
+  cpu->instPc = pc;
+  cpu->currentOpcode = d->opcode;
+  cpu->pc = (uint16_t)(pc + d->length);
+  uint8_t cycles = d->cycles + d->handler(cpu, d);
+  cpu->accessCycle = 0;
+  return cycles;
+}
+
+template <class V>
+static uint32_t runBlock(Cpu65xx* cpu, uint32_t maxCycles)
+{
+  /* anything but plain execution is left to the interpreter */
+  if (cpu->stopped || cpu->waiting || cpu->nmiPending || (cpu->irq && !(cpu->p & FLAG_I)))
+  {
+    return instCycle<V>(cpu);
+  }
+
+  if (!cpu->blocks)
+  {
+    cpu->blocks = (Block**)calloc(CACHE_SIZE, sizeof(Block*));
+    cpu->heat = (uint8_t*)calloc(CACHE_SIZE, sizeof(uint8_t));
+    if (!cpu->blocks || !cpu->heat) return instCycle<V>(cpu);
+  }
+
+  uint16_t pc = cpu->pc;
+  uint8_t pageIndex = pc >> 8;
+  Block* block = cpu->blocks[pc];
+  if (!block || block->gen != cpu->pageGen[pageIndex] || block->epoch != cpu->blockEpoch)
+  {
+    if (++cpu->heat[pc] < BLOCK_HOT_COUNT) return instCycle<V>(cpu);
+    cpu->heat[pc] = 0;
+    block = translate<V>(cpu, pc);
+    if (!block) return instCycle<V>(cpu);
+  }
+
+  /* every instruction must start before the caller's run ends */
+  if (block->maxCycles > maxCycles) return instCycle<V>(cpu);
+
+  uint64_t gen = block->gen;
+  const Decoded* d = block->insts;
+  const Decoded* end = d + block->count;
+  cpu->ioAccess = false;
+  cpu->runCycles = 0;
+
+  do
+  {
+    cpu->instPc = cpu->pc;
+    cpu->currentOpcode = d->opcode;
+    cpu->pc = (uint16_t)(cpu->pc + d->length);
+    cpu->runCycles += d->cycles + d->handler(cpu, d);
+    ++d;
+  } while (d != end && !cpu->ioAccess && cpu->pageGen[pageIndex] == gen);
+
+  uint32_t cycles = cpu->runCycles;
+  cpu->runCycles = 0;
+  cpu->accessCycle = 0;
+  return cycles;
+}
+
+extern "C" {
+
+Cpu65xx* cpu65xxNew(Cpu65xxModel model, Cpu65xxMemRead memRead, Cpu65xxMemWrite memWrite,
+                    const uint8_t* const* readPages, uint8_t* const* writePages)
+{
+  Cpu65xx* cpu = (Cpu65xx*)calloc(1, sizeof(Cpu65xx));
+  if (!cpu) return NULL;
+
+  cpu->cache = (Decoded*)calloc(CACHE_SIZE, sizeof(Decoded));
+  if (!cpu->cache)
+  {
+    free(cpu);
+    return NULL;
+  }
+
+  cpu->model = model;
+  cpu->memRead = memRead;
+  cpu->memWrite = memWrite;
+  cpu->readPages = readPages;
+  cpu->writePages = writePages;
+  cpu->p = FLAG_U | FLAG_I;
+
+  /* cache entries start at generation 0, so nothing is valid yet */
+  cpu65xxInvalidateCode(cpu);
+  return cpu;
+}
+
+void cpu65xxDestroy(Cpu65xx* cpu)
+{
+  if (!cpu) return;
+  if (cpu->blocks)
+  {
+    for (int i = 0; i < CACHE_SIZE; ++i)
+    {
+      free(cpu->blocks[i]);
+    }
+    free(cpu->blocks);
+  }
+  free(cpu->heat);
+  free(cpu->cache);
+  free(cpu);
+}
+
+void cpu65xxReset(Cpu65xx* cpu)
+{
+  cpu->sp = 0xfd;
+  cpu->p = FLAG_U | FLAG_I;
+  cpu->waiting = false;
+  cpu->stopped = false;
+  cpu->nmiPending = false;
+  cpu->currentOpcode = 0x00;
+  cpu->pc = busRead16(cpu, VECTOR_RESET, 0);
+}
+
+/* each case inlines its own instantiation. the switch always goes the
+ * same way, so it costs less than a call through a function pointer */
+uint8_t cpu65xxInstCycle(Cpu65xx* cpu)
+{
+  switch (cpu->model)
+  {
+    case CPU65XX_6502:        return instCycle<Nmos6502>(cpu);
+    case CPU65XX_6502_NO_BCD: return instCycle<Nmos6502NoBcd>(cpu);
+    case CPU65XX_65C02:       return instCycle<Cmos65C02>(cpu);
+    default:                  return instCycle<Wdc65C02>(cpu);
+  }
+}
+
+uint32_t cpu65xxRunBlock(Cpu65xx* cpu, uint32_t maxCycles)
+{
+  switch (cpu->model)
+  {
+    case CPU65XX_6502:        return runBlock<Nmos6502>(cpu, maxCycles);
+    case CPU65XX_6502_NO_BCD: return runBlock<Nmos6502NoBcd>(cpu, maxCycles);
+    case CPU65XX_65C02:       return runBlock<Cmos65C02>(cpu, maxCycles);
+    default:                  return runBlock<Wdc65C02>(cpu, maxCycles);
+  }
+}
+
+void cpu65xxSetBlockEnd(Cpu65xx* cpu, Cpu65xxBlockEndFn blockEnd)
+{
+  cpu->blockEnd = blockEnd;
+  cpu65xxInvalidateBlocks(cpu);
+}
+
+void cpu65xxSetEventHook(Cpu65xx* cpu, Cpu65xxEventFn event)
+{
+  cpu->eventHook = event;
+}
+
+void cpu65xxInvalidateBlocks(Cpu65xx* cpu)
+{
+  ++cpu->blockEpoch;
+}
+
+void cpu65xxInvalidateCode(Cpu65xx* cpu)
+{
+  for (int i = 0; i < PAGE_COUNT; ++i)
+  {
+    ++cpu->pageGen[i];
+  }
+}
+
+void cpu65xxInvalidatePage(Cpu65xx* cpu, uint8_t page)
+{
+  ++cpu->pageGen[page];
+}
+
+void cpu65xxSetIrq(Cpu65xx* cpu, bool asserted)
+{
+  cpu->irq = asserted;
+}
+
+void cpu65xxSetNmi(Cpu65xx* cpu, bool asserted)
+{
+  if (asserted && !cpu->nmi) cpu->nmiPending = true;
+  cpu->nmi = asserted;
+}
+
+bool cpu65xxIrq(Cpu65xx* cpu)
+{
+  return cpu->irq;
+}
+
+bool cpu65xxNmi(Cpu65xx* cpu)
+{
+  return cpu->nmi;
+}
+
+uint32_t cpu65xxAccessCycle(Cpu65xx* cpu)
+{
+  return cpu->runCycles + cpu->accessCycle;
+}
+
+void cpu65xxWatchWrites(Cpu65xx* cpu, uint8_t scratchSp)
+{
+  cpu->scratchSp = scratchSp;
+  cpu->writeSeen = false;
+}
+
+int cpu65xxWriteSeen(Cpu65xx* cpu)
+{
+  return cpu->writeSeen;
+}
+
+bool cpu65xxInstructionNext(Cpu65xx* cpu)
+{
+  return !cpu->stopped && !cpu->waiting && !cpu->nmiPending && !(cpu->irq && !(cpu->p & FLAG_I));
+}
+
+uint16_t cpu65xxGetPC(Cpu65xx* cpu)
+{
+  return cpu->pc;
+}
+
+const char* cpu65xxFusionName(int index)
+{
+  return (index >= 0 && index < CPU65XX_FUSION_COUNT) ? fusionNames[index] : NULL;
+}
+
+uint64_t cpu65xxFusionCount(Cpu65xx* cpu, int index)
+{
+  return (index >= 0 && index < CPU65XX_FUSION_COUNT) ? cpu->fusionCounts[index] : 0;
+}
+
+uint16_t cpu65xxGetInstPC(Cpu65xx* cpu)
+{
+  return cpu->instPc;
+}
+
+uint8_t cpu65xxGetAcc(Cpu65xx* cpu)
+{
+  return cpu->a;
+}
+
+uint8_t cpu65xxGetX(Cpu65xx* cpu)
+{
+  return cpu->x;
+}
+
+uint8_t cpu65xxGetY(Cpu65xx* cpu)
+{
+  return cpu->y;
+}
+
+uint8_t cpu65xxGetStackPointer(Cpu65xx* cpu)
+{
+  return cpu->sp;
+}
+
+uint8_t cpu65xxGetStatus(Cpu65xx* cpu)
+{
+  return cpu->p;
+}
+
+void cpu65xxSetPC(Cpu65xx* cpu, uint16_t pc)
+{
+  cpu->pc = pc;
+}
+
+void cpu65xxSetAcc(Cpu65xx* cpu, uint8_t a)
+{
+  cpu->a = a;
+}
+
+void cpu65xxSetX(Cpu65xx* cpu, uint8_t x)
+{
+  cpu->x = x;
+}
+
+void cpu65xxSetY(Cpu65xx* cpu, uint8_t y)
+{
+  cpu->y = y;
+}
+
+void cpu65xxSetStackPointer(Cpu65xx* cpu, uint8_t sp)
+{
+  cpu->sp = sp;
+}
+
+void cpu65xxSetStatus(Cpu65xx* cpu, uint8_t p)
+{
+  cpu->p = (p & ~FLAG_B) | FLAG_U;
+}
+
+uint8_t cpu65xxGetCurrentOpcode(Cpu65xx* cpu)
+{
+  return cpu->currentOpcode;
+}
+
+uint8_t cpu65xxGetNextOpcode(Cpu65xx* cpu)
+{
+  const uint8_t* page = cpu->readPages[cpu->pc >> 8];
+  return page ? page[cpu->pc & 0xff] : cpu->memRead(cpu->pc, true);
+}
+
+}
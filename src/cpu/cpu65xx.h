@@ -0,0 +1,212 @@
+/*
+ * DB6502 Emulator - 65xx CPU core
+ *
+ * An instruction-stepped 6502/65C02/W65C02 core with a predecoded
+ * instruction cache.
+ * Each instruction is decoded once into its handler, operands, base cycle
+ * count and length. Entries for memory pages are reused until the page is
+ * written (RAM) or the code cache is invalidated (ROM load).
+ *
+ * Same shape as vrEmu6502: memory callbacks plus run/inspect functions.
+ * Plain memory is accessed through the bus's host page pointers, so only
+ * device accesses reach the callbacks.
+ */
+
+#ifndef _DB6502_CPU65XX_H_
+#define _DB6502_CPU65XX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Cpu65xx Cpu65xx;
+
+typedef enum
+{
+  CPU65XX_6502,           /* NMOS */
+  CPU65XX_6502_NO_BCD,    /* NMOS without decimal mode (e.g. Ricoh 2A03) */
+  CPU65XX_65C02,          /* CMOS, no bit instructions or WAI/STP */
+  CPU65XX_W65C02          /* WDC: everything */
+} Cpu65xxModel;
+
+#define CPU65XX_FUSION_COUNT  5   /* superinstructions (see cpu65xxFusionName) */
+
+typedef uint8_t (*Cpu65xxMemRead)(uint16_t addr, bool dbg);
+typedef void (*Cpu65xxMemWrite)(uint16_t addr, uint8_t val);
+typedef bool (*Cpu65xxBlockEndFn)(uint16_t addr);
+
+typedef enum
+{
+  CPU65XX_EVENT_IRQ,      /* an IRQ was taken */
+  CPU65XX_EVENT_NMI,
+  CPU65XX_EVENT_BRK,
+  CPU65XX_EVENT_RTI
+} Cpu65xxEvent;
+
+typedef void (*Cpu65xxEventFn)(Cpu65xxEvent event);
+
+/* Function:  cpu65xxNew
+ * --------------------
+ * create a core. each model is its own compiled instantiation, picked
+ * here once. readPages/writePages are the bus's 256 host page
+ * pointers (NULL where a device decodes the page). They are read live, so
+ * remapping only needs cpu65xxInvalidateCode()
+ */
+Cpu65xx* cpu65xxNew(Cpu65xxModel model, Cpu65xxMemRead memRead, Cpu65xxMemWrite memWrite,
+                    const uint8_t* const* readPages, uint8_t* const* writePages);
+
+/* Function:  cpu65xxDestroy
+ * --------------------
+ * destroy a core
+ */
+void cpu65xxDestroy(Cpu65xx* cpu);
+
+/* Function:  cpu65xxReset
+ * --------------------
+ * reset the core (load PC from the reset vector)
+ */
+void cpu65xxReset(Cpu65xx* cpu);
+
+/* Function:  cpu65xxInstCycle
+ * --------------------
+ * run one instruction (or interrupt entry). returns the cycles it took
+ */
+uint8_t cpu65xxInstCycle(Cpu65xx* cpu);
+
+/* Function:  cpu65xxRunBlock
+ * --------------------
+ * run a translated block of straight-line code from PC, as long as every
+ * instruction in it finishes within maxCycles. anything else (interrupts,
+ * cold code, a block that doesn't fit) runs one instruction through
+ * cpu65xxInstCycle(). returns the cycles run
+ *
+ * a block ends early after any device access, so the caller sees its side
+ * effects at the same instruction boundary as with cpu65xxInstCycle().
+ * blocks fuse some common sequences into superinstructions
+ */
+uint32_t cpu65xxRunBlock(Cpu65xx* cpu, uint32_t maxCycles);
+
+/* Function:  cpu65xxSetBlockEnd
+ * --------------------
+ * blockEnd(addr) returns true if a block must not run through addr
+ * (a debugger breakpoint)
+ */
+void cpu65xxSetBlockEnd(Cpu65xx* cpu, Cpu65xxBlockEndFn blockEnd);
+
+/* Function:  cpu65xxSetEventHook
+ * --------------------
+ * event(e) is called when the core enters an interrupt (after the pushes)
+ * and runs an RTI (after the pulls). NULL for none
+ */
+void cpu65xxSetEventHook(Cpu65xx* cpu, Cpu65xxEventFn event);
+
+/* Function:  cpu65xxInvalidateBlocks
+ * --------------------
+ * drop every translated block (blockEnd has changed its mind)
+ */
+void cpu65xxInvalidateBlocks(Cpu65xx* cpu);
+
+/* Function:  cpu65xxInvalidateCode
+ * --------------------
+ * drop every predecoded instruction. needed when memory changes without
+ * the core writing it (ROM load, bus remap)
+ */
+void cpu65xxInvalidateCode(Cpu65xx* cpu);
+
+/* Function:  cpu65xxInvalidatePage
+ * --------------------
+ * drop the predecoded instructions of one page (written other than by
+ * the core)
+ */
+void cpu65xxInvalidatePage(Cpu65xx* cpu, uint8_t page);
+
+/* Function:  cpu65xxSetIrq / cpu65xxSetNmi
+ * --------------------
+ * set the state of the (level triggered) IRQ or (edge triggered) NMI line
+ */
+void cpu65xxSetIrq(Cpu65xx* cpu, bool asserted);
+void cpu65xxSetNmi(Cpu65xx* cpu, bool asserted);
+
+/* Function:  cpu65xxIrq / cpu65xxNmi
+ * --------------------
+ * current state of the interrupt lines
+ */
+bool cpu65xxIrq(Cpu65xx* cpu);
+bool cpu65xxNmi(Cpu65xx* cpu);
+
+/* Function:  cpu65xxAccessCycle
+ * --------------------
+ * while a memory callback is running: the cycle of that access, counted
+ * from the start of the instruction (or block). 0 between instructions
+ */
+uint32_t cpu65xxAccessCycle(Cpu65xx* cpu);
+
+/* Function:  cpu65xxWatchWrites
+ * --------------------
+ * start recording writes to memory, except stack bytes at or below
+ * scratchSp (pushes by subroutines that return before the next check)
+ */
+void cpu65xxWatchWrites(Cpu65xx* cpu, uint8_t scratchSp);
+
+/* Function:  cpu65xxWriteSeen
+ * --------------------
+ * non-zero if a recorded write happened since cpu65xxWatchWrites()
+ */
+int cpu65xxWriteSeen(Cpu65xx* cpu);
+
+/* Function:  cpu65xxInstructionNext
+ * --------------------
+ * true if the next cpu65xxInstCycle() runs the instruction at PC (no
+ * interrupt entry is due and the CPU isn't in WAI or STP)
+ */
+bool cpu65xxInstructionNext(Cpu65xx* cpu);
+
+/* register access */
+uint16_t cpu65xxGetPC(Cpu65xx* cpu);
+uint8_t cpu65xxGetAcc(Cpu65xx* cpu);
+uint8_t cpu65xxGetX(Cpu65xx* cpu);
+uint8_t cpu65xxGetY(Cpu65xx* cpu);
+uint8_t cpu65xxGetStackPointer(Cpu65xx* cpu);
+uint8_t cpu65xxGetStatus(Cpu65xx* cpu);
+
+void cpu65xxSetPC(Cpu65xx* cpu, uint16_t pc);
+void cpu65xxSetAcc(Cpu65xx* cpu, uint8_t a);
+void cpu65xxSetX(Cpu65xx* cpu, uint8_t x);
+void cpu65xxSetY(Cpu65xx* cpu, uint8_t y);
+void cpu65xxSetStackPointer(Cpu65xx* cpu, uint8_t sp);
+void cpu65xxSetStatus(Cpu65xx* cpu, uint8_t p);
+
+/* Function:  cpu65xxFusionName / cpu65xxFusionCount
+ * --------------------
+ * name of superinstruction index (NULL past the last), and how many times
+ * it has run
+ */
+const char* cpu65xxFusionName(int index);
+uint64_t cpu65xxFusionCount(Cpu65xx* cpu, int index);
+
+/* Function:  cpu65xxGetInstPC
+ * --------------------
+ * address of the last instruction run (PC before an interrupt entry)
+ */
+uint16_t cpu65xxGetInstPC(Cpu65xx* cpu);
+
+/* Function:  cpu65xxGetCurrentOpcode
+ * --------------------
+ * opcode of the last instruction run
+ */
+uint8_t cpu65xxGetCurrentOpcode(Cpu65xx* cpu);
+
+/* Function:  cpu65xxGetNextOpcode
+ * --------------------
+ * opcode at PC (a debug read)
+ */
+uint8_t cpu65xxGetNextOpcode(Cpu65xx* cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,7 +19,7 @@
 
 #include "debugger/debugger.h"
 
-#include "devices/memory_device.h"
+#include "devices/direct_memory_device.h"
 #include "devices/6502_device.h"
 #include "devices/tms9918_device.h"
 #include "devices/keyboard_device.h"
@@ -27,42 +27,294 @@
 #include "devices/via_device.h"
 #include "devices/acia_device.h"
 
+#include "vrEmu6502.h"
+
+#include "hle.h"
+#include "breakpoints.h"
+#include "irqstats.h"
+#include "inputstats.h"
+#include "kbport.h"
+#include "busmap.h"
+#include "spsc_queue.h"
+#include "snapshot_buffer.h"
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
-#include <queue>
 #include <string>
+#include <vector>
+#include <atomic>
 
 
 static HBC56Device devices[HBC56_MAX_DEVICES];
 static int deviceCount = 0;
 
+/* address decoder (busmap.c)
+ *
+ * Pages wholly owned by plain memory also get a host pointer in
+ * busReadPages/busWritePages, so RAM and ROM accesses never reach a device.
+ * The CPU core reads these directly and caches decoded instructions from
+ * them, so it is told whenever they change.
+ *
+ * A watched page (busWatchPages) gets no host pointer for the watched kind
+ * of access, so those accesses take the device path and reach the watch
+ * handler. Unwatched pages are unaffected. */
+static uint8_t* busReadPages[BUS_PAGE_COUNT];
+static uint8_t* busWritePages[BUS_PAGE_COUNT];
+static uint8_t busWatchPages[BUS_PAGE_COUNT];
+static HBC56WatchFn busWatch = NULL;
+
+/* --bench only: the bus as it was. busSlowPath gives no page a host
+ * pointer, so every access goes through hbc56MemRead/Write, and with
+ * busReadMutex each read also takes a mutex, as every read once did */
+static bool busSlowPath = false;
+static SDL_mutex* busReadMutex = NULL;
+
+/* device scheduler
+ *
+ * Devices are lazy. Each one records the cycle it was last ticked to and
+ * only catches up when the CPU touches its registers, or when it reaches
+ * the cycle of its next event (an IRQ it may need to raise, a frame to
+ * render). The CPU runs straight to the earliest pending event.
+ *
+ * Before an access, the device is ticked up to the exact cycle of that bus
+ * access. Afterwards it is asked for its next event again. If the guest
+ * moved that event before the end of the current run, the CPU stops after
+ * the instruction so it isn't missed.
+ *
+ * Devices that can't predict their events are ticked every
+ * SCHED_DEFAULT_PERIOD cycles. The CPU itself isn't scheduled. */
+#define SCHED_DEFAULT_PERIOD  (clockFreq / 10000)   /* 100us */
+
+struct DeviceSchedule
+{
+  bool              scheduled;
+  HBC56NextEventFn  nextEventFn;
+  uint64_t          lastTickCycle;
+  uint64_t          nextEventCycle;
+  bool              steadyReads;    /* reads only change at its events (idle loop detection) */
+  bool              wakesCore;      /* its events matter while the CPU is idle (idle sleep) */
+};
+
+static DeviceSchedule schedule[HBC56_MAX_DEVICES];
+
+/* emulated cycles run so far, and where the current CPU run will stop */
+static uint64_t emulatedCycles = 0;
+
+/* the CPU clock. --clock or Debug > Clock change it, from HBC56_CLOCK_FREQ.
+ * the core runs by it while the UI sets it and converts its cycle counts */
+#define CLOCK_FREQ_MIN        1000
+#define CLOCK_FREQ_MAX        100000000
+static std::atomic<uint32_t> clockFreq{ HBC56_CLOCK_FREQ };
+static uint64_t schedRunEnd = 0;
+
 static HBC56Device* cpuDevice = NULL;
 static HBC56Device* romDevice = NULL;
 static HBC56Device* kbDevice = NULL;
 static HBC56Device* aciaDevice = NULL;
+static bool hleEnabled = false;   /* trap ROM routines named in the label file */
 
 static SDL_Window* window = NULL;
 
 static char tempBuffer[256];
 
+/* IRQ sources, one bit each (irq 1 is bit 0). a trigger holds the line
+ * until the next change from any source. the CPU only hears about changes
+ * of the combined line */
 #define MAX_IRQS 5
-static HBC56InterruptSignal irqs[MAX_IRQS];
+static uint8_t irqMask = 0;
+static uint8_t irqTriggerMask = 0;
+static bool irqLine = false;
 
 static SDL_Renderer* renderer = NULL;
-SDL_mutex* kbQueueMutex = nullptr;
 
-static std::queue<SDL_KeyboardEvent> pasteQueue;
-static std::queue<uint8_t> aciaPasteQueue;
+/* the VDP draws into a texture of a software renderer the core owns, so
+ * its framebuffer is only ever touched on the core thread. the UI shows
+ * the frames the core publishes in a texture of its own */
+static HBC56Device* vdpDevice = NULL;
+static SDL_Surface* vdpSurface = NULL;
+static SDL_Renderer* vdpRenderer = NULL;
+static SDL_Texture* vdpTexture = NULL;
+
+/* input handed from the UI event thread to the emulation core. Lock-free,
+ * so the bus never has to synchronise with the UI */
+#define KB_QUEUE_SIZE         0x8000
+#define ACIA_PASTE_QUEUE_SIZE 0x10000
+
+/* polled input carries the performance counter value of its poll, for
+ * timing it into the guest. pasted input carries 0 and is due at once */
+struct KeyInput
+{
+  SDL_KeyboardEvent key;
+  Uint64            polled;
+
+  KeyInput(const SDL_KeyboardEvent& key = SDL_KeyboardEvent(), Uint64 polled = 0) : key(key), polled(polled) {}
+};
+
+struct AciaInput
+{
+  uint8_t           byte;
+  Uint64            polled;
+
+  AciaInput(uint8_t byte = 0, Uint64 polled = 0) : byte(byte), polled(polled) {}
+};
+
+static SpscQueue<KeyInput, KB_QUEUE_SIZE> pasteQueue;
+
+/* pasted text for the PS/2 keyboard, as key strokes: an SDL scancode, with
+ * KB_STROKE_UP for a release. They never become SDL events, and go to the
+ * keyboard device alone, each as soon as the guest has acknowledged the
+ * codes of the one before on VIA1 port A (kbport.c) */
+#define KB_STROKE_UP          0x8000
+static SpscQueue<uint16_t, KB_QUEUE_SIZE> kbStrokeQueue;
+static SpscQueue<AciaInput, ACIA_PASTE_QUEUE_SIZE> aciaPasteQueue;
+
+/* host input is polled (UI thread) and handed to the devices (core, in
+ * emulated time) at this rate, whatever the frame rate */
+#define INPUT_RATE_DEFAULT    1000
+#define INPUT_RATE_MIN        60
+#define INPUT_RATE_MAX        10000
+static std::atomic<uint32_t> inputRate{ INPUT_RATE_DEFAULT };
+
+/* queued host input is checked at the input rate, and pasted strokes also
+ * as soon as the guest has read the keyboard device empty */
+static uint64_t nextInputCycle = 0;
+
+/* emulation core lock. With HBC56_HAVE_THREADS the core runs on its own
+ * thread and holds this while it runs. The UI draws from the snapshots the
+ * core publishes, and only takes it for commands (reset, ROM load, run
+ * state, edits from the debugger views) and for the VDP and VIA views,
+ * which read the devices themselves. SDL mutexes are recursive. They
+ * aren't fair either, so the core thread lets waiters in (coreLockWaiters) */
+static SDL_mutex* coreMutex = NULL;
+static SDL_atomic_t coreLockWaiters;
+
+static void coreLock()
+{
+  if (!coreMutex) return;
+  SDL_AtomicAdd(&coreLockWaiters, 1);
+  SDL_LockMutex(coreMutex);
+  SDL_AtomicAdd(&coreLockWaiters, -1);
+}
+
+static void coreUnlock()
+{
+  if (coreMutex) SDL_UnlockMutex(coreMutex);
+}
+
+/* the core thread sleeps while the guest is idle (see coreIdleSleepMs).
+ * Queueing host input wakes it */
+static SDL_mutex* wakeMutex = NULL;
+static SDL_cond* wakeCond = NULL;
+static bool wakePending = false;
+
+static void coreWake()
+{
+  if (!wakeCond) return;
+  SDL_LockMutex(wakeMutex);
+  wakePending = true;
+  SDL_CondSignal(wakeCond);
+  SDL_UnlockMutex(wakeMutex);
+}
+
+/* state the core publishes for the UI through lock-free snapshot buffers */
+#define TERM_SNAPSHOT_SIZE    0x10000
+
+/* the paced clock since power on. wallCycles - pacedCycles - droppedCycles
+ * is the lag still to catch up (negative after an overshoot) */
+struct ClockStats
+{
+  uint64_t        wallCycles;     /* what the paced wall time was worth */
+  uint64_t        pacedCycles;    /* run to keep up with it */
+  uint64_t        droppedCycles;  /* given up after host stalls */
+  uint32_t        drops;
+};
+
+struct CoreStatus
+{
+  uint64_t        cycles;
+  HBC56CpuState   cpuState;
+  float           cpuUtilization;
+  bool            runningTo;
+  uint64_t        runToCycles;
+  ClockStats      clock;
+};
+
+struct TerminalSnapshot
+{
+  uint32_t        version;
+  int             len;
+  char            text[TERM_SNAPSHOT_SIZE];
+};
+
+/* the CPU for the debugger views: its registers, and the address space as
+ * debug reads see it */
+struct DebugSnapshot
+{
+  HBC56CpuRegs    regs;
+  double          runtimeSeconds;
+  uint8_t         memory[0x10000];
+};
+
+/* our own debugger windows: conditions & watches, interrupts, input latency */
+struct StatsSnapshot
+{
+  int             bpCount;
+  char            bpSpec[BP_MAX_ENTRIES][BP_MAX_SPEC];
+  uint64_t        bpHits[BP_MAX_ENTRIES];
+  char            bpLastHit[BP_MAX_HIT];
+  bool            irqWired[IRQ_STATS_SOURCES];
+  IrqSourceStats  irq[IRQ_STATS_SOURCES];
+  uint64_t        irqCycles;
+  InputLatencyStats input[INPUT_PATHS];
+};
+
+/* the VDP's texture (border included), as ARGB8888 */
+#define VDP_FRAME_WIDTH       320
+#define VDP_FRAME_HEIGHT      240
+
+struct VdpFrame
+{
+  uint32_t        version;
+  int             width;
+  int             height;
+  uint32_t        pixels[VDP_FRAME_WIDTH * VDP_FRAME_HEIGHT];
+};
+
+static SnapshotBuffer<CoreStatus> coreStatus;
+static SnapshotBuffer<TerminalSnapshot> terminalSnapshot;
+static SnapshotBuffer<DebugSnapshot> debugSnapshot;
+static SnapshotBuffer<StatsSnapshot> statsSnapshot;
+static SnapshotBuffer<VdpFrame> vdpFrame;
+
+static void publishCoreState(bool force);
+
+/* while the UI thread draws the debugger views, memory reads (through the
+ * vrEmu6502 mirror or not) come from its copy of the last DebugSnapshot,
+ * and writes go to the machine as commands. no other thread sets these */
+static thread_local uint8_t* viewMemory = NULL;
+static thread_local double viewRuntimeSeconds = 0.0;
 
 static int loadRom(const char* filename);
 
 static std::string currentRomFile;
 static bool programLoaded = false;
+static int headless = 0;
 
 static imgui_addons::ImGuiFileBrowser file_dialog;
 
+/* report an error: message box, or stderr when running headless */
+static void showError(const char* message)
+{
+  if (headless)
+  {
+    fprintf(stderr, "%s\n", message);
+    return;
+  }
+  SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "DB6502 Emulator", message, NULL);
+}
+
 /* ACIA terminal accessor declarations (defined in acia_device.c) */
 extern "C" {
   const char* aciaGetTermBuffer(HBC56Device* device);
@@ -79,17 +331,31 @@ extern "C" {
 
   void hbc56Reset()
   {
+    coreLock();
+
     for (size_t i = 0; i < deviceCount; ++i)
     {
       resetDevice(&devices[i]);
     }
 
-    for (int i = 0; i < MAX_IRQS; ++i)
+    irqMask = 0;
+    irqTriggerMask = 0;
+    irqLine = false;
+    interrupt6502(cpuDevice, INTERRUPT_INT, INTERRUPT_RELEASE);
+    irqStatsSources(0);
+    irqStatsReset();
+    inputStatsReset();
+    kbPortReset();
+
+    /* reset devices have nothing pending. ask them again */
+    for (size_t i = 0; i < deviceCount; ++i)
     {
-      irqs[i] = INTERRUPT_RELEASE;
+      schedule[i].nextEventCycle = emulatedCycles;
     }
 
     debug6502State(cpuDevice, CPU_RUNNING);
+
+    coreUnlock();
   }
 
   int hbc56NumDevices()
@@ -108,38 +374,133 @@ extern "C" {
   {
     if (deviceCount < (HBC56_MAX_DEVICES - 1))
     {
+      DeviceSchedule* sched = &schedule[deviceCount];
+      sched->scheduled = device.tickFn != NULL;
+      sched->nextEventFn = NULL;
+      sched->lastTickCycle = emulatedCycles;
+      sched->nextEventCycle = emulatedCycles + SCHED_DEFAULT_PERIOD;
+
       devices[deviceCount] = device;
       return &devices[deviceCount++];
     }
     return NULL;
   }
 
+  void hbc56ScheduleDevice(HBC56Device* device, HBC56NextEventFn nextEventFn)
+  {
+    DeviceSchedule* sched = &schedule[device - devices];
+    sched->nextEventFn = nextEventFn;
+    sched->nextEventCycle = emulatedCycles;
+  }
+
+  /* the CPU drives the clock rather than being scheduled */
+  static void schedClockedByCpu(HBC56Device* device)
+  {
+    schedule[device - devices].scheduled = false;
+  }
+
+  /* reading the device returns the same thing until its next event */
+  static void schedSteadyReads(HBC56Device* device)
+  {
+    schedule[device - devices].steadyReads = true;
+  }
+
+  /* the core thread mustn't sleep through the device's events: they can
+   * interrupt the CPU, or produce output */
+  static void schedWakesCore(HBC56Device* device, bool wakes)
+  {
+    schedule[device - devices].wakesCore = wakes;
+  }
+
+  static uint64_t schedNextEvent(int index, uint64_t cycle)
+  {
+    DeviceSchedule* sched = &schedule[index];
+    if (!sched->nextEventFn) return cycle + SCHED_DEFAULT_PERIOD;
+
+    uint64_t next = sched->nextEventFn(&devices[index], cycle);
+    return (next > cycle) ? next : cycle + 1;
+  }
+
+  /* tick a device up to the given cycle. a device nobody has touched for a
+   * long time catches up in chunks the tick interface can hold */
+  static void schedSyncDevice(int index, uint64_t cycle)
+  {
+    DeviceSchedule* sched = &schedule[index];
+
+    uint32_t freq = clockFreq;
+    while (cycle > sched->lastTickCycle)
+    {
+      uint64_t delta = cycle - sched->lastTickCycle;
+      uint32_t deltaTicks = (delta > freq) ? freq : (uint32_t)delta;
+      tickDevice(&devices[index], deltaTicks, (float)(deltaTicks / (double)freq));
+      sched->lastTickCycle += deltaTicks;
+    }
+  }
+
+  /* bring every device up to date (before the UI looks at them) */
+  static void schedSyncAll()
+  {
+    for (int i = 0; i < deviceCount; ++i)
+    {
+      if (schedule[i].scheduled) schedSyncDevice(i, emulatedCycles);
+    }
+  }
+
   void hbc56Interrupt(uint8_t irq, HBC56InterruptSignal signal)
   {
     if (irq == 0 || irq > MAX_IRQS) return;
-    irq--;
+    uint8_t bit = 1 << (irq - 1);
+    uint8_t sources = irqMask | irqTriggerMask;
 
-    irqs[irq] = signal;
+    irqMask &= ~bit;
+    if (signal == INTERRUPT_RAISE) irqMask |= bit;
 
-    if (cpuDevice)
+    /* earlier triggers end with this change */
+    irqTriggerMask = (signal == INTERRUPT_TRIGGER) ? bit : 0;
+
+    if ((irqMask | irqTriggerMask) != sources)
     {
-      signal = INTERRUPT_RELEASE;
+      sources = irqMask | irqTriggerMask;
+      irqStatsSources(sources);
+    }
 
-      for (int i = 0; i < MAX_IRQS;++i)
-      {
-        if (irqs[i] == INTERRUPT_RAISE)
-        {
-          signal = INTERRUPT_RAISE;
-        }
-        else if (irqs[i] == INTERRUPT_TRIGGER)
-        {
-          irqs[i] = INTERRUPT_RELEASE;
-          signal = INTERRUPT_RAISE;
-        }
-      }
+    bool line = sources != 0;
 
-      interrupt6502(cpuDevice, INTERRUPT_INT, signal);
-    }
+    if (line == irqLine || !cpuDevice) return;
+    irqLine = line;
+    interrupt6502(cpuDevice, INTERRUPT_INT, line ? INTERRUPT_RAISE : INTERRUPT_RELEASE);
+  }
+
+  /* host pointers for a page wholly owned by plain memory, unless watched */
+  static void busUpdatePagePointers(int page)
+  {
+    busReadPages[page] = NULL;
+    busWritePages[page] = NULL;
+
+    const BusMapping* mapping = busMapPageOwner(page);
+    if (!mapping || !mapping->memory || busSlowPath) return;
+
+    uint8_t* memory = mapping->memory + ((page << 8) - mapping->startAddr);
+    if (!(busWatchPages[page] & HBC56_WATCH_READ)) busReadPages[page] = memory;
+    if (!(busWatchPages[page] & HBC56_WATCH_WRITE) && mapping->writable) busWritePages[page] = memory;
+  }
+
+  static void busAddMapping(HBC56Device* device, uint32_t startAddr, uint32_t endAddr, uint8_t priority, uint8_t* memory, bool writable)
+  {
+    if (!busMapAdd(device, startAddr, endAddr, priority, memory, writable)) return;
+
+    for (int page = 0; page < BUS_PAGE_COUNT; ++page) busUpdatePagePointers(page);
+    invalidate6502CodeCache(cpuDevice);
+  }
+
+  void hbc56MapDevice(HBC56Device* device, uint32_t startAddr, uint32_t endAddr, uint8_t priority)
+  {
+    busAddMapping(device, startAddr, endAddr, priority, NULL, false);
+  }
+
+  void hbc56MapMemory(HBC56Device* device, uint32_t startAddr, uint32_t endAddr, uint8_t priority, uint8_t* memory, bool writable)
+  {
+    busAddMapping(device, startAddr, endAddr, priority, memory, writable);
   }
 
   int hbc56LoadRom(const uint8_t* romData, int romDataSize)
@@ -151,24 +512,30 @@ extern "C" {
     if (romDataSize != HBC56_ROM_SIZE)
     {
       SDL_snprintf(tempBuffer, sizeof(tempBuffer), "Error. ROM file must be %d bytes.", HBC56_ROM_SIZE);
-      SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "DB6502 Emulator", tempBuffer, NULL);
+      showError(tempBuffer);
       status = 0;
     }
 
     if (status)
     {
+      coreLock();
       debug6502State(cpuDevice, CPU_BREAK);
       SDL_Delay(1);
       if (!romDevice)
       {
-        romDevice = hbc56AddDevice(createRomDevice(HBC56_ROM_START, HBC56_ROM_END, romData));
+        romDevice = hbc56AddDevice(createDirectRomDevice(HBC56_ROM_START, HBC56_ROM_END, romData));
+        hbc56MapMemory(romDevice, HBC56_ROM_START, HBC56_ROM_END, HBC56_BUS_PRIORITY_MEMORY,
+          directMemoryDeviceData(romDevice), false);
       }
       else
       {
-        status = setMemoryDeviceContents(romDevice, romData, romDataSize);
+        status = setDirectMemoryDeviceContents(romDevice, romData, romDataSize);
+        invalidate6502CodeCache(cpuDevice);
       }
+      hleClearTraps();    /* until the new ROM's labels are loaded */
       programLoaded = true;
       hbc56Reset();
+      coreUnlock();
     }
     return status;
   }
@@ -176,6 +543,7 @@ extern "C" {
   void hbc56LoadLabels(const char* labelFileContents)
   {
     debuggerLoadLabels(labelFileContents);
+    if (hleEnabled) hleLoadTraps(labelFileContents);
   }
 
   void hbc56LoadSource(const char* labelFileContents)
@@ -200,26 +568,22 @@ extern "C" {
 
   void hbc56PasteText(const char* text)
   {
-    SDL_LockMutex(kbQueueMutex);
+    bool truncated = false;
 
-    SDL_KeyboardEvent ev;
-    ev.type = SDL_KEYUP;
-    ev.keysym.scancode = SDL_SCANCODE_LCTRL;
-    pasteQueue.push(ev);
-    ev.keysym.scancode = SDL_SCANCODE_RCTRL;
-    pasteQueue.push(ev);
-
-    while (*text)
+    /* Ctrl is still down from Ctrl+V */
+    if (kbDevice)
     {
-      char c = *(text++);
-
-      /* for ACIA: queue chars for throttled delivery to the ACIA */
-      if (aciaDevice)
+      if (kbStrokeQueue.room() < 2) truncated = true;
+      else
       {
-        uint8_t byte = (uint8_t)c;
-        if (c == '\n') byte = '\r'; /* convert LF to CR for BASIC */
-        aciaPasteQueue.push(byte);
+        kbStrokeQueue.push(SDL_SCANCODE_LCTRL | KB_STROKE_UP);
+        kbStrokeQueue.push(SDL_SCANCODE_RCTRL | KB_STROKE_UP);
       }
+    }
+
+    while (*text && !truncated)
+    {
+      char c = *(text++);
 
       SDL_Scancode sc = SDL_SCANCODE_UNKNOWN;
       bool shift = false;
@@ -277,94 +641,338 @@ extern "C" {
         }
       }
 
-      if (sc != SDL_SCANCODE_UNKNOWN)
+      /* a character goes in whole or not at all, so a full queue can't
+       * leave a key (or Shift) down */
+      bool strokes = kbDevice && sc != SDL_SCANCODE_UNKNOWN;
+      if ((aciaDevice && aciaPasteQueue.room() < 1) ||
+          (strokes && kbStrokeQueue.room() < (shift ? 4u : 2u)))
       {
-        ev.type = SDL_KEYDOWN;
-        if (shift)
-        {
-          ev.keysym.scancode = SDL_SCANCODE_LSHIFT;
-          pasteQueue.push(ev);
-        }
+        truncated = true;
+        break;
+      }
 
-        ev.keysym.scancode = sc;
-        pasteQueue.push(ev);
-        ev.type = SDL_KEYUP;
-        pasteQueue.push(ev);
+      /* for ACIA: queue chars for throttled delivery to the ACIA */
+      if (aciaDevice)
+      {
+        uint8_t byte = (uint8_t)c;
+        if (c == '\n') byte = '\r'; /* convert LF to CR for BASIC */
+        aciaPasteQueue.push(byte);
+      }
 
-        if (shift)
-        {
-          ev.keysym.scancode = SDL_SCANCODE_LSHIFT;
-          pasteQueue.push(ev);
-        }
+      if (strokes)
+      {
+        if (shift) kbStrokeQueue.push(SDL_SCANCODE_LSHIFT);
+        kbStrokeQueue.push(sc);
+        kbStrokeQueue.push(sc | KB_STROKE_UP);
+        if (shift) kbStrokeQueue.push(SDL_SCANCODE_LSHIFT | KB_STROKE_UP);
       }
     }
-    SDL_UnlockMutex(kbQueueMutex);
+
+    coreWake();
+
+    if (truncated)
+    {
+      SDL_Log("Paste truncated: input queue full");
+    }
   }
 
   void hbc56ToggleDebugger()
   {
+    coreLock();
     debug6502State(cpuDevice, (getDebug6502State(cpuDevice) == CPU_RUNNING) ? CPU_BREAK : CPU_RUNNING);
+    coreUnlock();
   }
 
   void hbc56DebugBreak()
   {
+    coreLock();
     debug6502State(cpuDevice, CPU_BREAK);
+    coreUnlock();
   }
 
   void hbc56DebugRun()
   {
+    coreLock();
     debug6502State(cpuDevice, CPU_RUNNING);
+    coreUnlock();
   }
 
+  /* step over, step out and run to: the core reports how long they took
+   * once they stop */
+  static bool runToReported = true;
+
   void hbc56DebugStepInto()
   {
+    coreLock();
     debug6502State(cpuDevice, CPU_STEP_INTO);
+    coreUnlock();
   }
 
   void hbc56DebugStepOver()
   {
+    coreLock();
     debug6502State(cpuDevice, CPU_STEP_OVER);
+    runToReported = !is6502RunningTo(cpuDevice);
+    coreUnlock();
   }
 
   void hbc56DebugStepOut()
   {
+    coreLock();
     debug6502State(cpuDevice, CPU_STEP_OUT);
+    runToReported = false;
+    coreUnlock();
+  }
+
+  void hbc56DebugRunTo(uint16_t addr)
+  {
+    coreLock();
+    run6502To(cpuDevice, addr);
+    runToReported = false;
+    coreUnlock();
   }
 
   void hbc56DebugBreakOnInt()
   {
+    coreLock();
     debug6502State(cpuDevice, CPU_BREAK_ON_INTERRUPT);
+    coreUnlock();
   }
 
   double hbc56CpuRuntimeSeconds()
   {
+    if (viewMemory) return viewRuntimeSeconds;
     return getCpuRuntimeSeconds(cpuDevice);
   }
 
-  uint8_t hbc56MemRead(uint16_t addr, bool dbg)
+  void hbc56SetClockFreq(uint32_t hz)
+  {
+    if (hz < CLOCK_FREQ_MIN) hz = CLOCK_FREQ_MIN;
+    if (hz > CLOCK_FREQ_MAX) hz = CLOCK_FREQ_MAX;
+
+    coreLock();
+
+    /* devices catch up at the old clock, then plan their events (frames,
+     * keyboard polls) at the new one. doTick() rebases its pacing */
+    schedSyncAll();
+    clockFreq = hz;
+    set6502ClockFreq(cpuDevice, hz);
+    for (int i = 0; i < deviceCount; ++i)
+    {
+      if (schedule[i].scheduled) schedule[i].nextEventCycle = schedNextEvent(i, emulatedCycles);
+    }
+
+    coreUnlock();
+  }
+
+  uint32_t hbc56ClockFreq()
+  {
+    return clockFreq;
+  }
+
+  static inline HBC56Device* busDecode(uint16_t addr)
+  {
+    const BusMapping* mapping = busMapOwner(addr);
+    return mapping ? mapping->device : NULL;
+  }
+
+  /* bring a device up to the cycle of the bus access the CPU is making */
+  static inline void schedBeforeAccess(HBC56Device* device)
+  {
+    int index = (int)(device - devices);
+    if (schedule[index].scheduled) schedSyncDevice(index, getCpuCycleCount(cpuDevice));
+  }
+
+  /* the access may have moved the device's next event */
+  static inline void schedAfterAccess(HBC56Device* device)
+  {
+    int index = (int)(device - devices);
+    DeviceSchedule* sched = &schedule[index];
+    if (!sched->scheduled) return;
+
+    sched->nextEventCycle = schedNextEvent(index, sched->lastTickCycle);
+    if (sched->nextEventCycle < schedRunEnd) stop6502CpuRun(cpuDevice);
+  }
+
+  /* idle loop detection: can a read of this (device) address change
+   * before the end of the current CPU run? */
+  static uint8_t busSteadyRead(uint16_t addr)
+  {
+    HBC56Device* device = busDecode(addr);
+    return !device || schedule[device - devices].steadyReads;
+  }
+
+  /* a watched access. the CPU finishes the instruction, then breaks */
+  static void busWatchHit(uint16_t addr, uint8_t val, bool write)
+  {
+    if (busWatch && busWatch(addr, val, write))
+    {
+      debug6502State(cpuDevice, CPU_BREAK);
+      stop6502CpuRun(cpuDevice);
+    }
+  }
+
+  /* a device leaves the addresses of its window it doesn't decode to the
+   * mapping under it (the ROM, under the I/O windows), as they were left
+   * when the bus tried every device in turn */
+  static void busReadFallback(uint16_t addr, uint8_t* val, bool dbg)
   {
+    const BusMapping* mapping = busMapFallback(addr);
+    if (!mapping) return;
+
+    if (!dbg) schedBeforeAccess(mapping->device);
+    readDevice(mapping->device, addr, val, dbg);
+    if (!dbg) schedAfterAccess(mapping->device);
+  }
+
+  static void busWriteFallback(uint16_t addr, uint8_t val)
+  {
+    const BusMapping* mapping = busMapFallback(addr);
+    if (!mapping) return;
+
+    schedBeforeAccess(mapping->device);
+    writeDevice(mapping->device, addr, val);
+    schedAfterAccess(mapping->device);
+  }
+
+  static inline uint8_t busRead(uint16_t addr, bool dbg)
+  {
+    /* plain memory: straight from the host page */
+    const uint8_t* page = busReadPages[addr >> 8];
+    if (page) return page[addr & 0xff];
+
     uint8_t val = 0x00;
 
-    SDL_LockMutex(kbQueueMutex);
-    for (size_t i = 0; i < deviceCount; ++i)
+    HBC56Device* device = busDecode(addr);
+    if (device)
     {
-      if (readDevice(&devices[i], addr, &val, dbg))
-        break;
+      if (dbg)
+      {
+        if (!readDevice(device, addr, &val, dbg)) busReadFallback(addr, &val, dbg);
+#if HBC56_HAVE_KB
+        int taken;
+        if (kbPortRegister(addr)) val = kbPortRead(addr, val, true, &taken);
+#endif
+      }
+      else
+      {
+        schedBeforeAccess(device);
+        uint8_t decoded = readDevice(device, addr, &val, dbg);
+        schedAfterAccess(device);
+        if (!decoded) busReadFallback(addr, &val, dbg);
+
+#if HBC56_HAVE_KB
+        if (kbPortRegister(addr))
+        {
+          int taken;
+          schedBeforeAccess(kbDevice);
+          val = kbPortRead(addr, val, false, &taken);
+          schedAfterAccess(kbDevice);
+
+          /* the guest acknowledged a code. once it has all of a pasted
+           * stroke's, the next stroke goes in after this instruction */
+          if (taken)
+          {
+            inputStatsRead(INPUT_PATH_KEYBOARD, getCpuCycleCount(cpuDevice));
+            if (!kbStrokeQueue.empty() && keyboardDeviceQueueEmpty(kbDevice))
+            {
+              nextInputCycle = getCpuCycleCount(cpuDevice);
+              stop6502CpuRun(cpuDevice);
+            }
+          }
+        }
+#endif
+
+        /* the guest reading input, for the latency stats */
+#if HBC56_HAVE_ACIA
+        if (addr == HBC56_ACIA_ADDR) inputStatsRead(INPUT_PATH_ACIA, getCpuCycleCount(cpuDevice));
+#endif
+      }
     }
-    SDL_UnlockMutex(kbQueueMutex);
 
+    if (!dbg && (busWatchPages[addr >> 8] & HBC56_WATCH_READ)) busWatchHit(addr, val, false);
+
+    return val;
+  }
+
+  uint8_t hbc56MemRead(uint16_t addr, bool dbg)
+  {
+    if (viewMemory) return viewMemory[addr];
+    if (!busReadMutex) return busRead(addr, dbg);
+
+    SDL_LockMutex(busReadMutex);
+    uint8_t val = busRead(addr, dbg);
+    SDL_UnlockMutex(busReadMutex);
     return val;
   }
 
   void hbc56MemWrite(uint16_t addr, uint8_t val)
   {
-    for (size_t i = 0; i < deviceCount; ++i)
+    if (viewMemory)
     {
-      if (writeDevice(&devices[i], addr, val))
-        break;
+      /* edited in a debugger view. publishing straight away keeps the next
+       * frame from showing the old value */
+      uint8_t* memory = viewMemory;
+      viewMemory = NULL;
+      coreLock();
+      hbc56MemWrite(addr, val);
+      memory[addr] = hbc56MemRead(addr, true);
+      publishCoreState(true);
+      coreUnlock();
+      viewMemory = memory;
+      return;
+    }
+
+    uint8_t* page = busWritePages[addr >> 8];
+    if (page)
+    {
+      /* the CPU writes pages itself. anyone else may be patching code */
+      page[addr & 0xff] = val;
+      invalidate6502CodePage(cpuDevice, addr >> 8);
+      return;
+    }
+
+    HBC56Device* device = busDecode(addr);
+    if (device)
+    {
+      schedBeforeAccess(device);
+      uint8_t decoded = writeDevice(device, addr, val);
+      schedAfterAccess(device);
+      if (!decoded) busWriteFallback(addr, val);
+    }
+
+    if (busWatchPages[addr >> 8] & HBC56_WATCH_WRITE)
+    {
+      /* a watched memory page: the core didn't see this write */
+      invalidate6502CodePage(cpuDevice, addr >> 8);
+      busWatchHit(addr, val, true);
     }
   }
 
+  const uint8_t* const* hbc56MemReadPages()
+  {
+    return busReadPages;
+  }
+
+  uint8_t* const* hbc56MemWritePages()
+  {
+    return busWritePages;
+  }
+
+  void hbc56SetWatchHandler(HBC56WatchFn watch)
+  {
+    busWatch = watch;
+  }
+
+  void hbc56WatchPage(uint8_t page, uint8_t access)
+  {
+    busWatchPages[page] = access;
+    busUpdatePagePointers(page);
+
+    /* code on the page is fetched through the bus while it is read watched */
+    invalidate6502CodePage(cpuDevice, page);
+  }
+
 #ifdef __cplusplus
 }
 #endif
@@ -381,76 +989,279 @@ static double perfFreq = 0.0;
 static int tickCount = 0;
 static int mouseZ = 0;
 
+/* turbo: run back to back instead of pacing to wall-clock time */
+#if HBC56_HAVE_THREADS
+#define TURBO_SLICE_SECONDS   0.002   /* wall time per doTick() before releasing the core lock */
+#else
+#define TURBO_SLICE_SECONDS   0.015   /* wall time per doTick() before rendering again */
+#endif
+static std::atomic<bool> turbo{ false };
 
-static void doTick()
+/* otherwise, pace to this multiple of real time */
+#define PACE_MULTIPLE_MAX     100
+static std::atomic<uint32_t> paceMultiple{ 1 };
+
+/* step over, step out and run to also run unthrottled, until they stop */
+static bool unthrottled()
 {
-  static double lastTime = (double)SDL_GetPerformanceCounter() / perfFreq;
+  return turbo || is6502RunningTo(cpuDevice);
+}
 
-  double deltaTime = 0.0001;  /* 100us per batch */
-  uint32_t deltaClockTicks = (uint32_t)(HBC56_CLOCK_FREQ * deltaTime);
+/* paced (not turbo) running catches up at most this much wall time at once */
+#define CATCHUP_MAX_MS        100
 
-  double currentTime = (double)SDL_GetPerformanceCounter() / perfFreq;
-  double elapsed = currentTime - lastTime;
+static ClockStats clockStats = {};
 
-  if (elapsed <= 0) return;
-  if (elapsed > 0.05) elapsed = 0.05; /* cap at 50ms to avoid long freezes */
+/* the core publishes snapshots for the UI at this interval */
+#define PUBLISH_INTERVAL_MS   8
 
-  int batches = (int)(elapsed / deltaTime);
-  if (batches < 1) batches = 1;
+/* measured emulation speed */
+static double measuredMHz = 0.0;
 
-  for (int b = 0; b < batches; ++b)
-  {
-    /* drip-feed pasted text into the ACIA with flow control.
-     * Check BIOS circular buffer fill level via zero page pointers:
-     *   READ_PTR at $0000, WRITE_PTR at $0001
-     * Only send when buffer has room (< 192 bytes used). */
-    if (aciaDevice && !aciaPasteQueue.empty() && aciaDeviceRxBufEmpty(aciaDevice))
-    {
-      uint8_t wrPtr = hbc56MemRead(0x0001, true);
-      uint8_t rdPtr = hbc56MemRead(0x0000, true);
-      uint8_t bufUsed = (wrPtr - rdPtr); /* wraps correctly for uint8_t */
-      if (bufUsed < 192)
-      {
-        aciaDeviceReceiveByte(aciaDevice, aciaPasteQueue.front());
-        aciaPasteQueue.pop();
-      }
-    }
 
-    for (size_t i = 0; i < deviceCount; ++i)
-    {
-      tickDevice(&devices[i], deltaClockTicks, deltaTime);
-    }
-  }
+/* the paced clock counts in whole cycles from clockBase (a performance
+ * counter value), so no fraction of a cycle is ever lost to rounding */
+static Uint64 clockBase = 0;
+static uint64_t clockRate = 0;      /* cycles per wall second since clockBase */
+static uint64_t clockDue = 0;       /* cycles the wall time since clockBase is worth */
+static uint64_t clockRun = 0;       /* cycles run or dropped since clockBase */
+static uint64_t clockBaseCycle = 0; /* the emulated cycle clockBase maps to, less drops */
 
-  lastTime = currentTime;
+/* emulated cycles per wall second when paced */
+static uint64_t pacedRate()
+{
+  return (uint64_t)clockFreq * paceMultiple;
 }
 
+/* start counting again from now (after turbo, before a ROM is loaded, or
+ * at a new rate) */
+static void clockRebase()
+{
+  clockBase = SDL_GetPerformanceCounter();
+  clockRate = pacedRate();
+  clockDue = 0;
+  clockRun = 0;
+  clockBaseCycle = emulatedCycles;
+}
 
-static void aboutDialog(bool* aboutOpen)
+/* the cycles a span of performance counter ticks is worth, rounded down.
+ * CLOCK_FREQ_MAX and PACE_MULTIPLE_MAX keep the product in 64 bits */
+static uint64_t clockCyclesIn(Uint64 ticks)
 {
-  if (ImGui::Begin("About DB6502 Emulator", aboutOpen, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoDocking | ImGuiWindowFlags_NoCollapse))
-  {
-    ImGui::Text("DB6502 Emulator v0.1\n\n");
-    ImGui::Text("Based on HBC-56 Emulator by Troy Schrapel\n");
-    ImGui::Text("Adapted for DB6502 by Paul\n\n");
-    ImGui::Separator();
-    ImGui::Text("Licensed under the MIT License.\n\n");
-    ImGui::Text("HBC-56: https://github.com/visrealm/hbc-56");
-  }
-  ImGui::End();
+  static const Uint64 ticksPerSecond = SDL_GetPerformanceFrequency();
+  return (ticks / ticksPerSecond) * clockRate + (ticks % ticksPerSecond) * clockRate / ticksPerSecond;
 }
 
+/* the emulated cycle a performance counter value maps to on the paced
+ * clock. unthrottled, nothing maps: it's now */
+static uint64_t clockCycleAt(Uint64 counter)
+{
+  if (unthrottled() || !clockBase || counter < clockBase) return emulatedCycles;
+  return clockBaseCycle + clockCyclesIn(counter - clockBase);
+}
 
-/* ACIA terminal window */
-static void aciaTerminalWindow(bool* showTerminal)
+static bool inputQueued()
 {
-  if (!aciaDevice) return;
+  return !pasteQueue.empty() || !aciaPasteQueue.empty() || !kbStrokeQueue.empty();
+}
 
-  ImGui::SetNextWindowSize(ImVec2(600, 400), ImGuiCond_FirstUseEver);
+/* polled input reaches the guest no earlier than the cycle its poll maps to */
+static uint64_t inputDueCycle(Uint64 polled)
+{
+  return polled ? clockCycleAt(polled) : emulatedCycles;
+}
+
+/* drip-feed pasted text into the ACIA with flow control.
+ * Check BIOS circular buffer fill level via zero page pointers:
+ *   READ_PTR at $0000, WRITE_PTR at $0001
+ * Only send when buffer has room (< 192 bytes used). */
+static void doPasteInput()
+{
+  if (aciaDevice && !aciaPasteQueue.empty() && aciaDeviceRxBufEmpty(aciaDevice))
+  {
+    uint8_t wrPtr = hbc56MemRead(0x0001, true);
+    uint8_t rdPtr = hbc56MemRead(0x0000, true);
+    uint8_t bufUsed = (wrPtr - rdPtr); /* wraps correctly for uint8_t */
+    const AciaInput& input = aciaPasteQueue.front();
+    uint64_t due = inputDueCycle(input.polled);
+    if (bufUsed < 192 && due <= emulatedCycles)
+    {
+      if (input.polled) inputStatsInjected(INPUT_PATH_ACIA, due, emulatedCycles);
+      aciaDeviceReceiveByte(aciaDevice, input.byte);
+      aciaPasteQueue.pop();
+    }
+  }
+}
+
+/* feed due key events to the devices while the keyboard device can accept
+ * them */
+static void doKeyboardInput()
+{
+  while (!pasteQueue.empty() && keyboardDeviceQueueEmpty(kbDevice))
+  {
+    const KeyInput& input = pasteQueue.front();
+    uint64_t due = inputDueCycle(input.polled);
+    if (due > emulatedCycles) break;
+    if (input.polled && input.key.type == SDL_KEYDOWN) inputStatsInjected(INPUT_PATH_KEYBOARD, due, emulatedCycles);
+
+    SDL_Event ev;
+    ev.type = input.key.type;
+    ev.key = input.key;
+    pasteQueue.pop();
+
+    for (size_t i = 0; i < deviceCount; ++i)
+    {
+      eventDevice(&devices[i], &ev);
+    }
+  }
+
+  /* then pasted strokes */
+  while (!kbStrokeQueue.empty() && keyboardDeviceQueueEmpty(kbDevice))
+  {
+    uint16_t stroke = kbStrokeQueue.front();
+    kbStrokeQueue.pop();
+
+    SDL_Event ev;
+    SDL_zero(ev);
+    ev.type = (stroke & KB_STROKE_UP) ? SDL_KEYUP : SDL_KEYDOWN;
+    ev.key.type = ev.type;
+    ev.key.keysym.scancode = (SDL_Scancode)(stroke & ~KB_STROKE_UP);
+    eventDevice(kbDevice, &ev);
+  }
+}
+
+/* run the machine for (at least) the given number of cycles. the CPU runs
+ * up to the earliest device event, then every device that is due is ticked */
+static void runCycles(uint64_t cycles)
+{
+  uint64_t endCycle = emulatedCycles + cycles;
+
+  while (emulatedCycles < endCycle)
+  {
+    uint64_t runEnd = endCycle;
+    for (int i = 0; i < deviceCount; ++i)
+    {
+      if (schedule[i].scheduled && schedule[i].nextEventCycle < runEnd)
+      {
+        runEnd = schedule[i].nextEventCycle;
+      }
+    }
+    if (inputQueued() && nextInputCycle < runEnd)
+    {
+      runEnd = nextInputCycle;
+    }
+
+    if (runEnd > emulatedCycles)
+    {
+      uint32_t deltaTicks = (uint32_t)(runEnd - emulatedCycles);
+      schedRunEnd = runEnd;
+      tickDevice(cpuDevice, deltaTicks, (float)(deltaTicks / (double)clockFreq));
+      emulatedCycles = getCpuCycleCount(cpuDevice);
+    }
+
+    if (emulatedCycles >= nextInputCycle)
+    {
+      doPasteInput();
+      doKeyboardInput();
+
+      /* bytes for the ACIA go in one per check, so they keep the shorter
+       * period. key events only need the input rate */
+      if (!aciaPasteQueue.empty()) nextInputCycle = emulatedCycles + SCHED_DEFAULT_PERIOD;
+      else nextInputCycle = emulatedCycles + (clockFreq + inputRate - 1) / inputRate;
+    }
+
+    for (int i = 0; i < deviceCount; ++i)
+    {
+      DeviceSchedule* sched = &schedule[i];
+      if (sched->scheduled && sched->nextEventCycle <= emulatedCycles)
+      {
+        schedSyncDevice(i, emulatedCycles);
+        sched->nextEventCycle = schedNextEvent(i, emulatedCycles);
+      }
+    }
+  }
+}
+
+static void doTick()
+{
+  if (unthrottled())
+  {
+    /* unthrottled: run until this slice of wall time is used up, checking
+     * the clock every emulated millisecond */
+    double sliceEnd = (double)SDL_GetPerformanceCounter() / perfFreq + TURBO_SLICE_SECONDS;
+    do
+    {
+      runCycles(clockFreq / 1000);
+    } while ((double)SDL_GetPerformanceCounter() / perfFreq < sliceEnd && unthrottled());
+
+    clockRebase();
+    return;
+  }
+
+  if (clockBase && clockRate != pacedRate())
+  {
+    /* a new clock or pacing: the stats are for the new rate */
+    clockStats = {};
+    clockRebase();
+  }
+  if (!clockBase) clockRebase();
+
+  uint64_t due = clockCyclesIn(SDL_GetPerformanceCounter() - clockBase);
+  clockStats.wallCycles += due - clockDue;
+  clockDue = due;
+  if (due <= clockRun) return;
+
+  uint64_t owed = due - clockRun;
+  uint64_t catchupMax = clockRate * CATCHUP_MAX_MS / 1000;
+  if (owed > catchupMax)
+  {
+    /* the host stalled. catching all of it up would freeze the guest for as
+     * long, so the excess is dropped, and counted */
+    uint64_t dropped = owed - catchupMax;
+    clockStats.droppedCycles += dropped;
+    ++clockStats.drops;
+    clockRun += dropped;
+    clockBaseCycle -= dropped;
+    owed = catchupMax;
+    SDL_Log("Clock: fell %.1f ms behind wall time, dropped %llu cycles (%.1f ms)",
+      (double)(owed + dropped) * 1000.0 / clockRate, (unsigned long long)dropped, dropped * 1000.0 / clockRate);
+  }
+
+  /* the run can overshoot by part of an instruction. that comes off next time */
+  uint64_t startCycles = emulatedCycles;
+  runCycles(owed);
+  clockRun += emulatedCycles - startCycles;
+  clockStats.pacedCycles += emulatedCycles - startCycles;
+}
+
+
+static void aboutDialog(bool* aboutOpen)
+{
+  if (ImGui::Begin("About DB6502 Emulator", aboutOpen, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoDocking | ImGuiWindowFlags_NoCollapse))
+  {
+    ImGui::Text("DB6502 Emulator v0.1\n\n");
+    ImGui::Text("Based on HBC-56 Emulator by Troy Schrapel\n");
+    ImGui::Text("Adapted for DB6502 by Paul\n\n");
+    ImGui::Separator();
+    ImGui::Text("Licensed under the MIT License.\n\n");
+    ImGui::Text("HBC-56: https://github.com/visrealm/hbc-56");
+  }
+  ImGui::End();
+}
+
+
+/* ACIA terminal window */
+static bool terminalFocused = false;
+
+static void aciaTerminalWindow(bool* showTerminal)
+{
+  if (!aciaDevice) return;
+
+  ImGui::SetNextWindowSize(ImVec2(600, 400), ImGuiCond_FirstUseEver);
   if (ImGui::Begin("Serial Terminal", showTerminal))
   {
-    const char* buf = aciaGetTermBuffer(aciaDevice);
-    int bufLen = aciaGetTermLen(aciaDevice);
+    static uint32_t shownVersion = 0;
+    const TerminalSnapshot& term = terminalSnapshot.latest();
 
     /* terminal output area */
     ImVec2 contentSize = ImGui::GetContentRegionAvail();
@@ -459,58 +1270,200 @@ static void aciaTerminalWindow(bool* showTerminal)
     ImGui::BeginChild("TermOutput", contentSize, true);
     ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 1.0f, 0.0f, 1.0f)); /* green text */
 
-    if (bufLen > 0)
+    if (term.len > 0)
     {
-      ImGui::TextUnformatted(buf, buf + bufLen);
+      ImGui::TextUnformatted(term.text, term.text + term.len);
     }
 
     ImGui::PopStyleColor();
 
-    if (aciaGetScrollToBottom(aciaDevice))
+    if (term.version != shownVersion)
     {
       ImGui::SetScrollHereY(1.0f);
+      shownVersion = term.version;
     }
     ImGui::EndChild();
 
-    /* input: capture keyboard when terminal is focused */
-    if (ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows))
+    /* input: while the terminal is focused, doEvents() sends typing to
+     * the ACIA as it's polled */
+    terminalFocused = ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows);
+
+    ImGui::Text("Type in terminal when focused | Ctrl+V to paste");
+  }
+  ImGui::End();
+}
+
+
+/* conditional breakpoints and watches (breakpoints.c). the core evaluates
+ * them, so the window shows the registry from the last StatsSnapshot and
+ * changes it as commands */
+static void breakConditionsWindow(bool* show)
+{
+  static char spec[96] = "";
+  static char error[128] = "";
+
+  ImGui::SetNextWindowSize(ImVec2(460, 260), ImGuiCond_FirstUseEver);
+  if (ImGui::Begin("Conditions & Watches", show))
+  {
+    bool add = ImGui::InputText("##spec", spec, sizeof(spec), ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    add |= ImGui::Button("Add");
+
+    if (add && spec[0])
     {
-      ImGuiIO& io = ImGui::GetIO();
-      /* process text input (filter CR/LF/BS - handled by special key checks below) */
-      if (io.InputQueueCharacters.Size > 0)
+      coreLock();
+      if (bpAdd(spec, error, sizeof(error)) >= 0)
       {
-        for (int i = 0; i < io.InputQueueCharacters.Size; ++i)
-        {
-          ImWchar c = io.InputQueueCharacters[i];
-          if (c > 0 && c < 128 && c != '\r' && c != '\n' && c != '\b')
-          {
-            aciaDeviceReceiveByte(aciaDevice, (uint8_t)c);
-          }
-        }
-        io.InputQueueCharacters.resize(0);
+        spec[0] = 0;
+        error[0] = 0;
       }
+      publishCoreState(true);
+      coreUnlock();
+    }
 
-      /* handle special keys */
-      if (ImGui::IsKeyPressed(ImGuiKey_Enter) || ImGui::IsKeyPressed(ImGuiKey_KeypadEnter))
-      {
-        aciaDeviceReceiveByte(aciaDevice, '\r');
-      }
-      if (ImGui::IsKeyPressed(ImGuiKey_Backspace))
-      {
-        aciaDeviceReceiveByte(aciaDevice, '\b');
-      }
-      if (ImGui::IsKeyPressed(ImGuiKey_Escape))
+    if (error[0]) ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", error);
+    else ImGui::TextDisabled("e.g. $E03A if A==$0D && [$0001]!=[$0000]  or  write $8400");
+    ImGui::Separator();
+
+    const StatsSnapshot& stats = statsSnapshot.latest();
+    int removeIndex = -1;
+    for (int i = 0; i < stats.bpCount; ++i)
+    {
+      ImGui::PushID(i);
+      if (ImGui::SmallButton("X")) removeIndex = i;
+      ImGui::PopID();
+      ImGui::SameLine();
+      ImGui::Text("%-40s %llu hits", stats.bpSpec[i], (unsigned long long)stats.bpHits[i]);
+    }
+
+    if (stats.bpLastHit[0])
+    {
+      ImGui::Separator();
+      ImGui::TextWrapped("%s", stats.bpLastHit);
+    }
+
+    if (removeIndex >= 0)
+    {
+      coreLock();
+      bpRemove(removeIndex);
+      publishCoreState(true);
+      coreUnlock();
+    }
+  }
+  ImGui::End();
+}
+
+
+/* per IRQ source: line time, handler time and storms */
+static void interruptsWindow(bool* show)
+{
+  ImGui::SetNextWindowSize(ImVec2(560, 200), ImGuiCond_FirstUseEver);
+  if (ImGui::Begin("Interrupts", show))
+  {
+    if (ImGui::Button("Reset"))
+    {
+      coreLock();
+      irqStatsReset();
+      publishCoreState(true);
+      coreUnlock();
+    }
+
+    const StatsSnapshot& snapshot = statsSnapshot.latest();
+    uint64_t cycles = snapshot.irqCycles;
+
+    ImGui::Text("%-4s %-12s %10s %9s %10s %10s %8s", "IRQ", "Source", "Asserts", "Asserted", "Entries", "Cycles", "Avg");
+    ImGui::Separator();
+
+    for (uint8_t irq = 1; irq <= IRQ_STATS_SOURCES; ++irq)
+    {
+      if (!snapshot.irqWired[irq - 1]) continue;
+      const IrqSourceStats& stats = snapshot.irq[irq - 1];
+
+      ImGui::Text("%-4u %-12s %10llu %8.2f%% %10llu %10llu %8.1f", irq, stats.name[0] ? stats.name : "?",
+        (unsigned long long)stats.asserts, cycles ? 100.0 * stats.assertedCycles / cycles : 0.0,
+        (unsigned long long)stats.entries, (unsigned long long)stats.handlerCycles,
+        stats.entries ? (double)stats.handlerCycles / stats.entries : 0.0);
+      if (stats.stormEntries)
       {
-        aciaDeviceReceiveByte(aciaDevice, 0x1B);
+        ImGui::SameLine();
+        if (stats.storming) ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "STORM (%llu)", (unsigned long long)stats.stormEntries);
+        else ImGui::TextDisabled("storm entries: %llu", (unsigned long long)stats.stormEntries);
       }
     }
+  }
+  ImGui::End();
+}
 
-    ImGui::Text("Type in terminal when focused | Ctrl+V to paste");
+
+/* key press to device and to guest read, per input path */
+static void inputLatencyWindow(bool* show)
+{
+  ImGui::SetNextWindowSize(ImVec2(560, 140), ImGuiCond_FirstUseEver);
+  if (ImGui::Begin("Input Latency", show))
+  {
+    static const uint32_t rates[] = { 250, 500, 1000, 2000, 4000 };
+    ImGui::Text("Input polling:");
+    for (uint32_t rate : rates)
+    {
+      ImGui::SameLine();
+      SDL_snprintf(tempBuffer, sizeof(tempBuffer), "%u Hz", rate);
+      if (ImGui::RadioButton(tempBuffer, inputRate == rate)) inputRate = rate;
+    }
+
+    if (ImGui::Button("Reset"))
+    {
+      coreLock();
+      inputStatsReset();
+      publishCoreState(true);
+      coreUnlock();
+    }
+
+    /* in microseconds of emulated time */
+    double usPerCycle = 1000000.0 / clockFreq;
+    ImGui::Text("%-10s %8s %10s %10s %8s %10s %10s %10s", "Path", "Keys", "Queue avg", "Queue max", "Read", "Read avg", "Read min", "Read max");
+    ImGui::Separator();
+
+    const StatsSnapshot& snapshot = statsSnapshot.latest();
+    for (int path = 0; path < INPUT_PATHS; ++path)
+    {
+      const InputLatencyStats& stats = snapshot.input[path];
+      ImGui::Text("%-10s %8llu %8.0fus %8.0fus %8llu %8.0fus %8.0fus %8.0fus", stats.name, (unsigned long long)stats.keys,
+        stats.keys ? stats.queueCycles * usPerCycle / stats.keys : 0.0, stats.queueMax * usPerCycle,
+        (unsigned long long)stats.reads, stats.reads ? stats.readCycles * usPerCycle / stats.reads : 0.0,
+        stats.readMin * usPerCycle, stats.readMax * usPerCycle);
+    }
   }
   ImGui::End();
 }
 
 
+/* the CPU tests breakpoints in its own bitmap rather than calling the
+ * debugger for every instruction. the debugger views only toggle
+ * breakpoints on a click or a key, so doEvents() flags those and the
+ * bitmap is rebuilt on this thread after the next frame has drawn the
+ * views with them. it is handed over only when it has changed */
+static bool breakpointInput = false;
+
+static void syncBreakpoints()
+{
+  static uint8_t bitmap[0x10000 / 8];
+  static uint8_t current[0x10000 / 8];
+
+  memset(current, 0, sizeof(current));
+  for (uint32_t addr = 0; addr < 0x10000; ++addr)
+  {
+    if (debuggerIsBreakpoint((uint16_t)addr)) current[addr >> 3] |= 1 << (addr & 7);
+  }
+
+  if (memcmp(current, bitmap, sizeof(bitmap)) != 0)
+  {
+    memcpy(bitmap, current, sizeof(bitmap));
+    coreLock();
+    set6502Breakpoints(cpuDevice, bitmap);
+    coreUnlock();
+  }
+}
+
 static void doRender()
 {
   static bool aboutOpen = false;
@@ -520,14 +1473,17 @@ static void doRender()
   static bool showDisassembly = true;
   static bool showSource = true;
   static bool showBreakpoints = true;
+  static bool showBreakConditions = false;
+  static bool showInterrupts = false;
+  static bool showInputLatency = false;
 
   static bool showMemory = true;
-  static bool showTms9918Memory = true;
-  static bool showTms9918Registers = true;
-  static bool showTms9918Patterns = true;
-  static bool showTms9918Sprites = true;
-  static bool showTms9918SpritePatterns = true;
-  static bool showVia6522 = true;
+  static bool showTms9918Memory = false;
+  static bool showTms9918Registers = false;
+  static bool showTms9918Patterns = false;
+  static bool showTms9918Sprites = false;
+  static bool showTms9918SpritePatterns = false;
+  static bool showVia6522 = false;
   static bool showTerminal = true;
 
   ImGui_ImplSDLRenderer2_NewFrame();
@@ -577,7 +1533,8 @@ static void doRender()
 
     if (ImGui::BeginMenu("Debug"))
     {
-      bool isRunning = getDebug6502State(cpuDevice) == CPU_RUNNING;
+      const CoreStatus& status = coreStatus.latest();
+      bool isRunning = status.cpuState == CPU_RUNNING || status.runningTo;
 
       if (ImGui::MenuItem("Break", "<F12>", false, isRunning)) { hbc56DebugBreak(); }
       if (ImGui::MenuItem("Break on Interrupt", "<F7>", false, isRunning)) { hbc56DebugBreakOnInt(); }
@@ -587,6 +1544,65 @@ static void doRender()
       if (ImGui::MenuItem("Step In", "<F11>", false, !isRunning)) { hbc56DebugStepInto(); }
       if (ImGui::MenuItem("Step Over", "<F10>", false, !isRunning)) { hbc56DebugStepOver(); }
       if (ImGui::MenuItem("Step Out", "<Shift> + <F11>", false, !isRunning)) { hbc56DebugStepOut(); }
+      if (ImGui::BeginMenu("Run To", !isRunning))
+      {
+        static char runToText[8] = "";
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 4);
+        if (ImGui::InputText("Address ($)", runToText, sizeof(runToText), ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_EnterReturnsTrue) && runToText[0])
+        {
+          hbc56DebugRunTo((uint16_t)SDL_strtoul(runToText, NULL, 16));
+          ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndMenu();
+      }
+      if (status.runToCycles)
+      {
+        ImGui::TextDisabled("Last step: %llu cycles", (unsigned long long)status.runToCycles);
+      }
+      ImGui::Separator();
+      if (ImGui::BeginMenu("Clock"))
+      {
+        static const uint32_t presets[] = { 1000000, 2000000, 4000000, 8000000, 14000000 };
+        for (uint32_t hz : presets)
+        {
+          SDL_snprintf(tempBuffer, sizeof(tempBuffer), "%u MHz", hz / 1000000);
+          if (ImGui::MenuItem(tempBuffer, "", hbc56ClockFreq() == hz)) { hbc56SetClockFreq(hz); }
+        }
+        static char clockText[12] = "";
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        if (ImGui::InputText("Hz", clockText, sizeof(clockText), ImGuiInputTextFlags_CharsDecimal | ImGuiInputTextFlags_EnterReturnsTrue) && clockText[0])
+        {
+          hbc56SetClockFreq((uint32_t)SDL_strtoul(clockText, NULL, 10));
+          ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndMenu();
+      }
+      if (ImGui::BeginMenu("Pacing"))
+      {
+        static const uint32_t multiples[] = { 1, 2, 10, 100 };
+        for (uint32_t multiple : multiples)
+        {
+          if (multiple == 1) SDL_strlcpy(tempBuffer, "Real time", sizeof(tempBuffer));
+          else SDL_snprintf(tempBuffer, sizeof(tempBuffer), "%ux real time", multiple);
+          if (ImGui::MenuItem(tempBuffer, "", !turbo && paceMultiple == multiple))
+          {
+            turbo = false;
+            paceMultiple = multiple;
+          }
+        }
+        if (ImGui::MenuItem("Unlimited (Turbo)", "<F9>", turbo)) { turbo = !turbo; }
+        ImGui::EndMenu();
+      }
+      if (status.clock.wallCycles)
+      {
+        /* paced (not turbo) running only */
+        const ClockStats& clock = status.clock;
+        ImGui::TextDisabled("Clock: %.4f MHz, %llu cycles dropped in %u stalls",
+          (double)clock.pacedCycles / clock.wallCycles * pacedRate() / 1000000.0,
+          (unsigned long long)clock.droppedCycles, clock.drops);
+        ImGui::TextDisabled("Behind wall time: %lld cycles",
+          (long long)(clock.wallCycles - clock.pacedCycles - clock.droppedCycles));
+      }
       ImGui::EndMenu();
     }
 
@@ -602,6 +1618,9 @@ static void doRender()
         ImGui::MenuItem("Source", "<Ctrl> + O", &showSource);
         ImGui::MenuItem("Memory", "<Ctrl> + M", &showMemory);
         ImGui::MenuItem("Breakpoints", "<Ctrl> + B", &showBreakpoints);
+        ImGui::MenuItem("Conditions & Watches", "", &showBreakConditions);
+        ImGui::MenuItem("Interrupts", "", &showInterrupts);
+        ImGui::MenuItem("Input Latency", "", &showInputLatency);
         ImGui::Separator();
         ImGui::MenuItem("TMS9918A VRAM", "<Ctrl> + G", &showTms9918Memory);
         ImGui::MenuItem("TMS9918A Registers", "<Ctrl> + T", &showTms9918Registers);
@@ -639,57 +1658,102 @@ static void doRender()
     hbc56Reset();
   }
 
-  for (size_t i = 0; i < deviceCount; ++i)
+  /* the VDP's picture, as the core last published it */
+  const VdpFrame& frame = vdpFrame.latest();
+  static uint32_t frameVersion = 0;
+  if (vdpTexture && frame.version != frameVersion)
   {
-    renderDevice(&devices[i]);
-    if (devices[i].output && devices[i].visible)
-    {
-      int texW, texH;
-      SDL_QueryTexture(devices[i].output, NULL, NULL, &texW, &texH);
+    SDL_Rect rect = { 0, 0, frame.width, frame.height };
+    SDL_UpdateTexture(vdpTexture, &rect, frame.pixels, VDP_FRAME_WIDTH * sizeof(uint32_t));
+    frameVersion = frame.version;
+  }
+
+  if (vdpDevice && vdpDevice->visible && frame.version)
+  {
+    int texW = frame.width, texH = frame.height;
 
-      ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
-      ImGui::Begin(devices[i].name, &devices[i].visible);
-      ImGui::PopStyleVar();
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
+    ImGui::Begin(vdpDevice->name, &vdpDevice->visible);
+    ImGui::PopStyleVar();
 
-      ImVec2 windowSize = ImGui::GetContentRegionAvail();
+    ImVec2 windowSize = ImGui::GetContentRegionAvail();
 
-      double scaleX = windowSize.x / (double)texW;
-      double scaleY = windowSize.y / (double)texH;
+    double scaleX = windowSize.x / (double)texW;
+    double scaleY = windowSize.y / (double)texH;
 
-      double scale = (scaleX < scaleY) ? scaleX : scaleY;
+    double scale = (scaleX < scaleY) ? scaleX : scaleY;
 
-      ImVec2 imageSize = windowSize;
-      imageSize.x = (float)(texW * scale);
-      imageSize.y = (float)(texH * scale);
+    ImVec2 imageSize = windowSize;
+    imageSize.x = (float)(texW * scale);
+    imageSize.y = (float)(texH * scale);
 
-      ImVec2 pos = ImGui::GetCursorPos();
-      pos.x += (windowSize.x - imageSize.x) / 2;
-      pos.y += (windowSize.y - imageSize.y) / 2;
-      ImGui::SetCursorPos(pos);
+    ImVec2 pos = ImGui::GetCursorPos();
+    pos.x += (windowSize.x - imageSize.x) / 2;
+    pos.y += (windowSize.y - imageSize.y) / 2;
+    ImGui::SetCursorPos(pos);
 
-      ImGui::Image(devices[i].output, imageSize);
-      ImGui::End();
-    }
+    ImGui::Image(vdpTexture, imageSize, ImVec2(0, 0), ImVec2((float)texW / VDP_FRAME_WIDTH, (float)texH / VDP_FRAME_HEIGHT));
+    ImGui::End();
   }
 
   if (aboutOpen) aboutDialog(&aboutOpen);
 
   /* serial terminal */
+  terminalFocused = false;
   if (showTerminal) aciaTerminalWindow(&showTerminal);
 
-  /* debugger windows */
+  if (showBreakConditions) breakConditionsWindow(&showBreakConditions);
+  if (showInterrupts) interruptsWindow(&showInterrupts);
+  if (showInputLatency) inputLatencyWindow(&showInputLatency);
+
+  /* CPU debugger windows. the mirror holds the registers of the last
+   * DebugSnapshot and memory reads come from a copy of its memory. edits
+   * go to the core as commands */
+  static uint8_t memory[0x10000];
+  const DebugSnapshot& debug = debugSnapshot.latest();
+  memcpy(memory, debug.memory, sizeof(memory));
+  set6502Mirror(cpuDevice, &debug.regs);
+  viewMemory = memory;
+  viewRuntimeSeconds = debug.runtimeSeconds;
   if (showRegisters) debuggerRegistersView(&showRegisters);
   if (showStack) debuggerStackView(&showStack);
   if (showDisassembly)debuggerDisassemblyView(&showDisassembly);
   if (showSource) debuggerSourceView(&showSource);
   if (showMemory) debuggerMemoryView(&showMemory);
   if (showBreakpoints) debuggerBreakpointsView(&showBreakpoints);
-  if (showTms9918Memory) debuggerVramMemoryView(&showTms9918Memory);
-  if (showTms9918Registers) debuggerTmsRegistersView(&showTms9918Registers);
-  if (showTms9918Patterns) debuggerTmsPatternsView(renderer, &showTms9918Patterns);
-  if (showTms9918Sprites) debuggerTmsSpritesView(renderer, &showTms9918Sprites);
-  if (showTms9918SpritePatterns) debuggerTmsSpritePatternsView(renderer, &showTms9918SpritePatterns);
-  if (showVia6522) debuggerVia6522View(&showVia6522);
+  viewMemory = NULL;
+
+  if (is6502MirrorEdited(cpuDevice))
+  {
+    coreLock();
+    take6502MirrorEdits(cpuDevice);
+    publishCoreState(true);
+    coreUnlock();
+  }
+
+  /* the VDP and VIA views read the devices themselves, through the HBC-56
+   * debugger, so only these take the core lock every frame. they start
+   * closed */
+  if (showTms9918Memory || showTms9918Registers || showTms9918Patterns || showTms9918Sprites ||
+      showTms9918SpritePatterns || showVia6522)
+  {
+    coreLock();
+    schedSyncAll();
+    if (showTms9918Memory) debuggerVramMemoryView(&showTms9918Memory);
+    if (showTms9918Registers) debuggerTmsRegistersView(&showTms9918Registers);
+    if (showTms9918Patterns) debuggerTmsPatternsView(renderer, &showTms9918Patterns);
+    if (showTms9918Sprites) debuggerTmsSpritesView(renderer, &showTms9918Sprites);
+    if (showTms9918SpritePatterns) debuggerTmsSpritePatternsView(renderer, &showTms9918SpritePatterns);
+    if (showVia6522) debuggerVia6522View(&showVia6522);
+    coreUnlock();
+  }
+
+  /* even if the view that took the input has just been closed */
+  if (breakpointInput)
+  {
+    breakpointInput = false;
+    syncBreakpoints();
+  }
 
   ImGui::PopStyleColor(4);
 
@@ -702,14 +1766,60 @@ static void doRender()
 }
 
 
+/* typing into the focused terminal, straight to the ACIA. returns true if
+ * ImGui shouldn't see the event */
+static bool terminalInput(const SDL_Event& event, Uint64 polled)
+{
+  if (!terminalFocused) return false;
+
+  if (event.type == SDL_TEXTINPUT)
+  {
+    for (const char* c = event.text.text; *c; ++c)
+    {
+      if (*c > 0 && *c != '\r' && *c != '\n' && *c != '\b') aciaPasteQueue.push(AciaInput((uint8_t)*c, polled));
+    }
+    coreWake();
+    return true;
+  }
+
+  if (event.type == SDL_KEYDOWN)
+  {
+    uint8_t byte = 0;
+    switch (event.key.keysym.sym)
+    {
+      case SDLK_RETURN:
+      case SDLK_KP_ENTER:
+        byte = '\r';
+        break;
+      case SDLK_BACKSPACE:
+        byte = '\b';
+        break;
+      case SDLK_ESCAPE:
+        byte = 0x1B;
+        break;
+    }
+    if (byte)
+    {
+      aciaPasteQueue.push(AciaInput(byte, polled));
+      coreWake();
+    }
+  }
+  return false;
+}
+
 static void doEvents()
 {
-  SDL_LockMutex(kbQueueMutex);
+  Uint64 polled = SDL_GetPerformanceCounter();
 
   SDL_Event event;
   while (SDL_PollEvent(&event))
   {
+    if (terminalInput(event, polled)) continue;
     ImGui_ImplSDL2_ProcessEvent(&event);
+    if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP || event.type == SDL_KEYDOWN)
+    {
+      breakpointInput = true;
+    }
 
     int skipProcessing = 0;
     switch (event.type)
@@ -775,6 +1885,10 @@ static void doEvents()
               hbc56DebugBreakOnInt();
               break;
 
+            case SDLK_F9:
+              turbo = !turbo;
+              break;
+
             case SDLK_PAGEUP:
             case SDLK_KP_9:
               if (withControl)
@@ -863,70 +1977,333 @@ static void doEvents()
     {
       if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
       {
-        pasteQueue.push(event.key);
+        pasteQueue.push(KeyInput(event.key, polled));
+        coreWake();
       }
       else
       {
+        coreLock();
         for (size_t i = 0; i < deviceCount; ++i)
         {
           eventDevice(&devices[i], &event);
         }
+        coreUnlock();
       }
     }
   }
+}
 
-  if (keyboardDeviceQueueEmpty(kbDevice))
-  {
-    for (int j = 0; j < 2 && !pasteQueue.empty(); ++j)
-    {
-      SDL_Event ev;
-      ev.type = pasteQueue.front().type;
-      ev.key = pasteQueue.front();
-      pasteQueue.pop();
+/* one pass of the emulation core: run the machine up to wall-clock time.
+ * queued input is handed over as it runs */
+static void coreStep()
+{
+  /* no time is owed from before a ROM was loaded */
+  if (programLoaded) doTick();
+  else clockRebase();
 
-      for (size_t i = 0; i < deviceCount; ++i)
-      {
-        eventDevice(&devices[i], &ev);
-      }
-    }
+  if (!runToReported && !is6502RunningTo(cpuDevice))
+  {
+    uint64_t cycles = get6502RunToCycles(cpuDevice);
+    SDL_Log("Stopped at $%04X after %llu cycles (%.3f ms)", get6502InstructionPC(cpuDevice),
+      (unsigned long long)cycles, cycles * 1000.0 / clockFreq);
+    runToReported = true;
   }
-  SDL_UnlockMutex(kbQueueMutex);
 }
 
-static void loop()
+/* the CPU and our debugger windows' state, for the UI's debugger views */
+static void publishDebugState()
 {
-  static uint32_t lastRenderTicks = 0;
-
-  if (programLoaded) doTick();
+  DebugSnapshot& debug = debugSnapshot.back();
+  get6502Registers(cpuDevice, &debug.regs);
+  debug.runtimeSeconds = getCpuRuntimeSeconds(cpuDevice);
 
-  ++tickCount;
-
-  uint32_t currentTicks = SDL_GetTicks();
-  if ((currentTicks - lastRenderTicks) > 17)
+  const uint8_t* const* pages = hbc56MemReadPages();
+  for (int page = 0; page < 0x100; ++page)
   {
-    doRender();
+    uint8_t* dest = debug.memory + (page << 8);
+    if (pages[page])
+    {
+      memcpy(dest, pages[page], 0x100);
+      continue;
+    }
+    for (int i = 0; i < 0x100; ++i) dest[i] = hbc56MemRead((uint16_t)((page << 8) | i), true);
+  }
+  debugSnapshot.publish();
 
-    lastRenderTicks = currentTicks;
-    tickCount = 0;
+  StatsSnapshot& stats = statsSnapshot.back();
+  const char* spec;
+  stats.bpCount = 0;
+  while (stats.bpCount < BP_MAX_ENTRIES && (spec = bpGet(stats.bpCount, &stats.bpHits[stats.bpCount])) != NULL)
+  {
+    SDL_strlcpy(stats.bpSpec[stats.bpCount++], spec, BP_MAX_SPEC);
+  }
+  SDL_strlcpy(stats.bpLastHit, bpLastHit(), BP_MAX_HIT);
 
-    doEvents();
+  for (uint8_t irq = 1; irq <= IRQ_STATS_SOURCES; ++irq)
+  {
+    stats.irqWired[irq - 1] = irqStatsGet(irq, &stats.irq[irq - 1]) != 0;
+  }
+  stats.irqCycles = irqStatsCycles();
 
-    SDL_snprintf(tempBuffer, sizeof(tempBuffer), "DB6502 Emulator (CPU: %0.4f%%) (ROM: %s)", getCpuUtilization(cpuDevice) * 100.0f, currentRomFile.c_str());
-    SDL_SetWindowTitle(window, tempBuffer);
+  for (int path = 0; path < INPUT_PATHS; ++path)
+  {
+    inputStatsGet((InputPath)path, &stats.input[path]);
   }
+  statsSnapshot.publish();
 }
 
+/* render the VDP on the core's software renderer and publish the picture */
+static void publishVdpFrame()
+{
+  static uint32_t frameVersion = 0;
 
-static char labelMapFile[FILENAME_MAX] = { 0 };
+  if (!vdpRenderer || !vdpDevice || !vdpDevice->output) return;
 
-static int loadRom(const char* filename)
-{
-  FILE* ptr = NULL;
-  int romLoaded = 0;
+  renderDevice(vdpDevice);
 
-#ifndef HAVE_FOPEN_S
-  ptr = fopen(filename, "rb");
-#else
+  int width, height;
+  SDL_QueryTexture(vdpDevice->output, NULL, NULL, &width, &height);
+  if (width > VDP_FRAME_WIDTH) width = VDP_FRAME_WIDTH;
+  if (height > VDP_FRAME_HEIGHT) height = VDP_FRAME_HEIGHT;
+
+  SDL_Rect rect = { 0, 0, width, height };
+  SDL_RenderCopy(vdpRenderer, vdpDevice->output, NULL, &rect);
+
+  VdpFrame& frame = vdpFrame.back();
+  frame.width = width;
+  frame.height = height;
+  SDL_RenderReadPixels(vdpRenderer, &rect, SDL_PIXELFORMAT_ARGB8888, frame.pixels, VDP_FRAME_WIDTH * sizeof(uint32_t));
+  frame.version = ++frameVersion;
+  vdpFrame.publish();
+}
+
+/* publish core state for the UI. the terminal is only copied when the ACIA
+ * has written to it. the UI publishes too, after a command, but only with
+ * the core lock held */
+static void publishCoreState(bool force)
+{
+  static uint32_t lastPublishTicks = 0;
+  static uint32_t termVersion = 0;
+
+  uint32_t currentTicks = SDL_GetTicks();
+  if (!force && (currentTicks - lastPublishTicks) < PUBLISH_INTERVAL_MS) return;
+  lastPublishTicks = currentTicks;
+
+  CoreStatus& status = coreStatus.back();
+  status.cycles = emulatedCycles;
+  status.cpuState = getDebug6502State(cpuDevice);
+  status.cpuUtilization = getCpuUtilization(cpuDevice);
+  status.runningTo = is6502RunningTo(cpuDevice);
+  status.runToCycles = get6502RunToCycles(cpuDevice);
+  status.clock = clockStats;
+  coreStatus.publish();
+
+  if (aciaDevice && aciaGetScrollToBottom(aciaDevice))
+  {
+    TerminalSnapshot& term = terminalSnapshot.back();
+    term.len = aciaGetTermLen(aciaDevice);
+    if (term.len > TERM_SNAPSHOT_SIZE) term.len = TERM_SNAPSHOT_SIZE;
+    memcpy(term.text, aciaGetTermBuffer(aciaDevice), term.len);
+    term.version = ++termVersion;
+    terminalSnapshot.publish();
+  }
+
+  if (!headless)
+  {
+    schedSyncAll();
+    publishDebugState();
+    publishVdpFrame();
+  }
+}
+
+#define CORE_IDLE_SLEEP_MAX_MS  50    /* well inside doTick()'s catch-up limit */
+
+/* how long the core can sleep: while the CPU is idle (WAI, STP or an idle
+ * loop), only an event of a device that can interrupt it or that the loop
+ * reads, or host input, can change anything. Audio still needs its ticks */
+static uint32_t coreIdleSleepMs()
+{
+  if (unthrottled() || !programLoaded || !is6502CpuIdle(cpuDevice)) return 0;
+  if (!aciaPasteQueue.empty()) return 0;
+
+  /* key events and pasted strokes the keyboard device can take keep the
+   * core awake. the rest wait for the guest to read it, which an idle
+   * guest won't */
+  if ((!pasteQueue.empty() || !kbStrokeQueue.empty()) && keyboardDeviceQueueEmpty(kbDevice)) return 0;
+
+  uint64_t wakeCycle = emulatedCycles + pacedRate() * CORE_IDLE_SLEEP_MAX_MS / 1000;
+  for (int i = 0; i < deviceCount; ++i)
+  {
+    const DeviceSchedule* sched = &schedule[i];
+    if (sched->scheduled && (sched->wakesCore || sched->steadyReads) && sched->nextEventCycle < wakeCycle)
+    {
+      wakeCycle = sched->nextEventCycle;
+    }
+  }
+  if (wakeCycle <= emulatedCycles) return 0;
+  return (uint32_t)((wakeCycle - emulatedCycles) * 1000 / pacedRate());
+}
+
+#if HBC56_HAVE_THREADS
+/* the emulation core's own thread. it only gives up the core lock between
+ * passes, so the UI can never stall it for longer than its own brief
+ * locked sections. a waiting command gets the lock before the next pass,
+ * even unthrottled */
+static SDL_atomic_t coreRunning;
+
+static void coreSleep(uint32_t ms)
+{
+  SDL_LockMutex(wakeMutex);
+  if (!wakePending) SDL_CondWaitTimeout(wakeCond, wakeMutex, ms);
+  wakePending = false;
+  SDL_UnlockMutex(wakeMutex);
+}
+
+static int emulationThread(void*)
+{
+  while (SDL_AtomicGet(&coreRunning))
+  {
+    coreLock();
+    coreStep();
+    publishCoreState(false);
+    uint32_t sleepMs = coreIdleSleepMs();
+    bool fast = unthrottled();
+    coreUnlock();
+
+    while (SDL_AtomicGet(&coreLockWaiters) > 0) SDL_Delay(0);
+
+    /* caught up with wall-clock time. doTick() catches up the sleep */
+    if (sleepMs > 1) coreSleep(sleepMs);
+    else if (!fast) SDL_Delay(1);
+  }
+  return 0;
+}
+#endif
+
+/* sample the emulated clock rate over roughly half a second of wall time */
+static void updateMeasuredSpeed()
+{
+  static Uint64 lastCounter = SDL_GetPerformanceCounter();
+  static uint64_t lastCycles = 0;
+
+  Uint64 counter = SDL_GetPerformanceCounter();
+  double seconds = (double)(counter - lastCounter) / perfFreq;
+  if (seconds < 0.5) return;
+
+  uint64_t cycles = coreStatus.latest().cycles;
+  measuredMHz = (double)(cycles - lastCycles) / seconds / 1000000.0;
+  lastCounter = counter;
+  lastCycles = cycles;
+}
+
+/* the UI thread sleeps until its next deadline: the next frame, the next
+ * input poll and, without a core thread, the next core pass. SDL_Delay()
+ * can wake a scheduler quantum late, so the last HOST_SPIN_MS before a
+ * frame is spun. A late core pass costs nothing (doTick() catches up), and
+ * a poll is about as short as a quantum, so those are only slept for */
+#define FRAME_RATE            60
+#define CORE_PASS_MS          1     /* between passes while the guest is busy */
+#define HOST_SPIN_MS          1
+
+static void hostSleepUntil(Uint64 deadline, bool precise)
+{
+  Uint64 now = SDL_GetPerformanceCounter();
+  if (now >= deadline) return;
+
+  Uint64 ticksPerMs = SDL_GetPerformanceFrequency() / 1000;
+  if (!precise)
+  {
+    SDL_Delay((Uint32)((deadline - now + ticksPerMs - 1) / ticksPerMs));
+    return;
+  }
+
+  Uint64 ms = (deadline - now) / ticksPerMs;
+  if (ms > HOST_SPIN_MS) SDL_Delay((Uint32)(ms - HOST_SPIN_MS));
+  while (SDL_GetPerformanceCounter() < deadline) {}
+}
+
+static void loop()
+{
+  static Uint64 nextFrame = 0;
+  static Uint64 nextPoll = 0;
+  static const Uint64 framePeriod = SDL_GetPerformanceFrequency() / FRAME_RATE;
+
+#if !HBC56_HAVE_THREADS
+  Uint64 passStart = SDL_GetPerformanceCounter();
+  coreStep();
+#endif
+
+  ++tickCount;
+
+  Uint64 now = SDL_GetPerformanceCounter();
+  if (now >= nextFrame)
+  {
+#if !HBC56_HAVE_THREADS
+    publishCoreState(true);
+#endif
+    doRender();
+
+    /* keep to the frame grid, unless a frame ran long (or vsync held it) */
+    nextFrame += framePeriod;
+    if (nextFrame <= now) nextFrame = now + framePeriod;
+    tickCount = 0;
+
+    doEvents();
+
+    updateMeasuredSpeed();
+    if (turbo)
+    {
+      SDL_snprintf(tempBuffer, sizeof(tempBuffer), "DB6502 Emulator (TURBO: %0.2f MHz) (ROM: %s)", measuredMHz, currentRomFile.c_str());
+    }
+    else if (coreStatus.latest().runningTo)
+    {
+      SDL_snprintf(tempBuffer, sizeof(tempBuffer), "DB6502 Emulator (STEPPING: %0.2f MHz) (ROM: %s)", measuredMHz, currentRomFile.c_str());
+    }
+    else
+    {
+      SDL_snprintf(tempBuffer, sizeof(tempBuffer), "DB6502 Emulator (CPU: %0.4f%%, %0.2f MHz) (ROM: %s)", coreStatus.latest().cpuUtilization * 100.0f, measuredMHz, currentRomFile.c_str());
+    }
+    SDL_SetWindowTitle(window, tempBuffer);
+    nextPoll = now + SDL_GetPerformanceFrequency() / inputRate;
+  }
+  else if (now >= nextPoll)
+  {
+    /* between frames, host input is polled at the input rate */
+    doEvents();
+    nextPoll = now + SDL_GetPerformanceFrequency() / inputRate;
+  }
+
+#if !HBC56_HAVE_THREADS
+  /* the core runs here too. unthrottled, it doesn't wait at all; an idle
+   * guest waits for its next event */
+  if (unthrottled()) return;
+  uint32_t passMs = coreIdleSleepMs();
+  if (passMs < CORE_PASS_MS) passMs = CORE_PASS_MS;
+  Uint64 nextPass = passStart + passMs * (SDL_GetPerformanceFrequency() / 1000);
+  if (nextPass < nextFrame && nextPass < nextPoll)
+  {
+    hostSleepUntil(nextPass, false);
+    return;
+  }
+#endif
+
+  if (nextPoll < nextFrame) hostSleepUntil(nextPoll, false);
+  else hostSleepUntil(nextFrame, true);
+}
+
+
+static char labelMapFile[FILENAME_MAX] = { 0 };
+
+static int loadRom(const char* filename)
+{
+  FILE* ptr = NULL;
+  int romLoaded = 0;
+
+  coreLock();
+
+#ifndef HAVE_FOPEN_S
+  ptr = fopen(filename, "rb");
+#else
   fopen_s(&ptr, filename, "rb");
 #endif
 
@@ -993,24 +2370,260 @@ static int loadRom(const char* filename)
   }
   else
   {
+    coreUnlock();
     SDL_snprintf(tempBuffer, sizeof(tempBuffer), "Error. ROM file '%s' does not exist.", filename);
-    SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "DB6502 Emulator", tempBuffer, NULL);
+    showError(tempBuffer);
     return 2;
   }
 
+  coreUnlock();
   return romLoaded;
 }
 
-int main(int argc, char* argv[])
+/* bus benchmark: times reads over the whole address space through the
+ * original first-claim-wins device scan and through the address decoder.
+ * debug reads are used so device state isn't disturbed */
+static uint8_t busScanRead(uint16_t addr)
 {
-  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0)
+  uint8_t val = 0x00;
+  for (int i = 0; i < deviceCount; ++i)
   {
-    printf("Error: %s\n", SDL_GetError());
-    return -1;
+    if (readDevice(&devices[i], addr, &val, true))
+      break;
+  }
+  return val;
+}
+
+static uint8_t busDecodeRead(uint16_t addr)
+{
+  uint8_t val = 0x00;
+  HBC56Device* device = busDecode(addr);
+  if (device && !readDevice(device, addr, &val, true))
+  {
+    const BusMapping* fallback = busMapFallback(addr);
+    if (fallback) readDevice(fallback->device, addr, &val, true);
+  }
+  return val;
+}
+
+static uint8_t busDirectRead(uint16_t addr)
+{
+  return hbc56MemRead(addr, true);
+}
+
+/* the bus read path as it was with the keyboard queue mutex held around
+ * every access */
+static SDL_mutex* benchMutex = NULL;
+
+static uint8_t busLockedRead(uint16_t addr)
+{
+  SDL_LockMutex(benchMutex);
+  uint8_t val = busDecodeRead(addr);
+  SDL_UnlockMutex(benchMutex);
+  return val;
+}
+
+static double busBenchmarkPass(uint8_t (*readFn)(uint16_t), int passes, uint32_t* checksum)
+{
+  Uint64 start = SDL_GetPerformanceCounter();
+  for (int p = 0; p < passes; ++p)
+  {
+    for (uint32_t addr = 0; addr < 0x10000; ++addr)
+    {
+      *checksum += readFn((uint16_t)addr);
+    }
+  }
+  double seconds = (double)(SDL_GetPerformanceCounter() - start) / perfFreq;
+  return (passes * 65536.0) / seconds;
+}
+
+static void busBenchmark()
+{
+  const int passes = 200;
+  uint32_t scanChecksum = 0, decodeChecksum = 0;
+
+  uint32_t lockedChecksum = 0, directChecksum = 0;
+
+  benchMutex = SDL_CreateMutex();
+
+  double scanOps = busBenchmarkPass(busScanRead, passes, &scanChecksum);
+  double decodeOps = busBenchmarkPass(busDecodeRead, passes, &decodeChecksum);
+  double lockedOps = busBenchmarkPass(busLockedRead, passes, &lockedChecksum);
+  double directOps = busBenchmarkPass(busDirectRead, passes, &directChecksum);
+
+  SDL_DestroyMutex(benchMutex);
+  benchMutex = NULL;
+
+  printf("Bus benchmark: %d reads per method\n", passes * 0x10000);
+  printf("  device scan     : %8.2f Mops/s\n", scanOps / 1000000.0);
+  printf("  address decoder : %8.2f Mops/s (%.2fx)\n", decodeOps / 1000000.0, decodeOps / scanOps);
+  printf("  decoder + mutex : %8.2f Mops/s (%.2fx)\n", lockedOps / 1000000.0, lockedOps / scanOps);
+  printf("  direct pages    : %8.2f Mops/s (%.2fx)\n", directOps / 1000000.0, directOps / scanOps);
+  if (scanChecksum != decodeChecksum || scanChecksum != directChecksum)
+  {
+    printf("  WARNING: decoded reads returned different data to the device scan\n");
+  }
+}
+
+/* how often each fused instruction sequence has run */
+static void printFusionStats(FILE* out)
+{
+  uint64_t count;
+  const char* name;
+  for (int i = 0; (name = getCpuFusionStat(cpuDevice, i, &count)) != NULL; ++i)
+  {
+    fprintf(out, "  fused %-28s: %llu\n", name, (unsigned long long)count);
+  }
+}
+
+/* guest benchmark: boots BASIC from the Woz Monitor, types in a tight loop
+ * and measures emulated MHz while it runs with no wall-clock pacing. then
+ * again with every access through hbc56MemRead/Write, without and with the
+ * per read mutex the bus used to take */
+static double guestBenchmarkPass(uint64_t* cycles)
+{
+  const char* script = "A000 R\r\r\r10 I=I+1:GOTO 10\rRUN\r";
+  const uint64_t warmupCycles = clockFreq * 5ull;   /* 5 emulated seconds to boot and type */
+  const uint64_t timedCycles = clockFreq * 10ull;   /* 10 emulated seconds */
+
+  hbc56Reset();
+  aciaPasteQueue.clear();
+  while (*script) aciaPasteQueue.push((uint8_t)*(script++));
+
+  runCycles(warmupCycles);
+
+  uint64_t startCycles = emulatedCycles;
+  Uint64 start = SDL_GetPerformanceCounter();
+  runCycles(timedCycles);
+  double seconds = (double)(SDL_GetPerformanceCounter() - start) / perfFreq;
+  uint64_t run = emulatedCycles - startCycles;
+  if (cycles) *cycles = run;
+  return run / seconds;
+}
+
+static void busSetSlowPath(bool slow)
+{
+  busSlowPath = slow;
+  for (int page = 0; page < BUS_PAGE_COUNT; ++page) busUpdatePagePointers(page);
+  invalidate6502CodeCache(cpuDevice);
+}
+
+static void cpuBenchmark()
+{
+  uint64_t cycles = 0;
+  double hz = guestBenchmarkPass(&cycles);
+
+  printf("Guest benchmark: BASIC '10 I=I+1:GOTO 10', %llu cycles\n", (unsigned long long)cycles);
+  printf("  emulated speed  : %8.2f MHz (%.1fx real time)\n", hz / 1000000.0, hz / clockFreq);
+  printFusionStats(stdout);
+
+  busSetSlowPath(true);
+  double slowHz = guestBenchmarkPass(NULL);
+  busReadMutex = SDL_CreateMutex();
+  double lockedHz = guestBenchmarkPass(NULL);
+  SDL_DestroyMutex(busReadMutex);
+  busReadMutex = NULL;
+  busSetSlowPath(false);
+
+  printf("  no host pages   : %8.2f MHz (%.2fx)\n", slowHz / 1000000.0, slowHz / hz);
+  printf("  + mutex per read: %8.2f MHz (%.2fx)\n", lockedHz / 1000000.0, lockedHz / hz);
+}
+
+/* core benchmark: the same loop on flat memory through vrEmu6502 (model
+ * checked at run time) and through our core built for each model */
+static uint8_t benchMem[0x10000];
+static const uint8_t* benchReadPages[256];
+static uint8_t* benchWritePages[256];
+
+static uint8_t benchRead(uint16_t addr, bool dbg) { (void)dbg; return benchMem[addr]; }
+static void benchWrite(uint16_t addr, uint8_t val) { benchMem[addr] = val; }
+
+static void coreBenchmarkInit()
+{
+  static const uint8_t program[] = {
+    0xA2, 0x00,             /* $0200 LDX #0        */
+    0xBD, 0x00, 0x10,       /* loop: LDA $1000,X   */
+    0x18,                   /*       CLC           */
+    0x69, 0x07,             /*       ADC #7        */
+    0x9D, 0x00, 0x11,       /*       STA $1100,X   */
+    0xC9, 0x80,             /*       CMP #$80      */
+    0xD0, 0x02,             /*       BNE skip      */
+    0xE6, 0x40,             /*       INC $40       */
+    0xA0, 0x08,             /* skip: LDY #8        */
+    0x88,                   /* wait: DEY           */
+    0xD0, 0xFD,             /*       BNE wait      */
+    0xE8,                   /*       INX           */
+    0xD0, 0xE9,             /*       BNE loop      */
+    0x4C, 0x00, 0x02        /*       JMP $0200     */
+  };
+  memset(benchMem, 0, sizeof(benchMem));
+  memcpy(benchMem + 0x0200, program, sizeof(program));
+  for (int i = 0; i < 0x100; ++i) benchMem[0x1000 + i] = (uint8_t)(i * 13);
+  benchMem[0xFFFC] = 0x00;
+  benchMem[0xFFFD] = 0x02;
+  for (int page = 0; page < 256; ++page)
+  {
+    benchReadPages[page] = benchMem + (page << 8);
+    benchWritePages[page] = benchMem + (page << 8);
   }
+}
 
-  kbQueueMutex = SDL_CreateMutex();
+static double coreBenchmarkVrEmu(uint64_t cycles)
+{
+  coreBenchmarkInit();
+  VrEmu6502* cpu = vrEmu6502New(CPU_W65C02, benchRead, benchWrite);
+  vrEmu6502Reset(cpu);
+
+  uint64_t run = 0;
+  Uint64 start = SDL_GetPerformanceCounter();
+  while (run < cycles) run += vrEmu6502InstCycle(cpu);
+  double seconds = (double)(SDL_GetPerformanceCounter() - start) / perfFreq;
+
+  vrEmu6502Destroy(cpu);
+  return run / seconds;
+}
+
+static double coreBenchmarkCpu65xx(Cpu65xxModel model, bool threaded, uint64_t cycles)
+{
+  coreBenchmarkInit();
+  Cpu65xx* cpu = cpu65xxNew(model, benchRead, benchWrite, benchReadPages, benchWritePages);
+  cpu65xxReset(cpu);
+
+  uint64_t run = 0;
+  Uint64 start = SDL_GetPerformanceCounter();
+  while (run < cycles) run += threaded ? cpu65xxRunBlock(cpu, 1000) : cpu65xxInstCycle(cpu);
+  double seconds = (double)(SDL_GetPerformanceCounter() - start) / perfFreq;
+
+  cpu65xxDestroy(cpu);
+  return run / seconds;
+}
+
+static void coreBenchmark()
+{
+  const uint64_t cycles = 400000000ull;
+  double vrEmuHz = coreBenchmarkVrEmu(cycles);
+
+  printf("Core benchmark: copy/add/compare/delay loop, %llu cycles on flat memory\n", (unsigned long long)cycles);
+  printf("  vrEmu6502 W65C02       : %8.2f MHz\n", vrEmuHz / 1000000.0);
+
+  static const struct { Cpu65xxModel model; const char* name; } models[] = {
+    { CPU65XX_W65C02, "W65C02" },
+    { CPU65XX_65C02, "65C02" },
+    { CPU65XX_6502, "6502" },
+    { CPU65XX_6502_NO_BCD, "6502 no BCD" }
+  };
+  for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); ++i)
+  {
+    double interpHz = coreBenchmarkCpu65xx(models[i].model, false, cycles);
+    double threadedHz = coreBenchmarkCpu65xx(models[i].model, true, cycles);
+    printf("  %-11s interp     : %8.2f MHz (%.2fx)\n", models[i].name, interpHz / 1000000.0, interpHz / vrEmuHz);
+    printf("  %-11s threaded   : %8.2f MHz (%.2fx)\n", models[i].name, threadedHz / 1000000.0, threadedHz / vrEmuHz);
+  }
+}
 
+/* create the window, renderer and ImGui context */
+static int initGui()
+{
   int window_flags = 0;
   window_flags |= SDL_WINDOW_RESIZABLE;
   window = SDL_CreateWindow("DB6502 Emulator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1600, 900, (SDL_WindowFlags)window_flags);
@@ -1051,18 +2664,183 @@ int main(int argc, char* argv[])
   ImGui_ImplSDL2_InitForSDLRenderer(window, renderer);
   ImGui_ImplSDLRenderer2_Init(renderer);
 
-  perfFreq = (double)SDL_GetPerformanceFrequency();
+  vdpSurface = SDL_CreateRGBSurfaceWithFormat(0, VDP_FRAME_WIDTH, VDP_FRAME_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+  vdpRenderer = vdpSurface ? SDL_CreateSoftwareRenderer(vdpSurface) : NULL;
+  vdpTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, VDP_FRAME_WIDTH, VDP_FRAME_HEIGHT);
+  if (vdpRenderer == NULL || vdpTexture == NULL)
+  {
+    SDL_Log("Error creating the VDP renderer: %s", SDL_GetError());
+    return 0;
+  }
 
-  SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO);
+  return 1;
+}
 
-  /* add the cpu device */
-  cpuDevice = hbc56AddDevice(create6502CpuDevice(debuggerIsBreakpoint, HBC56_CLOCK_FREQ));
+static void destroyGui()
+{
+  ImGui_ImplSDLRenderer2_Shutdown();
+  ImGui_ImplSDL2_Shutdown();
+  ImGui::DestroyContext();
+
+  SDL_DestroyTexture(vdpTexture);
+  SDL_DestroyRenderer(vdpRenderer);
+  SDL_FreeSurface(vdpSurface);
+  SDL_DestroyRenderer(renderer);
+  SDL_DestroyWindow(window);
+}
+
+
+/* scheduler next event functions for the shared HBC-56 devices */
+#define FRAME_CYCLES    (clockFreq / 60)
+#define KB_POLL_CYCLES  (clockFreq / 1000)
+
+#define VIA_REG_T1CL    0x04
+#define VIA_REG_T1CH    0x05
+#define VIA_REG_T2CL    0x08
+#define VIA_REG_T2CH    0x09
+#define VIA_REG_ACR     0x0b
+#define VIA_REG_IER     0x0e
+#define VIA_ACR_T2_PULSE_COUNT 0x20
+#define VIA_INT_T1      0x40
+#define VIA_INT_T2      0x20
+
+/* VDP and PSG: frame boundaries. register accesses bring them up to date
+ * first, so status reads and mid-frame PSG writes still see the right cycle */
+static uint64_t frameNextEvent(HBC56Device*, uint64_t currentCycle)
+{
+  return (currentCycle / FRAME_CYCLES + 1) * FRAME_CYCLES;
+}
+
+/* keyboard: every 1ms, about as long as a PS/2 byte takes on the wire */
+static uint64_t kbNextEvent(HBC56Device*, uint64_t currentCycle)
+{
+  return currentCycle + KB_POLL_CYCLES;
+}
+
+/* VIA: the next underflow of a timer whose interrupt is enabled. other
+ * timer state is only visible through registers, and reads catch up */
+static uint64_t viaNextEvent(HBC56Device* device, uint64_t currentCycle)
+{
+  const BusMapping* mapping = busMapFind(device);
+  uint16_t base = mapping ? (uint16_t)mapping->startAddr : 0;
+
+  uint8_t lo = 0, hi = 0, ier = 0, acr = 0;
+  readDevice(device, base + VIA_REG_IER, &ier, true);
+  readDevice(device, base + VIA_REG_ACR, &acr, true);
+
+  uint64_t next = HBC56_NEVER;
+
+  /* the flag is set the cycle after the counter passes zero */
+  if (ier & VIA_INT_T1)
+  {
+    readDevice(device, base + VIA_REG_T1CL, &lo, true);
+    readDevice(device, base + VIA_REG_T1CH, &hi, true);
+    next = currentCycle + ((hi << 8) | lo) + 1;
+  }
+
+  /* T2 doesn't count cycles in pulse counting mode */
+  if ((ier & VIA_INT_T2) && !(acr & VIA_ACR_T2_PULSE_COUNT))
+  {
+    readDevice(device, base + VIA_REG_T2CL, &lo, true);
+    readDevice(device, base + VIA_REG_T2CH, &hi, true);
+    uint64_t t2 = currentCycle + ((hi << 8) | lo) + 1;
+    if (t2 < next) next = t2;
+  }
+
+  return next;
+}
+
+
+/* headless mode: stdin is read on its own thread and fed to the ACIA through
+ * the paste queue, so it gets the same BIOS buffer flow control as Ctrl+V */
+static int stdinReaderThread(void*)
+{
+  int c;
+  while ((c = fgetc(stdin)) != EOF)
+  {
+    uint8_t byte = (uint8_t)c;
+    if (c == '\n') byte = '\r'; /* convert LF to CR for BASIC */
+
+    while (!aciaPasteQueue.push(byte))
+    {
+      SDL_Delay(1);
+    }
+  }
+  return 0;
+}
+
+/* run the emulator with no window, as fast as the host allows. stops after
+ * maxCycles emulated cycles (0 = no limit) or on SIGINT/SIGTERM */
+static void runHeadless(uint64_t maxCycles)
+{
+  const uint64_t cyclesPerPoll = clockFreq / 10;
+
+  uint64_t startCycles = emulatedCycles;
+  uint64_t startIdleCycles = getCpuIdleCycles(cpuDevice);
+  Uint64 startTime = SDL_GetPerformanceCounter();
+
+  if (aciaDevice)
+  {
+    aciaDeviceSetTxStream(aciaDevice, stdout);
+    SDL_DetachThread(SDL_CreateThread(stdinReaderThread, "stdin", NULL));
+  }
+
+  while (!done)
+  {
+    uint64_t runFor = cyclesPerPoll;
+    if (maxCycles)
+    {
+      uint64_t cycles = emulatedCycles - startCycles;
+      if (cycles >= maxCycles) break;
+      if (maxCycles - cycles < runFor) runFor = maxCycles - cycles;
+    }
+
+    runCycles(runFor);
+
+    fflush(stdout);
+
+    /* with no debugger to continue from, a break ends the run */
+    if (getDebug6502State(cpuDevice) == CPU_BREAK)
+    {
+      const char* lastHit = bpLastHit();
+      fprintf(stderr, "\nStopped at $%04X: %s\n", get6502InstructionPC(cpuDevice), lastHit[0] ? lastHit : "in the debugger");
+      if (!runToReported)
+      {
+        fprintf(stderr, "Run to took %llu cycles\n", (unsigned long long)get6502RunToCycles(cpuDevice));
+      }
+      break;
+    }
+
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+      if (event.type == SDL_QUIT) done = 1;
+    }
+  }
+
+  uint64_t cycles = emulatedCycles - startCycles;
+  double seconds = (double)(SDL_GetPerformanceCounter() - startTime) / perfFreq;
+  fprintf(stderr, "\nEmulated %llu cycles in %.3f s (%.2f MHz, %.1f%% skipped idle)\n",
+    (unsigned long long)cycles, seconds, cycles / seconds / 1000000.0,
+    cycles ? 100.0 * (getCpuIdleCycles(cpuDevice) - startIdleCycles) / cycles : 0.0);
+  printFusionStats(stderr);
+  hlePrintStats(stderr);
+  bpPrintStats(stderr);
+  irqStatsPrint(stderr);
+}
 
-  /* initialise the debugger */
-  debuggerInit(getCpuDevice(cpuDevice));
 
+int main(int argc, char* argv[])
+{
   int doBreak = 0;
+  int benchmark = 0;
+  int idleSkip = 1;
+  HBC56CpuCore cpuCore = CPU_CORE_THREADED;
+  uint64_t maxCycles = 0;
   const char* romFile = NULL;
+  std::vector<const char*> breakSpecs;
+  std::vector<const char*> hleCosts;
+  int32_t runToAddr = -1;
 
   /* parse arguments (defer ROM loading until after device setup) */
   for (int i = 1; i < argc;)
@@ -1084,62 +2862,280 @@ int main(int argc, char* argv[])
         consumed = 1;
         doBreak = 1;
       }
+      else if (SDL_strcasecmp(argv[i], "--bench") == 0)
+      {
+        consumed = 1;
+        benchmark = 1;
+        headless = 1;
+      }
+      else if (SDL_strcasecmp(argv[i], "--turbo") == 0)
+      {
+        consumed = 1;
+        turbo = true;
+      }
+      else if (SDL_strcasecmp(argv[i], "--clock") == 0)
+      {
+        /* Hz, or with a k or M suffix */
+        if (argv[i + 1])
+        {
+          char* end = NULL;
+          double hz = SDL_strtod(argv[i + 1], &end);
+          if (*end == 'k' || *end == 'K') hz *= 1000.0;
+          else if (*end == 'm' || *end == 'M') hz *= 1000000.0;
+          if (hz >= CLOCK_FREQ_MIN && hz <= CLOCK_FREQ_MAX)
+          {
+            consumed = 1;
+            clockFreq = (uint32_t)hz;
+            ++i;
+          }
+        }
+      }
+      else if (SDL_strcasecmp(argv[i], "--pace") == 0)
+      {
+        /* realtime, <n>x or unlimited */
+        const char* pace = argv[i + 1];
+        if (pace && SDL_strcasecmp(pace, "realtime") == 0)
+        {
+          consumed = 1;
+          paceMultiple = 1;
+        }
+        else if (pace && SDL_strcasecmp(pace, "unlimited") == 0)
+        {
+          consumed = 1;
+          turbo = true;
+        }
+        else if (pace)
+        {
+          char* end = NULL;
+          unsigned long multiple = SDL_strtoul(pace, &end, 10);
+          if ((*end == 'x' || *end == 'X') && !end[1] && multiple >= 1 && multiple <= PACE_MULTIPLE_MAX)
+          {
+            consumed = 1;
+            paceMultiple = (uint32_t)multiple;
+          }
+        }
+        if (consumed > 0) ++i;
+      }
+      else if (SDL_strcasecmp(argv[i], "--input-rate") == 0)
+      {
+        /* host input polls per second */
+        if (argv[i + 1])
+        {
+          uint32_t rate = (uint32_t)SDL_strtoul(argv[i + 1], NULL, 10);
+          if (rate >= INPUT_RATE_MIN && rate <= INPUT_RATE_MAX)
+          {
+            consumed = 1;
+            inputRate = rate;
+            ++i;
+          }
+        }
+      }
+      else if (SDL_strcasecmp(argv[i], "--no-idle-skip") == 0)
+      {
+        consumed = 1;
+        idleSkip = 0;
+      }
+      else if (SDL_strncasecmp(argv[i], "--cpu=", 6) == 0)
+      {
+        const char* core = argv[i] + 6;
+        if (SDL_strcasecmp(core, "interp") == 0)
+        {
+          consumed = 1;
+          cpuCore = CPU_CORE_INTERP;
+        }
+        else if (SDL_strcasecmp(core, "threaded") == 0)
+        {
+          consumed = 1;
+          cpuCore = CPU_CORE_THREADED;
+        }
+        else if (SDL_strcasecmp(core, "jit") == 0)
+        {
+          /* no host code generator (yet). threaded blocks are the fastest core */
+          fprintf(stderr, "--cpu=jit is not available, using --cpu=threaded\n");
+          consumed = 1;
+          cpuCore = CPU_CORE_THREADED;
+        }
+      }
+      else if (SDL_strcasecmp(argv[i], "--hle") == 0)
+      {
+        consumed = 1;
+        hleEnabled = true;
+      }
+      else if (SDL_strcasecmp(argv[i], "--hle-cost") == 0)
+      {
+        /* <symbol>=<cycles>, set once the traps are registered */
+        if (argv[i + 1] && SDL_strchr(argv[i + 1], '='))
+        {
+          consumed = 1;
+          hleCosts.push_back(argv[++i]);
+        }
+      }
+      else if (SDL_strcasecmp(argv[i], "--break") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          breakSpecs.push_back(argv[++i]);
+        }
+      }
+      else if (SDL_strcasecmp(argv[i], "--run-to") == 0)
+      {
+        /* $hex, 0xhex or decimal */
+        if (argv[i + 1])
+        {
+          const char* addr = argv[++i];
+          consumed = 1;
+          runToAddr = (int32_t)((addr[0] == '$') ? SDL_strtoul(addr + 1, NULL, 16) : SDL_strtoul(addr, NULL, 0)) & 0xffff;
+        }
+      }
+      else if (SDL_strcasecmp(argv[i], "--headless") == 0)
+      {
+        consumed = 1;
+        headless = 1;
+      }
+      else if (SDL_strcasecmp(argv[i], "--cycles") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          maxCycles = SDL_strtoull(argv[++i], NULL, 0);
+        }
+      }
     }
     if (consumed < 0)
     {
       fprintf(stderr, "Unknown argument: '%s'\n", argv[i]);
-      fprintf(stderr, "Usage: Db6502Emu [--rom <romfile>] [--brk]\n");
+      fprintf(stderr, "Usage: Db6502Emu [--rom <romfile>] [--brk] [--turbo] [--clock <hz>] [--pace realtime|<n>x|unlimited] [--input-rate <hz>] [--no-idle-skip] [--cpu=interp|threaded] [--hle] [--hle-cost <symbol>=<cycles>] [--break <spec>] [--run-to <addr>] [--bench] [--headless] [--cycles <count>]\n");
       return 2;
     }
     i += consumed;
   }
 
+  Uint32 sdlFlags = headless ? (SDL_INIT_TIMER | SDL_INIT_EVENTS) : (SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER);
+  if (SDL_Init(sdlFlags) != 0)
+  {
+    printf("Error: %s\n", SDL_GetError());
+    return -1;
+  }
+
+  if (!headless && !initGui())
+  {
+    return 0;
+  }
+
+  perfFreq = (double)SDL_GetPerformanceFrequency();
+
+  SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO);
+
+  /* add the cpu device. it drives the emulated clock rather than being scheduled */
+  cpuDevice = hbc56AddDevice(create6502CpuDevice(clockFreq, HBC56_CPU_MODEL));
+  schedClockedByCpu(cpuDevice);
+  set6502CpuCore(cpuDevice, cpuCore);
+  if (idleSkip) set6502IdleDetection(cpuDevice, busSteadyRead);
+  hleInit(cpuDevice);
+  for (const char* cost : hleCosts)
+  {
+    const char* eq = SDL_strchr(cost, '=');
+    std::string name(cost, eq - cost);
+    if (!hleSetTrapCost(name.c_str(), (uint32_t)SDL_strtoul(eq + 1, NULL, 0)))
+    {
+      fprintf(stderr, "--hle-cost '%s': no trap named %s\n", cost, name.c_str());
+      return 2;
+    }
+  }
+  irqStatsInit(cpuDevice);
+  bpInit(cpuDevice);
+  for (const char* spec : breakSpecs)
+  {
+    char error[128];
+    if (bpAdd(spec, error, sizeof(error)) < 0)
+    {
+      fprintf(stderr, "--break '%s': %s\n", spec, error);
+      return 2;
+    }
+  }
+
+  /* initialise the debugger */
+  debuggerInit(getCpuDevice(cpuDevice));
+
   srand((unsigned int)time(NULL));
 
   /* === DB6502 Device Setup === */
-  /* Order matters: first device to claim an address wins on read/write */
+  /* Each device is mapped into the address decoder as it is added. I/O devices
+   * are mapped at a higher priority than memory so they shadow the ROM.
+   * Devices that can predict their next event are given to the scheduler */
 
   /* 1. RAM: $0000-$7FFF (32KB) */
-  hbc56AddDevice(createRamDevice(HBC56_RAM_START, HBC56_RAM_END));
+  HBC56Device* ramDevice = hbc56AddDevice(createDirectRamDevice(HBC56_RAM_START, HBC56_RAM_END));
+  hbc56MapMemory(ramDevice, HBC56_RAM_START, HBC56_RAM_END, HBC56_BUS_PRIORITY_MEMORY,
+    directMemoryDeviceData(ramDevice), true);
 
-  /* 2. TMS9918A VDP: $8200 (data), $8201 (register) */
+  /* 2. TMS9918A VDP: $8200 (data), $8201 (register). It draws on the core's
+   *    software renderer (none when headless) */
 #if HBC56_HAVE_TMS9918
   HBC56Device* tms9918Device = hbc56AddDevice(createTms9918Device(
-    HBC56_TMS9918_DAT_ADDR, HBC56_TMS9918_REG_ADDR, HBC56_TMS9918_IRQ, renderer));
+    HBC56_TMS9918_DAT_ADDR, HBC56_TMS9918_REG_ADDR, HBC56_TMS9918_IRQ, vdpRenderer));
+  vdpDevice = tms9918Device;
+  hbc56MapDevice(tms9918Device, HBC56_TMS9918_DAT_ADDR, HBC56_TMS9918_DAT_ADDR + HBC56_TMS9918_SIZE, HBC56_BUS_PRIORITY_IO);
+  hbc56ScheduleDevice(tms9918Device, frameNextEvent);
+  schedWakesCore(tms9918Device, HBC56_TMS9918_IRQ != 0);
+  irqStatsNameSource(HBC56_TMS9918_IRQ, "VDP");
   debuggerInitTms(tms9918Device);
 #endif
 
-  /* 3. AY-3-8910 PSG: $8300 */
-  hbc56Audio(1);
+  /* 3. AY-3-8910 PSG: $8300. No audio output when headless */
+  if (!headless) hbc56Audio(1);
 #if HBC56_HAVE_AY_3_8910
-  hbc56AddDevice(createAY38910Device(HBC56_AY38910_A_ADDR, HBC56_AY38910_CLOCK,
-    hbc56AudioFreq(), hbc56AudioChannels()));
+  HBC56Device* ayDevice = hbc56AddDevice(createAY38910Device(HBC56_AY38910_A_ADDR, HBC56_AY38910_CLOCK,
+    headless ? HBC56_AUDIO_FREQ : hbc56AudioFreq(), headless ? 2 : hbc56AudioChannels()));
+  hbc56MapDevice(ayDevice, HBC56_AY38910_A_ADDR, HBC56_AY38910_A_ADDR + HBC56_AY38910_SIZE, HBC56_BUS_PRIORITY_IO);
+  hbc56ScheduleDevice(ayDevice, frameNextEvent);
+  schedWakesCore(ayDevice, !headless);
 #endif
 
   /* 4. 65C51 ACIA: $8400-$8403 */
 #if HBC56_HAVE_ACIA
   aciaDevice = hbc56AddDevice(createAciaDevice(HBC56_ACIA_ADDR, HBC56_ACIA_IRQ));
+  hbc56MapDevice(aciaDevice, HBC56_ACIA_ADDR, HBC56_ACIA_ADDR + HBC56_ACIA_SIZE, HBC56_BUS_PRIORITY_IO);
+  hbc56ScheduleDevice(aciaDevice, aciaDeviceNextEvent);
+  schedSteadyReads(aciaDevice);
+  schedWakesCore(aciaDevice, HBC56_ACIA_IRQ != 0);
+  irqStatsNameSource(HBC56_ACIA_IRQ, "ACIA");
 #endif
 
   /* 5. VIA2 (65C22): $8800 */
 #if HBC56_HAVE_VIA2
   HBC56Device *via2Device = hbc56AddDevice(create65C22ViaDevice(HBC56_VIA2_ADDR, HBC56_VIA2_IRQ));
-  (void)via2Device;
+  hbc56MapDevice(via2Device, HBC56_VIA2_ADDR, HBC56_VIA2_ADDR + HBC56_VIA2_SIZE, HBC56_BUS_PRIORITY_IO);
+  hbc56ScheduleDevice(via2Device, viaNextEvent);
+  schedWakesCore(via2Device, HBC56_VIA2_IRQ != 0);
+  irqStatsNameSource(HBC56_VIA2_IRQ, "VIA2");
 #endif
 
-  /* 6. VIA1 (65C22): $9000 - synced to CPU */
+  /* 6. VIA1 (65C22): $9000 */
 #if HBC56_HAVE_VIA
   HBC56Device *viaDevice = hbc56AddDevice(create65C22ViaDevice(HBC56_VIA_ADDR, HBC56_VIA_IRQ));
+  hbc56MapDevice(viaDevice, HBC56_VIA_ADDR, HBC56_VIA_ADDR + HBC56_VIA_SIZE, HBC56_BUS_PRIORITY_IO);
+  hbc56ScheduleDevice(viaDevice, viaNextEvent);
+  schedWakesCore(viaDevice, HBC56_VIA_IRQ != 0);
+  irqStatsNameSource(HBC56_VIA_IRQ, "VIA1");
   debuggerInitVia(viaDevice);
-  sync6502CpuDevice(cpuDevice, viaDevice);
 #endif
 
-  /* 7. Keyboard: on VIA1 port A */
+  /* 7. Keyboard: on VIA1 port A. VIA1 owns $9000-$900F, so the keyboard
+   *    device isn't on the bus. its codes show through the VIA (kbport.c) */
 #if HBC56_HAVE_KB
+#if !HBC56_HAVE_VIA
+#error "the PS/2 keyboard is read through VIA1 (HBC56_HAVE_VIA)"
+#endif
   kbDevice = hbc56AddDevice(createKeyboardDevice(HBC56_KB_ADDR, HBC56_KB_IRQ));
+  kbPortInit(kbDevice, HBC56_KB_ADDR, viaDevice, HBC56_VIA_ADDR);
+  hbc56ScheduleDevice(kbDevice, kbNextEvent);
+  schedWakesCore(kbDevice, HBC56_KB_IRQ != 0);
+  irqStatsNameSource(HBC56_KB_IRQ, "Keyboard");
 #endif
 
-  /* 8. ROM: $8000-$FFFF (32KB) - loaded LAST so I/O devices take priority */
+  /* 8. ROM: $8000-$FFFF (32KB) - mapped at memory priority beneath the I/O devices */
   int romLoaded = 0;
   if (!romFile)
   {
@@ -1148,6 +3144,8 @@ int main(int argc, char* argv[])
   }
   romLoaded = loadRom(romFile);
 
+  int status = 0;
+
   if (romLoaded == 0)
   {
     fileOpen = true;
@@ -1155,15 +3153,56 @@ int main(int argc, char* argv[])
 
   done = 0;
 
+  if (headless && romLoaded != 1)
+  {
+    status = 2;
+    done = 1;
+  }
+  else if (benchmark)
+  {
+    busBenchmark();
+    coreBenchmark();
+    cpuBenchmark();
+    done = 1;
+  }
+
   hbc56Reset();
 
   if (doBreak) hbc56DebugBreak();
+  else if (runToAddr >= 0) hbc56DebugRunTo((uint16_t)runToAddr);
 
-  SDL_Delay(100);
-
-  while (!done)
+  if (headless)
   {
-    loop();
+    if (!done) runHeadless(maxCycles);
+  }
+  else
+  {
+    SDL_Delay(100);
+
+#if HBC56_HAVE_THREADS
+    coreMutex = SDL_CreateMutex();
+    wakeMutex = SDL_CreateMutex();
+    wakeCond = SDL_CreateCond();
+    SDL_AtomicSet(&coreRunning, 1);
+    SDL_Thread* coreThread = SDL_CreateThread(emulationThread, "emulation", NULL);
+#endif
+
+    while (!done)
+    {
+      loop();
+    }
+
+#if HBC56_HAVE_THREADS
+    SDL_AtomicSet(&coreRunning, 0);
+    coreWake();
+    SDL_WaitThread(coreThread, NULL);
+    SDL_DestroyCond(wakeCond);
+    SDL_DestroyMutex(wakeMutex);
+    SDL_DestroyMutex(coreMutex);
+    wakeCond = NULL;
+    wakeMutex = NULL;
+    coreMutex = NULL;
+#endif
   }
 
   /* clean up */
@@ -1172,18 +3211,14 @@ int main(int argc, char* argv[])
     destroyDevice(&devices[i]);
   }
 
-  hbc56Audio(0);
-  SDL_AudioQuit();
-
-  ImGui_ImplSDLRenderer2_Shutdown();
-  ImGui_ImplSDL2_Shutdown();
-  ImGui::DestroyContext();
+  if (!headless)
+  {
+    hbc56Audio(0);
+    SDL_AudioQuit();
 
-  SDL_DestroyRenderer(renderer);
-  SDL_DestroyWindow(window);
+    destroyGui();
+  }
   SDL_Quit();
 
-  SDL_DestroyMutex(kbQueueMutex);
-
-  return 0;
+  return status;
 }
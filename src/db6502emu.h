@@ -14,8 +14,28 @@
 #include "config.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+/* address decoder priorities - a higher priority device shadows any lower
+ * priority device mapped at the same address. Equal priorities resolve to
+ * the device that was added first. */
+#define HBC56_BUS_PRIORITY_MEMORY   0
+#define HBC56_BUS_PRIORITY_IO       1
+
+/* device scheduler - a device's next event function returns the emulated
+ * cycle it next needs ticking at, or HBC56_NEVER */
+#define HBC56_NEVER                 UINT64_MAX
+
+typedef uint64_t (*HBC56NextEventFn)(HBC56Device *device, uint64_t currentCycle);
+
+/* watchpoints - accesses to a watched page take the device path and are
+ * passed to the watch handler, which returns non-zero to break */
+#define HBC56_WATCH_READ            0x01
+#define HBC56_WATCH_WRITE           0x02
+
+typedef int (*HBC56WatchFn)(uint16_t addr, uint8_t val, bool write);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,6 +44,9 @@ void hbc56Reset();
 int hbc56NumDevices();
 HBC56Device *hbc56Device(size_t deviceNum);
 HBC56Device *hbc56AddDevice(HBC56Device device);
+void hbc56MapDevice(HBC56Device *device, uint32_t startAddr, uint32_t endAddr, uint8_t priority);
+void hbc56MapMemory(HBC56Device *device, uint32_t startAddr, uint32_t endAddr, uint8_t priority, uint8_t *memory, bool writable);
+void hbc56ScheduleDevice(HBC56Device *device, HBC56NextEventFn nextEventFn);
 void hbc56Interrupt(uint8_t irq, HBC56InterruptSignal signal);
 int hbc56LoadRom(const uint8_t *romData, int romDataSize);
 void hbc56LoadLabels(const char* labelFileContents);
@@ -37,10 +60,17 @@ void hbc56DebugRun();
 void hbc56DebugStepInto();
 void hbc56DebugStepOver();
 void hbc56DebugStepOut();
+void hbc56DebugRunTo(uint16_t addr);
 double hbc56CpuRuntimeSeconds();
+void hbc56SetClockFreq(uint32_t hz);
+uint32_t hbc56ClockFreq();
 void hbc56DebugBreakOnInt();
 uint8_t hbc56MemRead(uint16_t addr, bool dbg);
 void hbc56MemWrite(uint16_t addr, uint8_t val);
+const uint8_t * const *hbc56MemReadPages();
+uint8_t * const *hbc56MemWritePages();
+void hbc56SetWatchHandler(HBC56WatchFn watch);
+void hbc56WatchPage(uint8_t page, uint8_t access);
 
 #ifdef __cplusplus
 }
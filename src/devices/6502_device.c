@@ -0,0 +1,839 @@
+/*
+ * DB6502 Emulator - 65C02 CPU device
+ *
+ * Based on Troy Schrapel's HBC-56 Emulator (MIT License)
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ * Runs the DB6502 65C02 core (cpu/cpu65xx) one instruction at a time
+ * against the emulated clock. A tick runs the CPU until it has used the
+ * requested number of cycles (finishing the instruction in progress), so any
+ * overshoot is carried into the next tick rather than lost.
+ *
+ * The core reports the cycle of each device access within its instruction,
+ * so devices can catch up to exactly that cycle. With CPU_CORE_THREADED hot
+ * code runs as translated blocks instead (cpu65xxRunBlock()), which end
+ * before breakpoints and after device accesses. A vrEmu6502 instance is
+ * kept for the HBC-56 debugger, which only knows that API: the registers are
+ * copied into it at the end of every tick.
+ *
+ * A guest waiting for input spins in a short loop that only reads. Once a
+ * pass of such a loop leaves everything as it was, every further pass will
+ * too until a device event changes what it reads, so the CPU skips straight
+ * to the end of the tick (the scheduler ends ticks at the next event).
+ * WAI and STP are skipped the same way until an interrupt (or reset).
+ */
+
+#include "devices/6502_device.h"
+#include "hbc56emu.h"
+
+#include "cpu/cpu65xx.h"
+#include "vrEmu6502.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STATUS_FLAG_I   0x04
+
+#define UTILIZATION_PERIOD  0.25  /* emulated seconds */
+
+#define IDLE_LOOP_MAX_BYTES   32    /* backward jump distance */
+#define IDLE_LOOP_MAX_CYCLES  256   /* one pass, including any subroutines */
+#define IDLE_LOOP_REGS        5     /* A, X, Y, SP, P */
+#define IDLE_LOOP_REG_SP      3
+
+#define OPCODE_JSR      0x20
+#define OPCODE_RTI      0x40
+#define OPCODE_JMP      0x4c
+#define OPCODE_RTS      0x60
+#define OPCODE_BRA      0x80
+#define OPCODE_WAI      0xcb
+#define OPCODE_STP      0xdb
+
+/* Forward declarations */
+static void resetCpuDevice(HBC56Device*);
+static void destroyCpuDevice(HBC56Device*);
+static void tickCpuDevice(HBC56Device*, uint32_t, float);
+
+struct CPU6502Device
+{
+  Cpu65xx*            cpu;
+  VrEmu6502*          cpu6502;          /* register mirror for the debugger */
+  HBC56CpuRegs        mirrored;         /* the mirror as last loaded, to spot edits */
+  HBC56CpuState       currentState;
+  HBC56Device*        syncedDevice;
+  HBC56CpuCore        core;
+  uint32_t            clockFreq;
+  double              secondsPerCycle;
+
+  /* emulated time up to the last clock change, and the cycle it was at */
+  double              clockSeconds;
+  uint64_t            clockCycles;
+
+  /* emulated clock. cycles is where the current instruction started */
+  uint64_t            cycles;
+  int                 stopRequested;
+
+  /* step over, step out and run to: run at full speed until the CPU gets
+   * to runToAddr (a temporary breakpoint) or, with runToReturn, returns
+   * from a subroutine. either only counts with the stack pointer at or
+   * above runToSp (the sentinel), so recursive calls don't stop it */
+  int                 runTo;
+  int32_t             runToAddr;        /* -1 for none */
+  int32_t             runToSp;
+  int                 runToReturn;
+  uint64_t            runToStart;
+  uint64_t            runToCycles;      /* how long the last one took */
+
+  /* idle loop detection. loopDirty (or a write the core saw) is set by
+   * anything during a pass that could make the next pass behave differently */
+  HBC56SteadyReadFn   steadyRead;
+  uint16_t            loopHead;
+  uint8_t             loopRegs[IDLE_LOOP_REGS];
+  int                 loopDirty;
+  uint64_t            loopStartCycle;
+  uint64_t            idleCycles;
+  int                 idle;             /* the last tick ended idle */
+
+  /* breakpoints: one bit per address, tested only if there are any.
+   * armedMap is both maps combined. a conditional breakpoint only stops
+   * the CPU if breakCond agrees */
+  uint8_t             breakpointMap[0x10000 / 8];
+  uint8_t             condBreakMap[0x10000 / 8];
+  uint8_t             armedMap[0x10000 / 8];
+  int                 anyBreakpoints;
+  HBC56BreakCondFn    breakCond;
+
+  /* high-level emulation traps: one bit per address */
+  HBC56TrapFn         trap;
+  uint8_t             trapMap[0x10000 / 8];
+  int                 trapCount;
+
+  /* host time per emulated time */
+  float               utilization;
+  double              utilHostSeconds;
+  uint64_t            utilCycles;
+  double              perfFreq;
+};
+typedef struct CPU6502Device CPU6502Device;
+
+/* the core's memory callbacks carry no context. there is only one CPU */
+static CPU6502Device* busCpu = NULL;
+
+
+static CPU6502Device* getCpu6502Device(HBC56Device* device)
+{
+  if (!device || device->resetFn != &resetCpuDevice) return NULL;
+  return (CPU6502Device*)device->data;
+}
+
+/* the core reads and writes memory pages itself. only device accesses
+ * get here */
+static uint8_t cpuMemRead(uint16_t addr, bool dbg)
+{
+  uint8_t val = hbc56MemRead(addr, dbg);
+
+  if (busCpu->steadyRead && !busCpu->steadyRead(addr))
+  {
+    busCpu->loopDirty = 1;
+  }
+  return val;
+}
+
+static void cpuMemWrite(uint16_t addr, uint8_t val)
+{
+  hbc56MemWrite(addr, val);
+}
+
+static int isTrap(CPU6502Device* cpuDevice, uint16_t addr)
+{
+  return cpuDevice->trapMap[addr >> 3] & (1 << (addr & 7));
+}
+
+static int isBreakpoint(CPU6502Device* cpuDevice, uint16_t addr)
+{
+  return cpuDevice->anyBreakpoints && (cpuDevice->armedMap[addr >> 3] & (1 << (addr & 7)));
+}
+
+static void getRegisters(CPU6502Device* cpuDevice, HBC56CpuRegs* regs)
+{
+  Cpu65xx* cpu = cpuDevice->cpu;
+  regs->pc = cpu65xxGetPC(cpu);
+  regs->a = cpu65xxGetAcc(cpu);
+  regs->x = cpu65xxGetX(cpu);
+  regs->y = cpu65xxGetY(cpu);
+  regs->sp = cpu65xxGetStackPointer(cpu);
+  regs->p = cpu65xxGetStatus(cpu);
+}
+
+/* the CPU has reached an armed address. only a conditional breakpoint
+ * needs asking */
+static int breakpointHit(CPU6502Device* cpuDevice, uint16_t addr)
+{
+  if (cpuDevice->breakpointMap[addr >> 3] & (1 << (addr & 7))) return 1;
+  if (!(cpuDevice->condBreakMap[addr >> 3] & (1 << (addr & 7))) || !cpuDevice->breakCond) return 0;
+
+  HBC56CpuRegs regs;
+  getRegisters(cpuDevice, &regs);
+  return cpuDevice->breakCond(addr, &regs);
+}
+
+/* combine the unconditional and conditional maps and the run to address
+ * after any of them changed */
+static void updateArmedMap(CPU6502Device* cpuDevice)
+{
+  cpuDevice->anyBreakpoints = 0;
+  for (size_t i = 0; i < sizeof(cpuDevice->armedMap); ++i)
+  {
+    cpuDevice->armedMap[i] = cpuDevice->breakpointMap[i] | cpuDevice->condBreakMap[i];
+    if (cpuDevice->armedMap[i]) cpuDevice->anyBreakpoints = 1;
+  }
+
+  if (cpuDevice->runTo && cpuDevice->runToAddr >= 0)
+  {
+    cpuDevice->armedMap[cpuDevice->runToAddr >> 3] |= 1 << (cpuDevice->runToAddr & 7);
+    cpuDevice->anyBreakpoints = 1;
+  }
+
+  /* translated blocks may run through the new breakpoints */
+  cpu65xxInvalidateBlocks(cpuDevice->cpu);
+}
+
+/* start a full speed run. addr is a temporary breakpoint (or -1), minSp
+ * the stack sentinel, and onReturn also stops at an RTS or RTI */
+static void startRunTo(CPU6502Device* cpuDevice, int32_t addr, int32_t minSp, int onReturn)
+{
+  cpuDevice->runTo = 1;
+  cpuDevice->runToAddr = addr;
+  cpuDevice->runToSp = minSp;
+  cpuDevice->runToReturn = onReturn;
+  cpuDevice->runToStart = cpuDevice->cycles;
+  updateArmedMap(cpuDevice);
+}
+
+/* the run stopped, wherever that was */
+static void endRunTo(CPU6502Device* cpuDevice)
+{
+  cpuDevice->runTo = 0;
+  cpuDevice->runToCycles = cpuDevice->cycles - cpuDevice->runToStart;
+  updateArmedMap(cpuDevice);
+}
+
+/* called after each instruction or block. blocks end at the temporary
+ * breakpoint and at every RTS and RTI, so one check per run is enough.
+ * after a trap the opcode is still the last instruction's */
+static int runToDone(CPU6502Device* cpuDevice, uint16_t pc, int trapped)
+{
+  Cpu65xx* cpu = cpuDevice->cpu;
+  if (cpu65xxGetStackPointer(cpu) < cpuDevice->runToSp) return 0;
+  if (pc == cpuDevice->runToAddr) return 1;
+  if (!cpuDevice->runToReturn || trapped) return 0;
+
+  /* an interrupt taken instead reads as opcode $00 */
+  uint8_t opcode = cpu65xxGetCurrentOpcode(cpu);
+  return opcode == OPCODE_RTS || opcode == OPCODE_RTI;
+}
+
+/* blocks must stop at breakpoints, or the debugger would miss them, and
+ * at traps. both are only checked between runs */
+static bool cpuBlockEnd(uint16_t addr)
+{
+  return isTrap(busCpu, addr) || isBreakpoint(busCpu, addr);
+}
+
+static void getMirror(VrEmu6502* mirror, HBC56CpuRegs* regs)
+{
+  regs->pc = vrEmu6502GetPC(mirror);
+  regs->a = vrEmu6502GetAcc(mirror);
+  regs->x = vrEmu6502GetX(mirror);
+  regs->y = vrEmu6502GetY(mirror);
+  regs->sp = vrEmu6502GetStackPointer(mirror);
+  regs->p = vrEmu6502GetStatus(mirror);
+}
+
+static int sameRegisters(const HBC56CpuRegs* a, const HBC56CpuRegs* b)
+{
+  return a->pc == b->pc && a->a == b->a && a->x == b->x && a->y == b->y && a->sp == b->sp && a->p == b->p;
+}
+
+/* the mirror belongs to the thread drawing the debugger views, which reads
+ * memory through it. debug reads, so it never disturbs the bus */
+static uint8_t mirrorMemRead(uint16_t addr, bool dbg)
+{
+  (void)dbg;
+  return hbc56MemRead(addr, true);
+}
+
+static void mirrorMemWrite(uint16_t addr, uint8_t val)
+{
+  hbc56MemWrite(addr, val);
+}
+
+/* the debugger disassembles with the mirror, so give it the same model */
+static vrEmu6502Model mirrorModel(Cpu65xxModel model)
+{
+  switch (model)
+  {
+    case CPU65XX_6502:
+    case CPU65XX_6502_NO_BCD: return CPU_6502;
+    case CPU65XX_65C02:       return CPU_65C02;
+    default:                  return CPU_W65C02;
+  }
+}
+
+HBC56Device create6502CpuDevice(uint32_t clockFreq, Cpu65xxModel model)
+{
+  HBC56Device device = createDevice(model == CPU65XX_6502 || model == CPU65XX_6502_NO_BCD ? "6502 CPU" : "65C02 CPU");
+  CPU6502Device* cpuDevice = (CPU6502Device*)calloc(1, sizeof(CPU6502Device));
+  if (cpuDevice)
+  {
+    busCpu = cpuDevice;
+    cpuDevice->cpu = cpu65xxNew(model, cpuMemRead, cpuMemWrite, hbc56MemReadPages(), hbc56MemWritePages());
+    cpu65xxSetBlockEnd(cpuDevice->cpu, cpuBlockEnd);
+    cpuDevice->cpu6502 = vrEmu6502New(mirrorModel(model), mirrorMemRead, mirrorMemWrite);
+    cpuDevice->currentState = CPU_RUNNING;
+    cpuDevice->clockFreq = clockFreq;
+    cpuDevice->secondsPerCycle = 1.0 / clockFreq;
+    cpuDevice->perfFreq = (double)SDL_GetPerformanceFrequency();
+
+    device.data = cpuDevice;
+    device.resetFn = &resetCpuDevice;
+    device.destroyFn = &destroyCpuDevice;
+    device.tickFn = &tickCpuDevice;
+  }
+  return device;
+}
+
+VrEmu6502* getCpuDevice(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->cpu6502 : NULL;
+}
+
+void set6502Mirror(HBC56Device* device, const HBC56CpuRegs* regs)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  VrEmu6502* mirror = cpuDevice->cpu6502;
+  vrEmu6502SetPC(mirror, regs->pc);
+  vrEmu6502SetAcc(mirror, regs->a);
+  vrEmu6502SetX(mirror, regs->x);
+  vrEmu6502SetY(mirror, regs->y);
+  vrEmu6502SetStackPointer(mirror, regs->sp);
+  vrEmu6502SetStatus(mirror, regs->p);
+  cpuDevice->mirrored = *regs;
+}
+
+int is6502MirrorEdited(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return 0;
+
+  HBC56CpuRegs regs;
+  getMirror(cpuDevice->cpu6502, &regs);
+  return !sameRegisters(&regs, &cpuDevice->mirrored);
+}
+
+/* only the registers edited go to the core. it may have run on since the
+ * mirror was loaded */
+void take6502MirrorEdits(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  Cpu65xx* cpu = cpuDevice->cpu;
+  HBC56CpuRegs regs;
+  getMirror(cpuDevice->cpu6502, &regs);
+  if (sameRegisters(&regs, &cpuDevice->mirrored)) return;
+
+  if (regs.pc != cpuDevice->mirrored.pc) cpu65xxSetPC(cpu, regs.pc);
+  if (regs.a != cpuDevice->mirrored.a) cpu65xxSetAcc(cpu, regs.a);
+  if (regs.x != cpuDevice->mirrored.x) cpu65xxSetX(cpu, regs.x);
+  if (regs.y != cpuDevice->mirrored.y) cpu65xxSetY(cpu, regs.y);
+  if (regs.sp != cpuDevice->mirrored.sp) cpu65xxSetStackPointer(cpu, regs.sp);
+  if (regs.p != cpuDevice->mirrored.p) cpu65xxSetStatus(cpu, regs.p);
+  cpuDevice->mirrored = regs;
+  cpuDevice->loopDirty = 1;
+}
+
+void interrupt6502(HBC56Device* device, HBC56InterruptType type, HBC56InterruptSignal signal)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  bool asserted = (signal != INTERRUPT_RELEASE);
+  if (type == INTERRUPT_NMI)
+  {
+    cpu65xxSetNmi(cpuDevice->cpu, asserted);
+  }
+  else
+  {
+    cpu65xxSetIrq(cpuDevice->cpu, asserted);
+  }
+  cpuDevice->loopDirty = 1;
+}
+
+void debug6502State(HBC56Device* device, HBC56CpuState state)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  /* a new state ends any run to in progress */
+  if (cpuDevice->runTo) endRunTo(cpuDevice);
+
+  /* the stack grows down, so returning from the level we started at
+   * leaves the stack pointer above it */
+  uint8_t sp = cpu65xxGetStackPointer(cpuDevice->cpu);
+  if (state == CPU_STEP_OVER)
+  {
+    /* only a JSR needs stepping over: run to the instruction after it, or
+     * the return from this level. anything else is a single step */
+    if (cpu65xxGetNextOpcode(cpuDevice->cpu) == OPCODE_JSR)
+    {
+      startRunTo(cpuDevice, (uint16_t)(cpu65xxGetPC(cpuDevice->cpu) + 3), sp, 1);
+    }
+    else
+    {
+      state = CPU_STEP_INTO;
+    }
+  }
+  else if (state == CPU_STEP_OUT)
+  {
+    startRunTo(cpuDevice, -1, sp + 1, 1);
+  }
+
+  cpuDevice->currentState = state;
+}
+
+void run6502To(HBC56Device* device, uint16_t addr)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  if (cpuDevice->runTo) endRunTo(cpuDevice);
+  startRunTo(cpuDevice, addr, 0, 0);
+  cpuDevice->currentState = CPU_RUN_TO;
+}
+
+int is6502RunningTo(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->runTo : 0;
+}
+
+uint64_t get6502RunToCycles(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->runToCycles : 0;
+}
+
+HBC56CpuState getDebug6502State(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->currentState : CPU_RUNNING;
+}
+
+float getCpuUtilization(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->utilization : 0.0f;
+}
+
+double getCpuRuntimeSeconds(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->clockSeconds + (cpuDevice->cycles - cpuDevice->clockCycles) * cpuDevice->secondsPerCycle : 0.0;
+}
+
+void set6502ClockFreq(HBC56Device* device, uint32_t clockFreq)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice || !clockFreq) return;
+
+  cpuDevice->clockSeconds = getCpuRuntimeSeconds(device);
+  cpuDevice->clockCycles = cpuDevice->cycles;
+  cpuDevice->clockFreq = clockFreq;
+  cpuDevice->secondsPerCycle = 1.0 / clockFreq;
+
+  /* utilization is per emulated second, so start measuring again */
+  cpuDevice->utilHostSeconds = 0.0;
+  cpuDevice->utilCycles = 0;
+}
+
+void sync6502CpuDevice(HBC56Device* device, HBC56Device* syncedDevice)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) cpuDevice->syncedDevice = syncedDevice;
+}
+
+void get6502Registers(HBC56Device* device, HBC56CpuRegs* regs)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) getRegisters(cpuDevice, regs);
+}
+
+uint16_t get6502InstructionPC(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpu65xxGetInstPC(cpuDevice->cpu) : 0;
+}
+
+uint64_t getCpuCycleCount(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->cycles + cpu65xxAccessCycle(cpuDevice->cpu) : 0;
+}
+
+void stop6502CpuRun(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) cpuDevice->stopRequested = 1;
+}
+
+void set6502IdleDetection(HBC56Device* device, HBC56SteadyReadFn steadyRead)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  cpuDevice->steadyRead = steadyRead;
+  cpuDevice->loopDirty = 1;
+}
+
+void invalidate6502CodeCache(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) cpu65xxInvalidateCode(cpuDevice->cpu);
+}
+
+void invalidate6502CodePage(HBC56Device* device, uint8_t page)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) cpu65xxInvalidatePage(cpuDevice->cpu, page);
+}
+
+void set6502CpuCore(HBC56Device* device, HBC56CpuCore core)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) cpuDevice->core = core;
+}
+
+void set6502Breakpoints(HBC56Device* device, const uint8_t* bitmap)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice || memcmp(cpuDevice->breakpointMap, bitmap, sizeof(cpuDevice->breakpointMap)) == 0) return;
+
+  memcpy(cpuDevice->breakpointMap, bitmap, sizeof(cpuDevice->breakpointMap));
+  updateArmedMap(cpuDevice);
+}
+
+void set6502BreakCondition(HBC56Device* device, HBC56BreakCondFn cond)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) cpuDevice->breakCond = cond;
+}
+
+void set6502CondBreakpoint(HBC56Device* device, uint16_t addr, int enabled)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice || !(cpuDevice->condBreakMap[addr >> 3] & (1 << (addr & 7))) == !enabled) return;
+
+  cpuDevice->condBreakMap[addr >> 3] ^= 1 << (addr & 7);
+  updateArmedMap(cpuDevice);
+}
+
+void clear6502CondBreakpoints(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  memset(cpuDevice->condBreakMap, 0, sizeof(cpuDevice->condBreakMap));
+  updateArmedMap(cpuDevice);
+}
+
+void set6502EventHook(HBC56Device* device, Cpu65xxEventFn event)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) cpu65xxSetEventHook(cpuDevice->cpu, event);
+}
+
+void set6502TrapHandler(HBC56Device* device, HBC56TrapFn trap)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice) cpuDevice->trap = trap;
+}
+
+void set6502Trap(HBC56Device* device, uint16_t addr, int enabled)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice || !isTrap(cpuDevice, addr) == !enabled) return;
+
+  cpuDevice->trapMap[addr >> 3] ^= 1 << (addr & 7);
+  cpuDevice->trapCount += enabled ? 1 : -1;
+  cpu65xxInvalidateBlocks(cpuDevice->cpu);
+}
+
+void clear6502Traps(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  memset(cpuDevice->trapMap, 0, sizeof(cpuDevice->trapMap));
+  cpuDevice->trapCount = 0;
+  cpu65xxInvalidateBlocks(cpuDevice->cpu);
+}
+
+uint64_t getCpuIdleCycles(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->idleCycles : 0;
+}
+
+const char* getCpuFusionStat(HBC56Device* device, int index, uint64_t* count)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return NULL;
+
+  if (count) *count = cpu65xxFusionCount(cpuDevice->cpu, index);
+  return cpu65xxFusionName(index);
+}
+
+int is6502CpuIdle(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  return cpuDevice ? cpuDevice->idle : 0;
+}
+
+static void resetCpuDevice(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  cpu65xxReset(cpuDevice->cpu);
+  cpuDevice->loopDirty = 1;
+}
+
+static void destroyCpuDevice(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (cpuDevice)
+  {
+    cpu65xxDestroy(cpuDevice->cpu);
+    cpuDevice->cpu = NULL;
+    vrEmu6502Destroy(cpuDevice->cpu6502);
+    cpuDevice->cpu6502 = NULL;
+  }
+  /* device data freed by device framework */
+}
+
+/* run one instruction while single stepping or waiting for an interrupt.
+ * returns the cycles used */
+static uint8_t debugStepCpu(CPU6502Device* cpuDevice)
+{
+  Cpu65xx* cpu = cpuDevice->cpu;
+  int intPending = cpu65xxIrq(cpu) && !(cpu65xxGetStatus(cpu) & STATUS_FLAG_I);
+
+  uint8_t cycles = cpu65xxInstCycle(cpu);
+  cpuDevice->loopDirty = 1;
+
+  switch (cpuDevice->currentState)
+  {
+    case CPU_STEP_INTO:
+      cpuDevice->currentState = CPU_BREAK;
+      break;
+
+    case CPU_BREAK_ON_INTERRUPT:
+      if (intPending) cpuDevice->currentState = CPU_BREAK;
+      break;
+
+    default:
+      break;
+  }
+  return cycles;
+}
+
+/* if the instruction at PC is trapped, run the trap handler instead.
+ * returns the cycles it took, or -1 if the instruction is still to run */
+static int32_t runTrap(CPU6502Device* cpuDevice)
+{
+  Cpu65xx* cpu = cpuDevice->cpu;
+  uint16_t pc = cpu65xxGetPC(cpu);
+  if (!isTrap(cpuDevice, pc) || !cpuDevice->trap || !cpu65xxInstructionNext(cpu)) return -1;
+
+  HBC56CpuRegs regs;
+  getRegisters(cpuDevice, &regs);
+
+  int32_t cycles = cpuDevice->trap(pc, &regs);
+  if (cycles < 0) return -1;
+
+  cpu65xxSetPC(cpu, regs.pc);
+  cpu65xxSetAcc(cpu, regs.a);
+  cpu65xxSetX(cpu, regs.x);
+  cpu65xxSetY(cpu, regs.y);
+  cpu65xxSetStackPointer(cpu, regs.sp);
+  cpu65xxSetStatus(cpu, regs.p);
+  cpuDevice->loopDirty = 1;
+  return cycles;
+}
+
+/* relative branches (including BBR/BBS) and JMP absolute close loops.
+ * RTS and RTI only look like backward jumps */
+static int isLoopBranch(uint8_t opcode)
+{
+  return (opcode & 0x1f) == 0x10 || opcode == OPCODE_BRA || (opcode & 0x0f) == 0x0f || opcode == OPCODE_JMP;
+}
+
+/* called after a short backward jump from instPc to pc. returns non-zero if
+ * the pass of the loop that just ended wrote nothing, read nothing that can
+ * change before the next device event and left the registers as they were.
+ * the next pass will then do exactly the same */
+static int idleLoopPass(CPU6502Device* cpuDevice, uint16_t instPc, uint16_t pc, uint8_t opcode)
+{
+  Cpu65xx* cpu = cpuDevice->cpu;
+  if (instPc - pc > IDLE_LOOP_MAX_BYTES || !isLoopBranch(opcode))
+  {
+    return 0;
+  }
+
+  uint8_t regs[IDLE_LOOP_REGS] = {
+    cpu65xxGetAcc(cpu), cpu65xxGetX(cpu), cpu65xxGetY(cpu),
+    cpu65xxGetStackPointer(cpu), cpu65xxGetStatus(cpu) };
+
+  if (pc == cpuDevice->loopHead && !cpuDevice->loopDirty && !cpu65xxWriteSeen(cpu) &&
+      cpuDevice->cycles - cpuDevice->loopStartCycle <= IDLE_LOOP_MAX_CYCLES &&
+      memcmp(regs, cpuDevice->loopRegs, sizeof(regs)) == 0)
+  {
+    return 1;
+  }
+
+  cpuDevice->loopHead = pc;
+  memcpy(cpuDevice->loopRegs, regs, sizeof(regs));
+  cpuDevice->loopDirty = 0;
+
+  /* pushes below the stack pointer the loop started with are scratch:
+   * a subroutine called from the loop writes the same bytes every pass */
+  cpu65xxWatchWrites(cpu, regs[IDLE_LOOP_REG_SP]);
+  cpuDevice->loopStartCycle = cpuDevice->cycles;
+  return 0;
+}
+
+/* called when the instruction just run (at instPc) left the PC where it was
+ * or jumped back to pc. returns the cycles up to targetCycles the CPU can
+ * skip without the guest being able to tell */
+static uint64_t idleSkipCycles(CPU6502Device* cpuDevice, uint16_t instPc, uint16_t pc, uint64_t targetCycles)
+{
+  Cpu65xx* cpu = cpuDevice->cpu;
+  uint8_t opcode = cpu65xxGetCurrentOpcode(cpu);
+
+  /* WAI holds until an interrupt line is asserted, STP until reset */
+  if (opcode == OPCODE_STP ||
+      (opcode == OPCODE_WAI && !cpu65xxIrq(cpu) && !cpu65xxNmi(cpu)))
+  {
+    return targetCycles - cpuDevice->cycles;
+  }
+
+  if (cpuDevice->steadyRead && idleLoopPass(cpuDevice, instPc, pc, opcode))
+  {
+    /* skip whole passes, so the loop is where it would have been */
+    uint64_t passCycles = cpuDevice->cycles - cpuDevice->loopStartCycle;
+    uint64_t skipped = ((targetCycles - cpuDevice->cycles) / passCycles) * passCycles;
+    cpuDevice->loopStartCycle = cpuDevice->cycles + skipped;
+    return skipped;
+  }
+  return 0;
+}
+
+static void tickCpuDevice(HBC56Device* device, uint32_t deltaTicks, float deltaTime)
+{
+  CPU6502Device* cpuDevice = getCpu6502Device(device);
+  if (!cpuDevice) return;
+
+  Uint64 startCounter = SDL_GetPerformanceCounter();
+
+  uint64_t startCycles = cpuDevice->cycles;
+  uint64_t targetCycles = startCycles + deltaTicks;
+  cpuDevice->stopRequested = 0;
+
+  /* other devices have run since the last tick */
+  cpuDevice->loopDirty = 1;
+  cpuDevice->idle = 0;
+
+  while (cpuDevice->cycles < targetCycles)
+  {
+    if (cpuDevice->currentState == CPU_BREAK)
+    {
+      /* halted in the debugger. the clock keeps running for the other devices */
+      cpuDevice->cycles = targetCycles;
+      break;
+    }
+
+    uint32_t cycles;
+    int32_t trapCycles = -1;
+    if (cpuDevice->currentState != CPU_RUNNING && !cpuDevice->runTo)
+    {
+      cycles = debugStepCpu(cpuDevice);
+    }
+    else if (cpuDevice->trapCount && (trapCycles = runTrap(cpuDevice)) >= 0)
+    {
+      cycles = (uint32_t)trapCycles;
+    }
+    else if (cpuDevice->core == CPU_CORE_THREADED)
+    {
+      cycles = cpu65xxRunBlock(cpuDevice->cpu, (uint32_t)(targetCycles - cpuDevice->cycles));
+    }
+    else
+    {
+      cycles = cpu65xxInstCycle(cpuDevice->cpu);
+    }
+
+    if (cpuDevice->syncedDevice)
+    {
+      tickDevice(cpuDevice->syncedDevice, cycles, (float)(cycles * cpuDevice->secondsPerCycle));
+    }
+
+    cpuDevice->cycles += cycles;
+
+    uint16_t pc = cpu65xxGetPC(cpuDevice->cpu);
+    uint16_t instPc = cpu65xxGetInstPC(cpuDevice->cpu);
+
+    if (cpuDevice->runTo && runToDone(cpuDevice, pc, trapCycles >= 0))
+    {
+      cpuDevice->currentState = CPU_BREAK;
+    }
+    else if (isBreakpoint(cpuDevice, pc) && breakpointHit(cpuDevice, pc))
+    {
+      cpuDevice->currentState = CPU_BREAK;
+    }
+    if (cpuDevice->runTo && cpuDevice->currentState == CPU_BREAK) endRunTo(cpuDevice);
+
+    /* after a trap, instPc and the opcode are still the last instruction's */
+    if (pc <= instPc && trapCycles < 0 && cpuDevice->currentState != CPU_BREAK &&
+        !cpuDevice->stopRequested && cpuDevice->cycles < targetCycles)
+    {
+      uint64_t skipped = idleSkipCycles(cpuDevice, instPc, pc, targetCycles);
+      if (skipped)
+      {
+        if (cpuDevice->syncedDevice)
+        {
+          tickDevice(cpuDevice->syncedDevice, (uint32_t)skipped, (float)(skipped * cpuDevice->secondsPerCycle));
+        }
+        cpuDevice->cycles += skipped;
+        cpuDevice->idleCycles += skipped;
+        cpuDevice->idle = 1;
+      }
+    }
+
+    if (cpuDevice->stopRequested) break;
+  }
+
+  /* utilization is measured over at least UTILIZATION_PERIOD emulated seconds */
+  cpuDevice->utilHostSeconds += (SDL_GetPerformanceCounter() - startCounter) / cpuDevice->perfFreq;
+  cpuDevice->utilCycles += cpuDevice->cycles - startCycles;
+  if (cpuDevice->utilCycles * cpuDevice->secondsPerCycle >= UTILIZATION_PERIOD)
+  {
+    cpuDevice->utilization = (float)(cpuDevice->utilHostSeconds / (cpuDevice->utilCycles * cpuDevice->secondsPerCycle));
+    cpuDevice->utilHostSeconds = 0.0;
+    cpuDevice->utilCycles = 0;
+  }
+
+  (void)deltaTime;
+}
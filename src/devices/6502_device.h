@@ -0,0 +1,290 @@
+/*
+ * DB6502 Emulator - 65C02 CPU device
+ *
+ * Based on Troy Schrapel's HBC-56 Emulator (MIT License)
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ * DB6502 replacement for HBC-56's 6502_device (same interface). Our src/
+ * directory is searched first, so this header shadows the shared one.
+ * The CPU owns the emulated clock: it counts every cycle it runs, and keeps
+ * counting while halted in the debugger.
+ */
+
+#ifndef _HBC56_6502_CPU_DEVICE_H_
+#define _HBC56_6502_CPU_DEVICE_H_
+
+#include "devices/device.h"
+#include "cpu/cpu65xx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct vrEmu6502_s;
+typedef struct vrEmu6502_s VrEmu6502;
+
+typedef enum
+{
+  CPU_RUNNING,
+  CPU_BREAK,
+  CPU_STEP_INTO,
+  CPU_STEP_OVER,
+  CPU_STEP_OUT,
+  CPU_BREAK_ON_INTERRUPT,
+  CPU_RUN_TO
+} HBC56CpuState;
+
+typedef enum
+{
+  INTERRUPT_INT,
+  INTERRUPT_NMI
+} HBC56InterruptType;
+
+typedef enum
+{
+  CPU_CORE_INTERP,      /* one instruction at a time */
+  CPU_CORE_THREADED     /* hot code as translated blocks */
+} HBC56CpuCore;
+
+typedef struct
+{
+  uint16_t pc;
+  uint8_t  a, x, y, sp, p;
+} HBC56CpuRegs;
+
+typedef uint8_t (*HBC56SteadyReadFn)(uint16_t addr);
+typedef int32_t (*HBC56TrapFn)(uint16_t addr, HBC56CpuRegs* regs);
+typedef int (*HBC56BreakCondFn)(uint16_t addr, const HBC56CpuRegs* regs);
+
+/* Function:  create6502CpuDevice
+ * --------------------
+ * create a CPU device running at clockFreq Hz. the core is built separately
+ * for each model, so decimal mode and CMOS behaviour cost nothing at run time
+ */
+HBC56Device create6502CpuDevice(uint32_t clockFreq, Cpu65xxModel model);
+
+/* Function:  getCpuDevice
+ * --------------------
+ * a vrEmu6502 mirroring the CPU registers (for the debugger). it belongs to
+ * the thread drawing the debugger views, not the core: that thread loads
+ * it with set6502Mirror() and hands edits back with take6502MirrorEdits()
+ */
+VrEmu6502* getCpuDevice(HBC56Device* device);
+
+/* Function:  set6502Mirror
+ * --------------------
+ * load the mirror with registers (a snapshot of the CPU's)
+ */
+void set6502Mirror(HBC56Device* device, const HBC56CpuRegs* regs);
+
+/* Function:  is6502MirrorEdited
+ * --------------------
+ * non-zero if the debugger has changed the mirror since set6502Mirror()
+ */
+int is6502MirrorEdited(HBC56Device* device);
+
+/* Function:  take6502MirrorEdits
+ * --------------------
+ * give the registers edited in the mirror to the CPU. with the core's lock
+ * held
+ */
+void take6502MirrorEdits(HBC56Device* device);
+
+/* Function:  interrupt6502
+ * --------------------
+ * set the state of the IRQ or NMI line
+ */
+void interrupt6502(HBC56Device* device, HBC56InterruptType type, HBC56InterruptSignal signal);
+
+/* Function:  debug6502State
+ * --------------------
+ * change the debugger run state. step over (a JSR) and step out run at full
+ * speed to a temporary breakpoint or stack level, as run6502To() does
+ */
+void debug6502State(HBC56Device* device, HBC56CpuState state);
+
+/* Function:  run6502To
+ * --------------------
+ * run at full speed until the CPU reaches addr, then break (CPU_RUN_TO)
+ */
+void run6502To(HBC56Device* device, uint16_t addr);
+
+/* Function:  is6502RunningTo
+ * --------------------
+ * non-zero while a step over, step out or run to is under way
+ */
+int is6502RunningTo(HBC56Device* device);
+
+/* Function:  get6502RunToCycles
+ * --------------------
+ * cycles the last step over, step out or run to took to stop
+ */
+uint64_t get6502RunToCycles(HBC56Device* device);
+
+/* Function:  getDebug6502State
+ * --------------------
+ * current debugger run state
+ */
+HBC56CpuState getDebug6502State(HBC56Device* device);
+
+/* Function:  getCpuUtilization
+ * --------------------
+ * host time spent running the CPU as a fraction of the emulated time run
+ */
+float getCpuUtilization(HBC56Device* device);
+
+/* Function:  getCpuRuntimeSeconds
+ * --------------------
+ * emulated seconds since power on
+ */
+double getCpuRuntimeSeconds(HBC56Device* device);
+
+/* Function:  set6502ClockFreq
+ * --------------------
+ * change the clock (Hz). the runtime keeps counting from where it was
+ */
+void set6502ClockFreq(HBC56Device* device, uint32_t clockFreq);
+
+/* Function:  sync6502CpuDevice
+ * --------------------
+ * tick another device in lockstep with each instruction
+ */
+void sync6502CpuDevice(HBC56Device* device, HBC56Device* syncedDevice);
+
+/* Function:  get6502Registers
+ * --------------------
+ * the live registers. during a bus access, pc has already moved past the
+ * instruction making it (see get6502InstructionPC)
+ */
+void get6502Registers(HBC56Device* device, HBC56CpuRegs* regs);
+
+/* Function:  get6502InstructionPC
+ * --------------------
+ * address of the instruction running (during a bus access) or last run
+ */
+uint16_t get6502InstructionPC(HBC56Device* device);
+
+/* Function:  getCpuCycleCount
+ * --------------------
+ * emulated cycles since power on. while an instruction is executing, this
+ * is the cycle of the bus access in progress
+ */
+uint64_t getCpuCycleCount(HBC56Device* device);
+
+/* Function:  stop6502CpuRun
+ * --------------------
+ * end the current tick at the next instruction boundary
+ */
+void stop6502CpuRun(HBC56Device* device);
+
+/* Function:  set6502IdleDetection
+ * --------------------
+ * skip tight polling loops ahead to the end of the tick (WAI and STP are
+ * always skipped). steadyRead(addr)
+ * returns non-zero if a read of a device address can't change before the
+ * next device event (memory is always steady). NULL disables it
+ */
+void set6502IdleDetection(HBC56Device* device, HBC56SteadyReadFn steadyRead);
+
+/* Function:  invalidate6502CodeCache
+ * --------------------
+ * drop the CPU's predecoded instructions. call when memory changes other
+ * than through CPU writes (ROM load, bus remap)
+ */
+void invalidate6502CodeCache(HBC56Device* device);
+
+/* Function:  invalidate6502CodePage
+ * --------------------
+ * drop the CPU's predecoded instructions for one page of memory written
+ * other than by the CPU
+ */
+void invalidate6502CodePage(HBC56Device* device, uint8_t page);
+
+/* Function:  set6502CpuCore
+ * --------------------
+ * select how the CPU runs code (CPU_CORE_INTERP by default)
+ */
+void set6502CpuCore(HBC56Device* device, HBC56CpuCore core);
+
+/* Function:  set6502Breakpoints
+ * --------------------
+ * replace the breakpoint set: 0x10000 / 8 bytes, one bit per address
+ * (addr >> 3, bit addr & 7). the CPU stops in the debugger before running
+ * an instruction at a breakpoint
+ */
+void set6502Breakpoints(HBC56Device* device, const uint8_t* bitmap);
+
+/* Function:  set6502BreakCondition
+ * --------------------
+ * cond(addr, regs) is called when the CPU reaches an address armed with
+ * set6502CondBreakpoint(), and returns non-zero to stop in the debugger
+ */
+void set6502BreakCondition(HBC56Device* device, HBC56BreakCondFn cond);
+
+/* Function:  set6502CondBreakpoint
+ * --------------------
+ * arm (or disarm) an address for the break condition. unarmed addresses
+ * cost nothing
+ */
+void set6502CondBreakpoint(HBC56Device* device, uint16_t addr, int enabled);
+
+/* Function:  clear6502CondBreakpoints
+ * --------------------
+ * disarm every address
+ */
+void clear6502CondBreakpoints(HBC56Device* device);
+
+/* Function:  set6502EventHook
+ * --------------------
+ * event(e) is called as the CPU takes an IRQ or NMI, runs a BRK and runs
+ * an RTI. getCpuCycleCount() gives the cycle
+ */
+void set6502EventHook(HBC56Device* device, Cpu65xxEventFn event);
+
+/* Function:  set6502TrapHandler
+ * --------------------
+ * trap(addr, regs) is called instead of running the instruction at a
+ * trapped address. it may change regs (including pc) and returns the cycles
+ * it took, or a negative value to run the guest code after all. traps only
+ * fire while running (including step over, step out and run to), not
+ * while single stepping in the debugger
+ */
+void set6502TrapHandler(HBC56Device* device, HBC56TrapFn trap);
+
+/* Function:  set6502Trap
+ * --------------------
+ * trap (or stop trapping) an address
+ */
+void set6502Trap(HBC56Device* device, uint16_t addr, int enabled);
+
+/* Function:  clear6502Traps
+ * --------------------
+ * remove every trap
+ */
+void clear6502Traps(HBC56Device* device);
+
+/* Function:  getCpuIdleCycles
+ * --------------------
+ * emulated cycles skipped in idle loops since power on
+ */
+uint64_t getCpuIdleCycles(HBC56Device* device);
+
+/* Function:  getCpuFusionStat
+ * --------------------
+ * name of fused instruction sequence index (NULL past the last) and, in
+ * count, how many times it has run since power on
+ */
+const char* getCpuFusionStat(HBC56Device* device, int index, uint64_t* count);
+
+/* Function:  is6502CpuIdle
+ * --------------------
+ * non-zero if the last tick ended with the CPU idle: in WAI or STP, or in
+ * an idle loop. nothing changes until a device event or host input
+ */
+int is6502CpuIdle(HBC56Device* device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
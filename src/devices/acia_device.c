@@ -67,6 +67,7 @@ struct AciaDevice
 {
   uint16_t  baseAddr;
   uint8_t   irq;
+  int       irqAsserted;  /* the line as last signalled */
 
   /* registers */
   uint8_t   commandReg;
@@ -85,6 +86,9 @@ struct AciaDevice
 
   /* cursor position for basic terminal emulation */
   int       cursorX;
+
+  /* optional mirror of transmitted bytes */
+  FILE*     txStream;
 };
 typedef struct AciaDevice AciaDevice;
 
@@ -179,12 +183,17 @@ static void updateIrq(AciaDevice* acia)
   if (irqActive)
   {
     acia->statusReg |= ACIA_STATUS_IRQ;
-    hbc56Interrupt(acia->irq, INTERRUPT_RAISE);
   }
   else
   {
     acia->statusReg &= ~ACIA_STATUS_IRQ;
-    hbc56Interrupt(acia->irq, INTERRUPT_RELEASE);
+  }
+
+  /* called on every data read and command write. only changes matter */
+  if (irqActive != acia->irqAsserted)
+  {
+    acia->irqAsserted = irqActive;
+    hbc56Interrupt(acia->irq, irqActive ? INTERRUPT_RAISE : INTERRUPT_RELEASE);
   }
 }
 
@@ -218,6 +227,7 @@ static void resetAciaDevice(HBC56Device* device)
   acia->statusReg = ACIA_STATUS_TDRE;
   acia->rxHead = 0;
   acia->rxTail = 0;
+  acia->irqAsserted = 0;
   hbc56Interrupt(acia->irq, INTERRUPT_RELEASE);
 }
 
@@ -288,6 +298,7 @@ static uint8_t writeAciaDevice(HBC56Device* device, uint16_t addr, uint8_t val)
       /* transmit byte - output to terminal */
       if(getAciaLog()) fprintf(getAciaLog(), "[ACIA TX] 0x%02X '%c'\n", val, (val >= 0x20 && val < 0x7F) ? val : '.');
       termPutChar(acia, (char)val);
+      if (acia->txStream) fputc(val, acia->txStream);
       break;
 
     case ACIA_STATUS_REG:
@@ -321,6 +332,18 @@ static void tickAciaDevice(HBC56Device* device, uint32_t deltaTicks, float delta
   }
 }
 
+uint64_t aciaDeviceNextEvent(HBC56Device* device, uint64_t currentCycle)
+{
+  AciaDevice* acia = (AciaDevice*)device->data;
+
+  /* receiving a byte sets RDRF straight away, so this is only a fallback */
+  if (rxBufCount(acia) > 0 && !(acia->statusReg & ACIA_STATUS_RDRF))
+  {
+    return currentCycle;
+  }
+  return HBC56_NEVER;
+}
+
 void aciaDeviceReceiveByte(HBC56Device* device, uint8_t byte)
 {
   AciaDevice* acia = (AciaDevice*)device->data;
@@ -336,6 +359,12 @@ void aciaDeviceReceiveByte(HBC56Device* device, uint8_t byte)
   }
 }
 
+void aciaDeviceSetTxStream(HBC56Device* device, FILE* stream)
+{
+  AciaDevice* acia = (AciaDevice*)device->data;
+  acia->txStream = stream;
+}
+
 int aciaDeviceRxBufEmpty(HBC56Device* device)
 {
   AciaDevice* acia = (AciaDevice*)device->data;
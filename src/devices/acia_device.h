@@ -10,6 +10,8 @@
 
 #include "devices/device.h"
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,6 +28,20 @@ HBC56Device createAciaDevice(uint16_t baseAddr, uint8_t irq);
  */
 void aciaDeviceReceiveByte(HBC56Device* device, uint8_t byte);
 
+/* Function:  aciaDeviceSetTxStream
+ * --------------------
+ * also write transmitted bytes to a stream (e.g. stdout when headless).
+ * pass NULL to stop
+ */
+void aciaDeviceSetTxStream(HBC56Device* device, FILE* stream);
+
+/* Function:  aciaDeviceNextEvent
+ * --------------------
+ * scheduler next event: the ACIA only needs ticking while received data is
+ * waiting for RDRF
+ */
+uint64_t aciaDeviceNextEvent(HBC56Device* device, uint64_t currentCycle);
+
 /* Function:  aciaRenderTerminal
  * --------------------
  * render the ImGui terminal window
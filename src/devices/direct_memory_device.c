@@ -0,0 +1,126 @@
+/*
+ * DB6502 Emulator - Direct memory (RAM/ROM) device
+ *
+ * Plain RAM and ROM whose storage is exposed to the address decoder.
+ * The read/write functions are only used for accesses the decoder can't
+ * serve through a host pointer.
+ */
+
+#include "devices/direct_memory_device.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Forward declarations */
+static void destroyDirectMemoryDevice(HBC56Device*);
+static uint8_t readDirectMemoryDevice(HBC56Device*, uint16_t, uint8_t*, uint8_t);
+static uint8_t writeDirectMemoryDevice(HBC56Device*, uint16_t, uint8_t);
+
+struct DirectMemoryDevice
+{
+  uint32_t  startAddr;
+  uint32_t  endAddr;
+  int       writable;
+  uint8_t*  data;
+};
+typedef struct DirectMemoryDevice DirectMemoryDevice;
+
+
+static HBC56Device createDirectMemoryDevice(const char* name, uint32_t startAddr, uint32_t endAddr, int writable)
+{
+  HBC56Device device = createDevice(name);
+  DirectMemoryDevice* mem = (DirectMemoryDevice*)calloc(1, sizeof(DirectMemoryDevice));
+  if (mem && endAddr > startAddr)
+  {
+    mem->startAddr = startAddr;
+    mem->endAddr = endAddr;
+    mem->writable = writable;
+    mem->data = (uint8_t*)malloc(endAddr - startAddr);
+
+    device.data = mem;
+    device.destroyFn = &destroyDirectMemoryDevice;
+    device.readFn = &readDirectMemoryDevice;
+    device.writeFn = &writeDirectMemoryDevice;
+  }
+  return device;
+}
+
+HBC56Device createDirectRamDevice(uint32_t startAddr, uint32_t endAddr)
+{
+  HBC56Device device = createDirectMemoryDevice("RAM", startAddr, endAddr, 1);
+  DirectMemoryDevice* mem = (DirectMemoryDevice*)device.data;
+  if (mem && mem->data)
+  {
+    /* power-on RAM contents are undefined */
+    for (uint32_t i = 0; i < endAddr - startAddr; ++i)
+    {
+      mem->data[i] = (uint8_t)rand();
+    }
+  }
+  return device;
+}
+
+HBC56Device createDirectRomDevice(uint32_t startAddr, uint32_t endAddr, const uint8_t* contents)
+{
+  HBC56Device device = createDirectMemoryDevice("ROM", startAddr, endAddr, 0);
+  setDirectMemoryDeviceContents(&device, contents, endAddr - startAddr);
+  return device;
+}
+
+int setDirectMemoryDeviceContents(HBC56Device* device, const uint8_t* contents, uint32_t contentSize)
+{
+  DirectMemoryDevice* mem = (DirectMemoryDevice*)device->data;
+  if (!mem || !mem->data || !contents) return 0;
+  if (contentSize > mem->endAddr - mem->startAddr) return 0;
+
+  memcpy(mem->data, contents, contentSize);
+  return 1;
+}
+
+uint8_t* directMemoryDeviceData(HBC56Device* device)
+{
+  DirectMemoryDevice* mem = (DirectMemoryDevice*)device->data;
+  return mem ? mem->data : NULL;
+}
+
+int directMemoryDeviceWritable(HBC56Device* device)
+{
+  DirectMemoryDevice* mem = (DirectMemoryDevice*)device->data;
+  return mem ? mem->writable : 0;
+}
+
+static void destroyDirectMemoryDevice(HBC56Device* device)
+{
+  DirectMemoryDevice* mem = (DirectMemoryDevice*)device->data;
+  if (mem)
+  {
+    free(mem->data);
+    mem->data = NULL;
+  }
+  /* device data freed by device framework */
+}
+
+static uint8_t readDirectMemoryDevice(HBC56Device* device, uint16_t addr, uint8_t* val, uint8_t dbg)
+{
+  DirectMemoryDevice* mem = (DirectMemoryDevice*)device->data;
+  (void)dbg;
+
+  if (addr < mem->startAddr || addr >= mem->endAddr) return 0;
+
+  *val = mem->data[addr - mem->startAddr];
+  return 1;
+}
+
+static uint8_t writeDirectMemoryDevice(HBC56Device* device, uint16_t addr, uint8_t val)
+{
+  DirectMemoryDevice* mem = (DirectMemoryDevice*)device->data;
+
+  if (addr < mem->startAddr || addr >= mem->endAddr) return 0;
+
+  /* writes to ROM are claimed and ignored */
+  if (mem->writable)
+  {
+    mem->data[addr - mem->startAddr] = val;
+  }
+  return 1;
+}
@@ -0,0 +1,52 @@
+/*
+ * DB6502 Emulator - Direct memory (RAM/ROM) device
+ *
+ * Plain RAM and ROM whose storage is exposed to the address decoder so
+ * that memory pages can be accessed through host pointers without a
+ * device call.
+ */
+
+#ifndef _DB6502_DIRECT_MEMORY_DEVICE_H_
+#define _DB6502_DIRECT_MEMORY_DEVICE_H_
+
+#include "devices/device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Function:  createDirectRamDevice
+ * --------------------
+ * create a RAM device covering startAddr to endAddr (exclusive)
+ */
+HBC56Device createDirectRamDevice(uint32_t startAddr, uint32_t endAddr);
+
+/* Function:  createDirectRomDevice
+ * --------------------
+ * create a ROM device covering startAddr to endAddr (exclusive)
+ */
+HBC56Device createDirectRomDevice(uint32_t startAddr, uint32_t endAddr, const uint8_t* contents);
+
+/* Function:  setDirectMemoryDeviceContents
+ * --------------------
+ * replace the contents of a RAM or ROM device. returns non-zero on success
+ */
+int setDirectMemoryDeviceContents(HBC56Device* device, const uint8_t* contents, uint32_t contentSize);
+
+/* Function:  directMemoryDeviceData
+ * --------------------
+ * host pointer to the byte at the device's start address
+ */
+uint8_t* directMemoryDeviceData(HBC56Device* device);
+
+/* Function:  directMemoryDeviceWritable
+ * --------------------
+ * returns non-zero if guest writes go to memory (RAM), zero for ROM
+ */
+int directMemoryDeviceWritable(HBC56Device* device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
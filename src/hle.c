@@ -0,0 +1,571 @@
+/*
+ * DB6502 Emulator - High-level emulation of ROM routines
+ *
+ * Each trap names the ROM symbol it replaces. When the CPU reaches that
+ * address the handler does the routine's work directly on guest memory and
+ * registers, the trap's cycle cost is charged and, for subroutines, the RTS
+ * is done here too. A handler can decline (unusual input, an error the ROM
+ * should report), and the ROM code then runs as normal.
+ *
+ * hleInit() registers the routines of the eater.bin BIOS and Microsoft
+ * BASIC (5 byte floats): CHROUT and its TX delay loop, FMULT, FDIV and
+ * BLTU2. Others are added with hleRegisterTrap(). The float
+ * traps repeat the ROM's arithmetic bit for bit: a shift-and-add multiply
+ * that truncates as it goes, and a restoring divide by the rounded FAC.
+ * Results the ROM turns into zero or an overflow error are left to the ROM.
+ */
+
+#include "hle.h"
+#include "hbc56emu.h"
+#include "devices/6502_device.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define FLAG_C  0x01
+#define FLAG_Z  0x02
+#define FLAG_V  0x40
+#define FLAG_N  0x80
+
+#define RTS_CYCLES  6
+
+#define MAX_SYMBOL_LEN  64
+
+/* the zero page symbols the handlers use */
+typedef enum
+{
+  SYM_FAC,
+  SYM_FACSIGN,
+  SYM_FACEXTENSION,
+  SYM_ARG,
+  SYM_ARGSIGN,
+  SYM_SGNCPR,
+  SYM_LOWTR,
+  SYM_HIGHTR,
+  SYM_HIGHDS,
+  SYM_INDEX,
+  SYM_COUNT
+} HleSymbol;
+
+static const char* symbolNames[SYM_COUNT] = {
+  "FAC", "FACSIGN", "FACEXTENSION", "ARG", "ARGSIGN", "SGNCPR",
+  "LOWTR", "HIGHTR", "HIGHDS", "INDEX"
+};
+
+static int32_t symbols[SYM_COUNT];    /* address, or -1 if not in the label file */
+
+#define MAX_TRAPS   32
+
+typedef struct
+{
+  char        name[MAX_SYMBOL_LEN];   /* the ROM symbol */
+  HleHandler  handler;
+  int         returns;    /* a subroutine: the trap does its RTS */
+  uint32_t    cycles;     /* charged per call */
+  uint32_t    needs;      /* bit per HleSymbol the handler uses */
+
+  int32_t     addr;       /* -1 if not installed */
+  uint64_t    hits;
+} HleTrap;
+
+static int chrout(uint16_t addr, HBC56CpuRegs* regs);
+static int txDelay(uint16_t addr, HBC56CpuRegs* regs);
+static int fmult(uint16_t addr, HBC56CpuRegs* regs);
+static int fdiv(uint16_t addr, HBC56CpuRegs* regs);
+static int bltu2(uint16_t addr, HBC56CpuRegs* regs);
+
+#define FP_SYMBOLS  ((1 << SYM_FAC) | (1 << SYM_FACSIGN) | (1 << SYM_FACEXTENSION) | \
+                     (1 << SYM_ARG) | (1 << SYM_ARGSIGN) | (1 << SYM_SGNCPR))
+
+static HleTrap traps[MAX_TRAPS];
+static size_t trapCount = 0;
+
+static HBC56Device* hleCpuDevice = NULL;
+
+
+/* ---- guest memory ---- */
+
+static uint8_t peek(uint16_t addr)
+{
+  return hbc56MemRead(addr, false);
+}
+
+static void poke(uint16_t addr, uint8_t val)
+{
+  hbc56MemWrite(addr, val);
+}
+
+static uint16_t peek16(uint16_t addr)
+{
+  return peek(addr) | (peek((uint16_t)(addr + 1)) << 8);
+}
+
+static void poke16(uint16_t addr, uint16_t val)
+{
+  poke(addr, val & 0xff);
+  poke((uint16_t)(addr + 1), val >> 8);
+}
+
+static uint16_t sym(HleSymbol s)
+{
+  return (uint16_t)symbols[s];
+}
+
+static void setNZ(HBC56CpuRegs* regs, uint8_t val)
+{
+  regs->p &= ~(FLAG_N | FLAG_Z);
+  if (!val) regs->p |= FLAG_Z;
+  regs->p |= val & FLAG_N;
+}
+
+/* C and V as left by a binary mode SBC */
+static void sbcFlags(HBC56CpuRegs* regs, uint8_t a, uint8_t b, int carry)
+{
+  int diff = a - b - (carry ? 0 : 1);
+  regs->p &= ~(FLAG_C | FLAG_V);
+  if (diff >= 0) regs->p |= FLAG_C;
+  if ((a ^ b) & (a ^ diff) & 0x80) regs->p |= FLAG_V;
+}
+
+
+/* ---- BIOS ---- */
+
+/* write A to the ACIA. the ROM then waits out the transmit time, which our
+ * ACIA doesn't need. A is preserved, N and Z are set from it (PLA) */
+static int chrout(uint16_t addr, HBC56CpuRegs* regs)
+{
+  (void)addr;
+  poke(HBC56_ACIA_ADDR, regs->a);
+  setNZ(regs, regs->a);
+  return 1;
+}
+
+/* DEC A; BNE *-1 */
+static int txDelay(uint16_t addr, HBC56CpuRegs* regs)
+{
+  if (peek(addr) != 0x3a || peek((uint16_t)(addr + 1)) != 0xd0 || peek((uint16_t)(addr + 2)) != 0xfd)
+  {
+    return 0;
+  }
+
+  regs->a = 0;
+  setNZ(regs, regs->a);
+  regs->pc = (uint16_t)(addr + 3);
+  return 1;
+}
+
+
+/* ---- BASIC ---- */
+
+static uint32_t mantissa(uint16_t addr)
+{
+  return ((uint32_t)peek((uint16_t)(addr + 1)) << 24) | ((uint32_t)peek((uint16_t)(addr + 2)) << 16) |
+         ((uint32_t)peek((uint16_t)(addr + 3)) << 8) | peek((uint16_t)(addr + 4));
+}
+
+static void setFac(int exponent, uint32_t mant, uint8_t extension)
+{
+  poke(sym(SYM_FAC), (uint8_t)exponent);
+  poke((uint16_t)(sym(SYM_FAC) + 1), mant >> 24);
+  poke((uint16_t)(sym(SYM_FAC) + 2), (mant >> 16) & 0xff);
+  poke((uint16_t)(sym(SYM_FAC) + 3), (mant >> 8) & 0xff);
+  poke((uint16_t)(sym(SYM_FAC) + 4), mant & 0xff);
+  poke(sym(SYM_FACEXTENSION), extension);
+}
+
+/* NORMALIZE_FAC2's exit, which FMULT and FDIV leave through: X = 0, Y the
+ * top mantissa byte before the bit shifts, A the exponent, C clear and N, Z
+ * and V from the ADC #1 that worked the exponent out */
+static void normalizedRegs(HBC56CpuRegs* regs, uint8_t top, int exponent)
+{
+  regs->a = (uint8_t)exponent;
+  regs->x = 0;
+  regs->y = top;
+  regs->p &= ~(FLAG_C | FLAG_V);
+  if (exponent == 0x80) regs->p |= FLAG_V;
+  setNZ(regs, regs->a);
+}
+
+/* LOAD_ARG_FROM_YA: unpack the number at (Y,A) into ARG. returns SGNCPR */
+static uint8_t loadArg(HBC56CpuRegs* regs)
+{
+  uint16_t src = regs->a | (regs->y << 8);
+  uint8_t sign = peek((uint16_t)(src + 1));
+
+  poke(sym(SYM_ARG), peek(src));
+  poke(sym(SYM_ARGSIGN), sign);
+  poke((uint16_t)(sym(SYM_ARG) + 1), sign | 0x80);
+  for (int i = 2; i < 5; ++i)
+  {
+    poke((uint16_t)(sym(SYM_ARG) + i), peek((uint16_t)(src + i)));
+  }
+
+  uint8_t sgncpr = sign ^ peek(sym(SYM_FACSIGN));
+  poke(sym(SYM_SGNCPR), sgncpr);
+  return sgncpr;
+}
+
+/* FAC = (Y,A) * FAC */
+static int fmult(uint16_t addr, HBC56CpuRegs* regs)
+{
+  (void)addr;
+  uint16_t src = regs->a | (regs->y << 8);
+  int argExp = peek(src);
+  int facExp = peek(sym(SYM_FAC));
+
+  /* zero operands, underflow and overflow are the ROM's */
+  int exponent = argExp + facExp - 128;
+  if (!argExp || !facExp || exponent < 2 || exponent > 255) return 0;
+
+  uint8_t sgncpr = loadArg(regs);
+  uint32_t argMant = mantissa(sym(SYM_ARG));
+  uint32_t facMant = mantissa(sym(SYM_FAC));
+
+  /* multiplier bytes from FACEXTENSION up to FAC+1, each bit from the
+   * bottom: add ARG to RESULT, then shift RESULT:FACEXTENSION right */
+  uint8_t multiplier[5] = {
+    peek(sym(SYM_FACEXTENSION)), facMant & 0xff, (facMant >> 8) & 0xff,
+    (facMant >> 16) & 0xff, facMant >> 24 };
+
+  uint64_t acc = 0;
+  for (int i = 0; i < 5; ++i)
+  {
+    for (int bit = 0; bit < 8; ++bit)
+    {
+      if (multiplier[i] & (1 << bit)) acc += (uint64_t)argMant << 8;
+      acc >>= 1;
+    }
+  }
+
+  uint32_t mant = (uint32_t)(acc >> 8);
+  uint8_t extension = acc & 0xff;
+  uint8_t top = mant >> 24;
+  if (!(mant & 0x80000000))
+  {
+    mant = (mant << 1) | (extension >> 7);
+    extension <<= 1;
+    --exponent;
+  }
+
+  setFac(exponent, mant, extension);
+  poke(sym(SYM_FACSIGN), sgncpr);
+  normalizedRegs(regs, top, exponent);
+  return 1;
+}
+
+/* FAC = (Y,A) / FAC */
+static int fdiv(uint16_t addr, HBC56CpuRegs* regs)
+{
+  (void)addr;
+  uint16_t src = regs->a | (regs->y << 8);
+  int argExp = peek(src);
+  int facExp = peek(sym(SYM_FAC));
+  if (!argExp || !facExp) return 0;   /* division by zero is the ROM's error */
+
+  /* the divisor is FAC rounded (ROUND_FAC), which can overflow */
+  uint32_t facMant = mantissa(sym(SYM_FAC));
+  if (peek(sym(SYM_FACEXTENSION)) & 0x80)
+  {
+    if (++facMant == 0)
+    {
+      facMant = 0x80000000;
+      if (++facExp > 255) return 0;
+    }
+  }
+
+  /* the ROM's exponent before normalising, out of range whichever way the
+   * quotient then normalises */
+  int exponent = argExp - facExp + 129;
+  if (exponent < 2 || exponent > 255) return 0;
+
+  uint32_t argMant = ((uint32_t)(peek((uint16_t)(src + 1)) | 0x80) << 24) |
+                     ((uint32_t)peek((uint16_t)(src + 2)) << 16) |
+                     ((uint32_t)peek((uint16_t)(src + 3)) << 8) | peek((uint16_t)(src + 4));
+
+  /* 34 quotient bits, from 2^0 down to 2^-33 */
+  uint64_t dividend = (uint64_t)argMant << 32;
+  uint64_t quotient = dividend / facMant;
+  uint64_t remainder = dividend % facMant;
+  quotient = (quotient << 1) | ((remainder << 1) >= facMant ? 1 : 0);
+
+  uint32_t mant;
+  uint8_t extension;
+  uint8_t top = (uint8_t)(quotient >> 26);
+  if (quotient >> 33)
+  {
+    mant = (uint32_t)(quotient >> 2);
+    extension = (uint8_t)((quotient & 3) << 6);
+  }
+  else
+  {
+    mant = (uint32_t)(quotient >> 1);
+    extension = (uint8_t)((quotient & 1) << 7);
+    --exponent;
+  }
+
+  /* the ROM divides in ARG's mantissa, leaving the last remainder shifted
+   * once (the bit shifted out of ARG+1 is lost) */
+  uint8_t sgncpr = loadArg(regs);
+  uint32_t rest = (uint32_t)(remainder << 1);
+  for (int i = 1; i < 5; ++i)
+  {
+    poke((uint16_t)(sym(SYM_ARG) + i), (rest >> (32 - 8 * i)) & 0xff);
+  }
+
+  setFac(exponent, mant, extension);
+  poke(sym(SYM_FACSIGN), sgncpr);
+  normalizedRegs(regs, top, exponent);
+  return 1;
+}
+
+/* move LOWTR..HIGHTR-1 up to end at HIGHDS-1, top byte first. the
+ * pointers, registers and flags are left as the ROM's loop leaves them */
+static int bltu2(uint16_t addr, HBC56CpuRegs* regs)
+{
+  (void)addr;
+  uint16_t lowtr = peek16(sym(SYM_LOWTR));
+  uint16_t hightr = peek16(sym(SYM_HIGHTR));
+  uint16_t highds = peek16(sym(SYM_HIGHDS));
+  if (hightr < lowtr) return 0;
+
+  uint16_t count = hightr - lowtr;
+  uint16_t dst = highds - count;
+  for (int i = count - 1; i >= 0; --i)
+  {
+    poke((uint16_t)(dst + i), peek((uint16_t)(lowtr + i)));
+  }
+
+  uint8_t low = count & 0xff;
+  if (low)
+  {
+    sbcFlags(regs, highds & 0xff, low, 1);
+  }
+  else
+  {
+    sbcFlags(regs, hightr >> 8, lowtr >> 8, 1);
+  }
+  if (symbols[SYM_INDEX] >= 0) poke(sym(SYM_INDEX), low);
+
+  poke16(sym(SYM_HIGHTR), (uint16_t)(lowtr - 0x100));
+  poke16(sym(SYM_HIGHDS), (uint16_t)(dst - 0x100));
+
+  regs->a = count ? peek(lowtr) : 0;
+  regs->x = 0;
+  regs->y = 0;
+  setNZ(regs, 0);
+  return 1;
+}
+
+
+/* ---- registry ---- */
+
+static HleTrap* findTrap(uint16_t addr)
+{
+  for (size_t i = 0; i < trapCount; ++i)
+  {
+    if (traps[i].addr == addr) return &traps[i];
+  }
+  return NULL;
+}
+
+static int32_t hleTrap(uint16_t addr, HBC56CpuRegs* regs)
+{
+  HleTrap* trap = findTrap(addr);
+  if (!trap || !trap->handler(addr, regs)) return -1;
+
+  ++trap->hits;
+  if (!trap->returns) return (int32_t)trap->cycles;
+
+  uint16_t ret = peek(0x100 | (uint8_t)(regs->sp + 1)) | (peek(0x100 | (uint8_t)(regs->sp + 2)) << 8);
+  regs->sp += 2;
+  regs->pc = (uint16_t)(ret + 1);
+  return (int32_t)(trap->cycles + RTS_CYCLES);
+}
+
+/* one label file line: "NAME = $XXXX" (ACME) or "al XXXXXX .NAME" (VICE).
+ * returns non-zero if it defines a symbol */
+static int parseLabel(const char* line, const char* end, char* name, uint16_t* addr)
+{
+  while (line < end && (*line == ' ' || *line == '\t')) ++line;
+
+  if (end - line > 3 && line[0] == 'a' && line[1] == 'l' && line[2] == ' ')
+  {
+    char* next;
+    unsigned long value = strtoul(line + 3, &next, 16);
+    while (next < end && *next == ' ') ++next;
+    if (next >= end || *next != '.') return 0;
+    line = next + 1;
+
+    size_t len = 0;
+    while (line + len < end && line[len] > ' ' && len < MAX_SYMBOL_LEN - 1) ++len;
+    memcpy(name, line, len);
+    name[len] = 0;
+    *addr = (uint16_t)value;
+    return len > 0;
+  }
+
+  size_t len = 0;
+  while (line + len < end && line[len] > ' ' && line[len] != '=' && len < MAX_SYMBOL_LEN - 1) ++len;
+  if (!len) return 0;
+  memcpy(name, line, len);
+  name[len] = 0;
+
+  line += len;
+  while (line < end && (*line == ' ' || *line == '\t')) ++line;
+  if (line >= end || *line != '=') return 0;
+  ++line;
+  while (line < end && (*line == ' ' || *line == '\t')) ++line;
+
+  int base = 10;
+  if (line < end && *line == '$')
+  {
+    base = 16;
+    ++line;
+  }
+  char* next;
+  unsigned long value = strtoul(line, &next, base);
+  if (next == line) return 0;
+  *addr = (uint16_t)value;
+  return 1;
+}
+
+static HleTrap* findTrapNamed(const char* name)
+{
+  for (size_t i = 0; i < trapCount; ++i)
+  {
+    if (strcmp(name, traps[i].name) == 0) return &traps[i];
+  }
+  return NULL;
+}
+
+/* a new symbol takes the next entry. an existing one keeps its entry and
+ * installed address */
+static int registerTrap(const char* symbol, HleHandler handler, int returns, uint32_t cycles, uint32_t needs)
+{
+  if (!symbol[0] || strlen(symbol) >= MAX_SYMBOL_LEN || !handler) return 0;
+
+  HleTrap* trap = findTrapNamed(symbol);
+  if (!trap)
+  {
+    if (trapCount == MAX_TRAPS) return 0;
+    trap = &traps[trapCount++];
+    strcpy(trap->name, symbol);
+    trap->addr = -1;
+    trap->hits = 0;
+  }
+  trap->handler = handler;
+  trap->returns = returns;
+  trap->cycles = cycles;
+  trap->needs = needs;
+  return 1;
+}
+
+void hleInit(HBC56Device* cpuDevice)
+{
+  hleCpuDevice = cpuDevice;
+  set6502TrapHandler(cpuDevice, hleTrap);
+
+  trapCount = 0;
+  registerTrap("CHROUT",  chrout,  1, 20, 0);
+  registerTrap("TXDELAY", txDelay, 0, 2,  0);
+  registerTrap("FMULT",   fmult,   1, 60, FP_SYMBOLS);
+  registerTrap("FDIV",    fdiv,    1, 60, FP_SYMBOLS);
+  registerTrap("BLTU2",   bltu2,   1, 30, (1 << SYM_LOWTR) | (1 << SYM_HIGHTR) | (1 << SYM_HIGHDS));
+  hleClearTraps();
+}
+
+int hleRegisterTrap(const char* symbol, HleHandler handler, int returns, uint32_t cycles)
+{
+  return registerTrap(symbol, handler, returns, cycles, 0);
+}
+
+void hleClearTraps()
+{
+  for (size_t i = 0; i < trapCount; ++i)
+  {
+    traps[i].addr = -1;
+    traps[i].hits = 0;
+  }
+  for (int i = 0; i < SYM_COUNT; ++i)
+  {
+    symbols[i] = -1;
+  }
+  clear6502Traps(hleCpuDevice);
+}
+
+int hleLoadTraps(const char* labelFileContents)
+{
+  int32_t trapAddrs[MAX_TRAPS];
+  for (size_t i = 0; i < trapCount; ++i) trapAddrs[i] = -1;
+
+  hleClearTraps();
+
+  const char* line = labelFileContents;
+  while (line && *line)
+  {
+    const char* end = strchr(line, '\n');
+    if (!end) end = line + strlen(line);
+
+    char name[MAX_SYMBOL_LEN];
+    uint16_t addr;
+    if (parseLabel(line, end, name, &addr))
+    {
+      HleTrap* trap = findTrapNamed(name);
+      if (trap) trapAddrs[trap - traps] = addr;
+      for (int i = 0; i < SYM_COUNT; ++i)
+      {
+        if (strcmp(name, symbolNames[i]) == 0) symbols[i] = addr;
+      }
+    }
+    line = *end ? end + 1 : end;
+  }
+
+  int installed = 0;
+  for (size_t i = 0; i < trapCount; ++i)
+  {
+    if (trapAddrs[i] < 0) continue;
+
+    int haveSymbols = 1;
+    for (int s = 0; s < SYM_COUNT; ++s)
+    {
+      if ((traps[i].needs & (1 << s)) && symbols[s] < 0) haveSymbols = 0;
+    }
+    if (!haveSymbols) continue;
+
+    traps[i].addr = trapAddrs[i];
+    set6502Trap(hleCpuDevice, (uint16_t)trapAddrs[i], 1);
+    ++installed;
+  }
+  return installed;
+}
+
+int hleSetTrapCost(const char* name, uint32_t cycles)
+{
+  HleTrap* trap = findTrapNamed(name);
+  if (!trap) return 0;
+
+  trap->cycles = cycles;
+  return 1;
+}
+
+int32_t hleAddress(const char* name)
+{
+  HleTrap* trap = findTrapNamed(name);
+  if (trap) return trap->addr;
+
+  for (int i = 0; i < SYM_COUNT; ++i)
+  {
+    if (strcmp(name, symbolNames[i]) == 0) return symbols[i];
+  }
+  return -1;
+}
+
+void hlePrintStats(FILE* out)
+{
+  for (size_t i = 0; i < trapCount; ++i)
+  {
+    if (traps[i].addr < 0) continue;
+    fprintf(out, "  trap %-8s at $%04X: %llu calls\n", traps[i].name, (unsigned)traps[i].addr,
+      (unsigned long long)traps[i].hits);
+  }
+}
@@ -0,0 +1,81 @@
+/*
+ * DB6502 Emulator - High-level emulation of ROM routines
+ *
+ * Native replacements for hot BIOS and BASIC routines, installed as CPU
+ * traps at the addresses the ROM's label file gives them.
+ */
+
+#ifndef _DB6502_HLE_H_
+#define _DB6502_HLE_H_
+
+#include "devices/device.h"
+#include "devices/6502_device.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* a trap's handler, run instead of the instruction at addr. it does the
+ * routine's work on guest memory and regs and returns non-zero, or returns
+ * 0 (leaving regs alone) for the ROM code to run instead */
+typedef int (*HleHandler)(uint16_t addr, HBC56CpuRegs* regs);
+
+/* Function:  hleInit
+ * --------------------
+ * route the CPU device's traps to the registry, and register the built in
+ * traps (CHROUT, TXDELAY, FMULT, FDIV, BLTU2)
+ */
+void hleInit(HBC56Device* cpuDevice);
+
+/* Function:  hleRegisterTrap
+ * --------------------
+ * trap the ROM symbol with handler (after hleInit()). a subroutine
+ * (returns non-zero) gets its RTS done by the trap. cycles are charged per
+ * call. registering a symbol again replaces its handler. installed by the
+ * next hleLoadTraps(). returns 0 if the registry is full (or the symbol
+ * is longer than a label can be)
+ */
+int hleRegisterTrap(const char* symbol, HleHandler handler, int returns, uint32_t cycles);
+
+/* Function:  hleLoadTraps
+ * --------------------
+ * replace the installed traps with the registered ones whose symbols are
+ * in the label file (ACME "NAME = $XXXX" or VICE "al XXXXXX .NAME" lines).
+ * returns the number installed
+ */
+int hleLoadTraps(const char* labelFileContents);
+
+/* Function:  hleClearTraps
+ * --------------------
+ * remove every trap (a new ROM without labels)
+ */
+void hleClearTraps();
+
+/* Function:  hleSetTrapCost
+ * --------------------
+ * cycles charged for each call of the named trap (before its RTS).
+ * returns 0 if there is no trap of that name
+ */
+int hleSetTrapCost(const char* name, uint32_t cycles);
+
+/* Function:  hleAddress
+ * --------------------
+ * address of a trap or a symbol a handler uses, as the last label file
+ * gave it. -1 if it has none (or the trap isn't installed)
+ */
+int32_t hleAddress(const char* name);
+
+/* Function:  hlePrintStats
+ * --------------------
+ * print each installed trap and how often it ran
+ */
+void hlePrintStats(FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
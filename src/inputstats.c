@@ -0,0 +1,66 @@
+/*
+ * DB6502 Emulator - Input latency
+ *
+ * The core stamps each polled key with the emulated cycle its poll maps to
+ * on the paced clock, and hands it to the device no earlier than that. The
+ * queue time is from there to the hand over. The read time runs on to the
+ * guest's first read of the device's data register after it, which is when
+ * the program can have seen the key. One key per path is timed at a time:
+ * keys handed over before that read aren't timed to it.
+ */
+
+#include "inputstats.h"
+
+#include <string.h>
+
+typedef struct
+{
+  InputLatencyStats stats;
+  int               pending;
+  uint64_t          pendingCycle;   /* polled cycle of the key being timed */
+} PathStats;
+
+static const char* pathNames[INPUT_PATHS] = { "Keyboard", "ACIA" };
+static PathStats pathStats[INPUT_PATHS];
+
+
+void inputStatsInjected(InputPath path, uint64_t polledCycle, uint64_t cycle)
+{
+  PathStats* p = &pathStats[path];
+  uint64_t queued = cycle > polledCycle ? cycle - polledCycle : 0;
+
+  ++p->stats.keys;
+  p->stats.queueCycles += queued;
+  if (queued > p->stats.queueMax) p->stats.queueMax = queued;
+
+  if (!p->pending)
+  {
+    p->pending = 1;
+    p->pendingCycle = polledCycle;
+  }
+}
+
+void inputStatsRead(InputPath path, uint64_t cycle)
+{
+  PathStats* p = &pathStats[path];
+  if (!p->pending) return;
+
+  uint64_t latency = cycle > p->pendingCycle ? cycle - p->pendingCycle : 0;
+  p->pending = 0;
+
+  if (!p->stats.reads || latency < p->stats.readMin) p->stats.readMin = latency;
+  if (latency > p->stats.readMax) p->stats.readMax = latency;
+  ++p->stats.reads;
+  p->stats.readCycles += latency;
+}
+
+void inputStatsGet(InputPath path, InputLatencyStats* stats)
+{
+  *stats = pathStats[path].stats;
+  stats->name = pathNames[path];
+}
+
+void inputStatsReset()
+{
+  memset(pathStats, 0, sizeof(pathStats));
+}
@@ -0,0 +1,66 @@
+/*
+ * DB6502 Emulator - Input latency
+ *
+ * Per input path (PS/2 keyboard, ACIA): how long host key presses took to
+ * be handed to the device, and to be read by the guest, in emulated
+ * cycles from the moment they were polled.
+ */
+
+#ifndef _DB6502_INPUTSTATS_H_
+#define _DB6502_INPUTSTATS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+  INPUT_PATH_KEYBOARD,    /* key events to the keyboard device (VIA1 port) */
+  INPUT_PATH_ACIA,        /* typed bytes to the ACIA */
+  INPUT_PATHS
+} InputPath;
+
+typedef struct
+{
+  const char* name;
+  uint64_t    keys;           /* presses handed to the device */
+  uint64_t    queueCycles;    /* from poll to device, in total */
+  uint64_t    queueMax;
+  uint64_t    reads;          /* presses the guest then read */
+  uint64_t    readCycles;     /* from poll to the guest's read, in total */
+  uint64_t    readMin;
+  uint64_t    readMax;
+} InputLatencyStats;
+
+/* Function:  inputStatsInjected
+ * --------------------
+ * a key polled at emulated cycle polledCycle was handed to the device at
+ * cycle. timed to the guest's next read unless an earlier one still is
+ */
+void inputStatsInjected(InputPath path, uint64_t polledCycle, uint64_t cycle);
+
+/* Function:  inputStatsRead
+ * --------------------
+ * the guest read the path's data register at cycle
+ */
+void inputStatsRead(InputPath path, uint64_t cycle);
+
+/* Function:  inputStatsGet
+ * --------------------
+ * stats for path
+ */
+void inputStatsGet(InputPath path, InputLatencyStats* stats);
+
+/* Function:  inputStatsReset
+ * --------------------
+ * clear the counts (on reset, and from the UI)
+ */
+void inputStatsReset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * DB6502 Emulator - Interrupt profiler
+ *
+ * The interrupt router reports each change of the asserted sources, and
+ * the CPU each interrupt entry and RTI. An IRQ entry is charged to every
+ * source asserted at that moment, up to the RTI that returns from it.
+ * Entries are kept on a small stack, so an NMI or BRK inside the handler
+ * is paired with its own RTI.
+ *
+ * A handler that doesn't acknowledge its device returns with the line
+ * still asserted, and the CPU takes the IRQ again at once. An entry within
+ * STORM_GAP_CYCLES of an RTI, for a source that has stayed asserted since,
+ * counts as a storm entry. STORM_RUN of them in a row flag the source as
+ * storming until it releases the line or the handler gets further.
+ */
+
+#include "irqstats.h"
+#include "hbc56emu.h"
+#include "devices/6502_device.h"
+
+#include <string.h>
+
+#define STORM_GAP_CYCLES  16    /* RTI, then at most one short instruction */
+#define STORM_RUN         64
+
+#define MAX_NESTING       8
+#define MAX_NAME_LEN      48
+
+typedef struct
+{
+  char        name[MAX_NAME_LEN];
+  uint64_t    asserts;
+  uint64_t    assertedCycles;
+  uint64_t    assertStart;
+  uint64_t    entries;
+  uint64_t    handlerCycles;
+  uint64_t    stormEntries;
+  uint32_t    stormRun;
+} SourceStats;
+
+typedef struct
+{
+  uint64_t    cycle;
+  uint8_t     sources;      /* 0 for NMI and BRK */
+} HandlerEntry;
+
+static HBC56Device* statsCpu = NULL;
+static uint64_t statsStart = 0;
+static SourceStats sourceStats[IRQ_STATS_SOURCES];
+static uint8_t assertedSources = 0;
+
+static HandlerEntry handlerStack[MAX_NESTING];
+static int handlerDepth = 0;    /* may exceed MAX_NESTING. deeper entries aren't timed */
+
+static uint64_t lastRtiCycle = 0;
+static uint8_t rtiSources = 0;  /* asserted at the last RTI, and ever since */
+
+
+static uint64_t now()
+{
+  return getCpuCycleCount(statsCpu);
+}
+
+static void irqEntry(uint8_t sources)
+{
+  uint64_t cycle = now();
+  int storm = lastRtiCycle && cycle - lastRtiCycle <= STORM_GAP_CYCLES;
+
+  for (int i = 0; i < IRQ_STATS_SOURCES; ++i)
+  {
+    SourceStats* source = &sourceStats[i];
+    if (!(sources & (1 << i))) continue;
+
+    ++source->entries;
+    if (storm && (rtiSources & (1 << i)))
+    {
+      ++source->stormEntries;
+      if (++source->stormRun == STORM_RUN)
+      {
+        SDL_Log("IRQ storm: IRQ %d (%s) is still asserted each time the handler returns. Does the handler acknowledge it?",
+          i + 1, source->name[0] ? source->name : "?");
+      }
+    }
+    else
+    {
+      source->stormRun = 0;
+    }
+  }
+
+  if (handlerDepth < MAX_NESTING)
+  {
+    handlerStack[handlerDepth].cycle = cycle;
+    handlerStack[handlerDepth].sources = sources;
+  }
+  ++handlerDepth;
+}
+
+static void rti()
+{
+  /* an RTI with nothing entered (a ROM using it as a jump) times nothing */
+  if (handlerDepth == 0) return;
+  if (--handlerDepth >= MAX_NESTING) return;
+
+  uint64_t cycle = now();
+  const HandlerEntry* entry = &handlerStack[handlerDepth];
+  for (int i = 0; i < IRQ_STATS_SOURCES; ++i)
+  {
+    if (entry->sources & (1 << i)) sourceStats[i].handlerCycles += cycle - entry->cycle;
+  }
+
+  if (entry->sources)
+  {
+    lastRtiCycle = cycle;
+    rtiSources = assertedSources;
+  }
+}
+
+static void cpuEvent(Cpu65xxEvent event)
+{
+  switch (event)
+  {
+    case CPU65XX_EVENT_IRQ:
+      irqEntry(assertedSources);
+      break;
+
+    case CPU65XX_EVENT_NMI:
+    case CPU65XX_EVENT_BRK:
+      irqEntry(0);
+      break;
+
+    case CPU65XX_EVENT_RTI:
+      rti();
+      break;
+  }
+}
+
+void irqStatsInit(HBC56Device* cpuDevice)
+{
+  statsCpu = cpuDevice;
+  set6502EventHook(cpuDevice, cpuEvent);
+  irqStatsReset();
+}
+
+void irqStatsNameSource(uint8_t irq, const char* name)
+{
+  if (irq == 0 || irq > IRQ_STATS_SOURCES) return;
+
+  char* sourceName = sourceStats[irq - 1].name;
+  size_t len = strlen(sourceName);
+  if (len) SDL_snprintf(sourceName + len, MAX_NAME_LEN - len, "/%s", name);
+  else SDL_strlcpy(sourceName, name, MAX_NAME_LEN);
+}
+
+void irqStatsSources(uint8_t sources)
+{
+  uint8_t raised = sources & ~assertedSources;
+  uint8_t released = assertedSources & ~sources;
+  if (!raised && !released) return;
+
+  uint64_t cycle = now();
+  for (int i = 0; i < IRQ_STATS_SOURCES; ++i)
+  {
+    SourceStats* source = &sourceStats[i];
+    if (raised & (1 << i))
+    {
+      ++source->asserts;
+      source->assertStart = cycle;
+    }
+    else if (released & (1 << i))
+    {
+      source->assertedCycles += cycle - source->assertStart;
+      source->stormRun = 0;
+    }
+  }
+
+  assertedSources = sources;
+  rtiSources &= sources;
+}
+
+int irqStatsGet(uint8_t irq, IrqSourceStats* stats)
+{
+  if (irq == 0 || irq > IRQ_STATS_SOURCES) return 0;
+
+  const SourceStats* source = &sourceStats[irq - 1];
+  if (!source->name[0] && !source->asserts) return 0;
+
+  stats->name = source->name;
+  stats->asserts = source->asserts;
+  stats->assertedCycles = source->assertedCycles;
+  if (assertedSources & (1 << (irq - 1))) stats->assertedCycles += now() - source->assertStart;
+  stats->entries = source->entries;
+  stats->handlerCycles = source->handlerCycles;
+  stats->stormEntries = source->stormEntries;
+  stats->storming = source->stormRun >= STORM_RUN;
+  return 1;
+}
+
+uint64_t irqStatsCycles()
+{
+  return now() - statsStart;
+}
+
+void irqStatsReset()
+{
+  uint64_t cycle = now();
+  statsStart = cycle;
+  for (int i = 0; i < IRQ_STATS_SOURCES; ++i)
+  {
+    SourceStats* source = &sourceStats[i];
+    source->asserts = 0;
+    source->assertedCycles = 0;
+    source->assertStart = cycle;
+    source->entries = 0;
+    source->handlerCycles = 0;
+    source->stormEntries = 0;
+    source->stormRun = 0;
+  }
+  handlerDepth = 0;
+  lastRtiCycle = 0;
+  rtiSources = 0;
+}
+
+void irqStatsPrint(FILE* out)
+{
+  IrqSourceStats stats;
+  uint64_t cycles = irqStatsCycles();
+  for (uint8_t irq = 1; irq <= IRQ_STATS_SOURCES; ++irq)
+  {
+    if (!irqStatsGet(irq, &stats) || !stats.asserts) continue;
+
+    fprintf(out, "  IRQ %u %-12s: %llu asserts, asserted %.2f%%, %llu handler entries, %llu handler cycles (%.2f%%)",
+      irq, stats.name[0] ? stats.name : "?", (unsigned long long)stats.asserts,
+      cycles ? 100.0 * stats.assertedCycles / cycles : 0.0, (unsigned long long)stats.entries,
+      (unsigned long long)stats.handlerCycles, cycles ? 100.0 * stats.handlerCycles / cycles : 0.0);
+    if (stats.stormEntries)
+    {
+      fprintf(out, ", %llu storm entries%s", (unsigned long long)stats.stormEntries,
+        stats.storming ? " (STORMING)" : "");
+    }
+    fprintf(out, "\n");
+  }
+}
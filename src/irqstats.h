@@ -0,0 +1,81 @@
+/*
+ * DB6502 Emulator - Interrupt profiler
+ *
+ * Per IRQ source: how often it asserted the line and for how long, and
+ * the cycles the CPU spent in the handler for it. Flags a source that is
+ * still asserted every time the handler returns (an interrupt storm).
+ */
+
+#ifndef _DB6502_IRQSTATS_H_
+#define _DB6502_IRQSTATS_H_
+
+#include "devices/device.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IRQ_STATS_SOURCES  8   /* IRQ numbers 1 to 8 */
+
+typedef struct
+{
+  const char* name;           /* the devices wired to it */
+  uint64_t    asserts;        /* times it raised (or triggered) the line */
+  uint64_t    assertedCycles; /* cycles it held it, up to now */
+  uint64_t    entries;        /* IRQs taken while it was asserted */
+  uint64_t    handlerCycles;  /* cycles from those entries to their RTI */
+  uint64_t    stormEntries;   /* entries straight after an RTI it was still asserted at */
+  int         storming;       /* the last STORM_RUN entries were all like that */
+} IrqSourceStats;
+
+/* Function:  irqStatsInit
+ * --------------------
+ * hook the CPU device's interrupt entries and RTIs
+ */
+void irqStatsInit(HBC56Device* cpuDevice);
+
+/* Function:  irqStatsNameSource
+ * --------------------
+ * name a device wired to irq (0 is not wired)
+ */
+void irqStatsNameSource(uint8_t irq, const char* name);
+
+/* Function:  irqStatsSources
+ * --------------------
+ * the asserted sources changed. bit n is IRQ number n + 1
+ */
+void irqStatsSources(uint8_t sources);
+
+/* Function:  irqStatsGet
+ * --------------------
+ * stats for irq (1 to IRQ_STATS_SOURCES). returns 0 if nothing is wired
+ * to it and it has never asserted
+ */
+int irqStatsGet(uint8_t irq, IrqSourceStats* stats);
+
+/* Function:  irqStatsCycles
+ * --------------------
+ * cycles the counts cover (since the last reset)
+ */
+uint64_t irqStatsCycles();
+
+/* Function:  irqStatsReset
+ * --------------------
+ * clear the counts (on reset, and from the UI)
+ */
+void irqStatsReset();
+
+/* Function:  irqStatsPrint
+ * --------------------
+ * print the stats of each source that has asserted
+ */
+void irqStatsPrint(FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * DB6502 Emulator - PS/2 keyboard on VIA1 port A
+ *
+ * The HBC-56 keyboard device turns key events into PS/2 codes and queues
+ * them. On the HBC-56 the CPU reads that queue directly, but on the DB6502
+ * the keyboard sits behind VIA1, which owns the whole of $9000-$900F. So
+ * the keyboard device isn't on the bus, and its codes are shown through
+ * the VIA instead: one at a time, latched on port A with CA1 set in IFR
+ * until the guest reads ORA. Only then does the next code leave the
+ * keyboard device's queue, which is what paces pasted keys.
+ *
+ * Port A is taken to be all inputs. IRQs on CA1 aren't raised (VIA1's IRQ
+ * isn't wired up), so the guest polls IFR or ORA.
+ */
+
+#include "kbport.h"
+#include "devices/keyboard_device.h"
+
+#define VIA_REG_ORA       0x01
+#define VIA_REG_IFR       0x0d
+#define VIA_REG_IER       0x0e
+#define VIA_REG_ORA_NH    0x0f
+
+#define VIA_IFR_CA1       0x02
+#define VIA_IFR_IRQ       0x80
+
+static HBC56Device* kbDevice = NULL;
+static uint16_t kbDataAddr = 0;
+static HBC56Device* viaDevice = NULL;
+static uint16_t viaBaseAddr = 0;
+
+static uint8_t portCode = 0;      /* on the pins until the next one */
+static int portFull = 0;          /* not yet acknowledged (CA1 set) */
+
+
+void kbPortInit(HBC56Device* kb, uint16_t kbAddr, HBC56Device* via, uint16_t viaAddr)
+{
+  kbDevice = kb;
+  kbDataAddr = kbAddr;
+  viaDevice = via;
+  viaBaseAddr = viaAddr;
+  kbPortReset();
+}
+
+void kbPortReset()
+{
+  portCode = 0;
+  portFull = 0;
+}
+
+int kbPortRegister(uint16_t addr)
+{
+  uint16_t reg = (uint16_t)(addr - viaBaseAddr);
+  return kbDevice && (reg == VIA_REG_ORA || reg == VIA_REG_IFR || reg == VIA_REG_ORA_NH);
+}
+
+uint8_t kbPortRead(uint16_t addr, uint8_t val, int dbg, int* taken)
+{
+  *taken = 0;
+  if (!kbPortRegister(addr)) return val;
+
+  /* the next code arrives once the last one was acknowledged */
+  if (!dbg && !portFull && !keyboardDeviceQueueEmpty(kbDevice))
+  {
+    readDevice(kbDevice, kbDataAddr, &portCode, 0);
+    portFull = 1;
+  }
+
+  switch ((uint16_t)(addr - viaBaseAddr))
+  {
+    case VIA_REG_ORA:
+      if (!dbg && portFull)
+      {
+        portFull = 0;
+        *taken = 1;
+      }
+      return portCode;
+
+    case VIA_REG_ORA_NH:
+      return portCode;
+
+    default:
+      if (portFull)
+      {
+        uint8_t ier = 0;
+        readDevice(viaDevice, (uint16_t)(viaBaseAddr + VIA_REG_IER), &ier, 1);
+        val |= VIA_IFR_CA1;
+        if (ier & VIA_IFR_CA1) val |= VIA_IFR_IRQ;
+      }
+      return val;
+  }
+}
@@ -0,0 +1,52 @@
+/*
+ * DB6502 Emulator - PS/2 keyboard on VIA1 port A
+ *
+ * The keyboard interface drives VIA1's port A pins with each code it
+ * receives and pulses CA1. The guest sees the code in ORA, and reading
+ * ORA acknowledges it (clears CA1) and lets the next one in.
+ */
+
+#ifndef _DB6502_KBPORT_H_
+#define _DB6502_KBPORT_H_
+
+#include "devices/device.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Function:  kbPortInit
+ * --------------------
+ * take codes from the keyboard device (its data register at kbAddr) and
+ * show them on the port of the VIA at viaAddr
+ */
+void kbPortInit(HBC56Device* kb, uint16_t kbAddr, HBC56Device* via, uint16_t viaAddr);
+
+/* Function:  kbPortReset
+ * --------------------
+ * drop the code on the port
+ */
+void kbPortReset();
+
+/* Function:  kbPortRegister
+ * --------------------
+ * non-zero if the keyboard shows through the VIA register at addr
+ * (ORA, ORA without handshake, IFR)
+ */
+int kbPortRegister(uint16_t addr);
+
+/* Function:  kbPortRead
+ * --------------------
+ * the VIA register at addr read as val. returns what the guest sees
+ * instead. *taken is set if the read acknowledged a code. debugger reads
+ * (dbg) change nothing
+ */
+uint8_t kbPortRead(uint16_t addr, uint8_t val, int dbg, int* taken);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
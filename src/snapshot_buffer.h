@@ -0,0 +1,55 @@
+/*
+ * DB6502 Emulator - Lock-free snapshot buffer
+ *
+ * Double buffering for state the emulation core publishes to the UI, with
+ * a spare buffer in the middle so neither side ever waits: the core fills
+ * the back buffer and swaps it into the middle, the UI swaps the middle
+ * into the front when a newer snapshot is there.
+ *
+ * Exactly one thread may call back() and publish(), and exactly one thread
+ * may call latest(). The back buffer holds stale contents after a publish,
+ * so the producer must rewrite everything the consumer reads.
+ */
+
+#ifndef _DB6502_SNAPSHOT_BUFFER_H_
+#define _DB6502_SNAPSHOT_BUFFER_H_
+
+#include <atomic>
+#include <stdint.h>
+
+template <typename T>
+class SnapshotBuffer
+{
+public:
+  /* producer: the buffer to fill before publish() */
+  T& back()
+  {
+    return buffers[backIdx];
+  }
+
+  void publish()
+  {
+    backIdx = middleIdx.exchange(backIdx | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+  }
+
+  /* consumer: the most recently published snapshot */
+  const T& latest()
+  {
+    if (middleIdx.load(std::memory_order_relaxed) & FRESH)
+    {
+      frontIdx = middleIdx.exchange(frontIdx, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+    return buffers[frontIdx];
+  }
+
+private:
+  static const uint8_t FRESH = 0x80;
+  static const uint8_t INDEX_MASK = 0x03;
+
+  T buffers[3] = {};
+  uint8_t backIdx = 0;
+  alignas(64) std::atomic<uint8_t> middleIdx{ 1 };
+  alignas(64) uint8_t frontIdx = 2;
+};
+
+#endif
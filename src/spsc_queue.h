@@ -0,0 +1,69 @@
+/*
+ * DB6502 Emulator - Single producer, single consumer queue
+ *
+ * Bounded lock-free ring buffer used to hand input from the UI event
+ * thread to the emulation core without taking a lock on either side.
+ *
+ * Exactly one thread may call push(), and exactly one thread may call
+ * empty(), front() and pop().
+ */
+
+#ifndef _DB6502_SPSC_QUEUE_H_
+#define _DB6502_SPSC_QUEUE_H_
+
+#include <atomic>
+#include <stddef.h>
+
+template <typename T, size_t SIZE>
+class SpscQueue
+{
+  static_assert((SIZE & (SIZE - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+  /* producer: returns false (and drops the item) if the queue is full */
+  bool push(const T& item)
+  {
+    size_t head = headIdx.load(std::memory_order_relaxed);
+    if (head - tailIdx.load(std::memory_order_acquire) >= SIZE) return false;
+
+    items[head & (SIZE - 1)] = item;
+    headIdx.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* producer: free slots. the consumer can only free more meanwhile, so
+   * that many pushes will succeed */
+  size_t room() const
+  {
+    return SIZE - (headIdx.load(std::memory_order_relaxed) - tailIdx.load(std::memory_order_acquire));
+  }
+
+  /* consumer */
+  bool empty() const
+  {
+    return tailIdx.load(std::memory_order_relaxed) == headIdx.load(std::memory_order_acquire);
+  }
+
+  const T& front() const
+  {
+    return items[tailIdx.load(std::memory_order_relaxed) & (SIZE - 1)];
+  }
+
+  void pop()
+  {
+    tailIdx.store(tailIdx.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /* consumer: discard everything queued so far */
+  void clear()
+  {
+    tailIdx.store(headIdx.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+private:
+  alignas(64) std::atomic<size_t> headIdx{ 0 };
+  alignas(64) std::atomic<size_t> tailIdx{ 0 };
+  T items[SIZE];
+};
+
+#endif
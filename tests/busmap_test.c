@@ -0,0 +1,177 @@
+/*
+ * DB6502 Emulator - address decoder test
+ *
+ * Maps RAM, ROM and the I/O devices over the DB6502 memory map in
+ * config.h, as the emulator does. Every I/O register must go to its
+ * device, with the ROM under it as the fallback for any register the
+ * device doesn't decode, and every other address must go to the ROM or
+ * RAM, whatever order the mappings were added in.
+ */
+
+#include "busmap.h"
+#include "db6502emu.h"
+
+#include <stdio.h>
+
+static HBC56Device ram;
+static HBC56Device rom;
+static HBC56Device tms;
+static HBC56Device ay;
+static HBC56Device acia;
+static HBC56Device via2;
+static HBC56Device via;
+
+static uint8_t ramBuffer[HBC56_RAM_SIZE];
+static uint8_t romBuffer[HBC56_ROM_SIZE];
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); ++failures; } } while (0)
+
+static const struct
+{
+  HBC56Device*  device;
+  const char*   name;
+  uint16_t      addr;
+  uint16_t      size;
+} io[] = {
+  { &tms,  "TMS9918", HBC56_TMS9918_DAT_ADDR, HBC56_TMS9918_SIZE },
+  { &ay,   "AY-3-8910", HBC56_AY38910_A_ADDR, HBC56_AY38910_SIZE },
+  { &acia, "ACIA",    HBC56_ACIA_ADDR,        HBC56_ACIA_SIZE },
+  { &via2, "VIA2",    HBC56_VIA2_ADDR,        HBC56_VIA2_SIZE },
+  { &via,  "VIA1",    HBC56_VIA_ADDR,         HBC56_VIA_SIZE },
+};
+
+#define IO_COUNT (int)(sizeof(io) / sizeof(io[0]))
+
+static HBC56Device* owner(uint16_t addr)
+{
+  const BusMapping* mapping = busMapOwner(addr);
+  return mapping ? mapping->device : NULL;
+}
+
+static HBC56Device* fallback(uint16_t addr)
+{
+  const BusMapping* mapping = busMapFallback(addr);
+  return mapping ? mapping->device : NULL;
+}
+
+static void mapMemory(HBC56Device* device, uint32_t start, uint32_t end, uint8_t* buffer, int writable)
+{
+  CHECK(busMapAdd(device, start, end, HBC56_BUS_PRIORITY_MEMORY, buffer, writable), "memory not mapped at $%04x", start);
+}
+
+static void mapIo()
+{
+  for (int i = 0; i < IO_COUNT; ++i)
+  {
+    CHECK(busMapAdd(io[i].device, io[i].addr, io[i].addr + io[i].size, HBC56_BUS_PRIORITY_IO, NULL, 0),
+          "%s not mapped", io[i].name);
+  }
+}
+
+static int ioDevice(uint16_t addr)
+{
+  for (int i = 0; i < IO_COUNT; ++i)
+  {
+    if ((uint16_t)(addr - io[i].addr) < io[i].size) return i;
+  }
+  return -1;
+}
+
+static void checkMemoryMap(const char* order)
+{
+  for (uint32_t addr = 0; addr < 0x10000; ++addr)
+  {
+    int i = ioDevice((uint16_t)addr);
+    if (i >= 0)
+    {
+      CHECK(owner((uint16_t)addr) == io[i].device, "%s: $%04x not %s", order, addr, io[i].name);
+      CHECK(fallback((uint16_t)addr) == &rom, "%s: $%04x doesn't fall through to the ROM", order, addr);
+    }
+    else if (addr < HBC56_RAM_END)
+    {
+      CHECK(owner((uint16_t)addr) == &ram, "%s: $%04x not RAM", order, addr);
+      CHECK(fallback((uint16_t)addr) == NULL, "%s: $%04x has a fallback", order, addr);
+    }
+    else
+    {
+      CHECK(owner((uint16_t)addr) == &rom, "%s: $%04x not ROM", order, addr);
+      CHECK(fallback((uint16_t)addr) == NULL, "%s: $%04x has a fallback", order, addr);
+    }
+  }
+
+  for (int i = 0; i < IO_COUNT; ++i)
+  {
+    /* an I/O page isn't served as plain memory */
+    CHECK(busMapPageOwner(io[i].addr >> 8) == NULL, "%s: %s page has a single owner", order, io[i].name);
+  }
+
+  const BusMapping* page = busMapPageOwner(0x00);
+  CHECK(page && page->device == &ram && page->memory == ramBuffer && page->writable, "%s: page $00 not RAM", order);
+  page = busMapPageOwner(0xff);
+  CHECK(page && page->device == &rom && page->memory == romBuffer && !page->writable, "%s: page $ff not ROM", order);
+  page = busMapPageOwner(0x81);
+  CHECK(page && page->device == &rom, "%s: page $81 not ROM", order);
+}
+
+/* the emulator maps RAM and the devices, then the ROM once it's loaded */
+static void testRomLast()
+{
+  busMapReset();
+  mapMemory(&ram, HBC56_RAM_START, HBC56_RAM_END, ramBuffer, 1);
+  mapIo();
+  mapMemory(&rom, HBC56_ROM_START, HBC56_ROM_END, romBuffer, 0);
+  checkMemoryMap("ROM last");
+}
+
+static void testRomFirst()
+{
+  busMapReset();
+  mapMemory(&rom, HBC56_ROM_START, HBC56_ROM_END, romBuffer, 0);
+  mapMemory(&ram, HBC56_RAM_START, HBC56_RAM_END, ramBuffer, 1);
+  mapIo();
+  checkMemoryMap("ROM first");
+}
+
+/* equal priorities: the first mapping owns, the second is under it */
+static void testEqualPriority()
+{
+  busMapReset();
+  mapMemory(&rom, HBC56_ROM_START, HBC56_ROM_END, romBuffer, 0);
+  busMapAdd(&via, 0x9000, 0x9010, HBC56_BUS_PRIORITY_IO, NULL, 0);
+  busMapAdd(&via2, 0x9008, 0x9018, HBC56_BUS_PRIORITY_IO, NULL, 0);
+
+  CHECK(owner(0x9008) == &via && fallback(0x9008) == &via2, "overlap: $9008 not VIA1 over VIA2");
+  CHECK(owner(0x9010) == &via2 && fallback(0x9010) == &rom, "overlap: $9010 not VIA2 over ROM");
+  CHECK(owner(0x9018) == &rom, "overlap: $9018 not ROM");
+
+  const BusMapping* mapping = busMapFind(&via2);
+  CHECK(mapping && mapping->startAddr == 0x9008, "VIA2 mapping not found");
+  CHECK(busMapFind(&acia) == NULL, "unmapped ACIA found");
+}
+
+static void testRejects()
+{
+  busMapReset();
+  CHECK(!busMapAdd(NULL, 0x8000, 0x8010, HBC56_BUS_PRIORITY_IO, NULL, 0), "no device mapped");
+  CHECK(!busMapAdd(&via, 0x9010, 0x9010, HBC56_BUS_PRIORITY_IO, NULL, 0), "empty window mapped");
+  CHECK(busMapAdd(&rom, 0xff00, 0x20000, HBC56_BUS_PRIORITY_MEMORY, romBuffer, 0), "window past $ffff not clipped");
+  CHECK(owner(0xffff) == &rom && owner(0x0000) == NULL, "clipped window wrapped");
+}
+
+int main()
+{
+  testRomLast();
+  testRomFirst();
+  testEqualPriority();
+  testRejects();
+
+  if (failures)
+  {
+    printf("busmap: %d failures\n", failures);
+    return 1;
+  }
+  printf("busmap: ok\n");
+  return 0;
+}
@@ -0,0 +1,448 @@
+/*
+ * DB6502 Emulator - cpu65xx threaded blocks and superinstructions
+ *
+ * Loops run to the end both interpreted (cpu65xxInstCycle) and threaded
+ * (cpu65xxRunBlock), and must finish with the same registers, memory, bus
+ * writes, device reads and cycle count. Single blocks are then run hot and
+ * checked against hand-counted cycles: block translation, the exits on a
+ * write to the block's own page and on a device access, the maxCycles
+ * budget, and each superinstruction taken, not taken and across a page.
+ * Every model is run.
+ */
+
+#include "cpu65xx_harness.h"
+
+#include <vector>
+
+#define IO_PAGE     0xc0
+#define HOT_COUNT   8           /* entries before an address gets a block */
+#define CYCLE_LIMIT 10000000u
+
+#define FLAG_C      0x01
+#define FLAG_Z      0x02
+#define FLAG_D      0x08
+#define FLAG_N      0x80
+
+enum { DEX_BNE, DEY_BNE, CMP_BEQ, CMP_BNE, COPY_INY };
+
+struct Code
+{
+  uint16_t             addr;
+  std::vector<uint8_t> bytes;
+};
+
+typedef std::vector<Code> Program;
+
+static TestMachine interp;
+static TestMachine threaded;
+static const char* modelName = "";
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("%s: ", modelName); printf(__VA_ARGS__); printf("\n"); ++failures; } } while (0)
+
+
+/* ---- helpers ---- */
+
+static bool cmos(Cpu65xxModel model)
+{
+  return model == CPU65XX_65C02 || model == CPU65XX_W65C02;
+}
+
+static void machineInit(TestMachine* m, Cpu65xxModel model, const Program& program)
+{
+  memset(m->mem, 0, sizeof(m->mem));
+  for (int i = 0; i < 0x100; ++i) m->mem[0x0600 + i] = (i & 3) ? (uint8_t)(i * 7) : 0x40;
+  for (const Code& code : program) memcpy(m->mem + code.addr, code.bytes.data(), code.bytes.size());
+  testMachineInit(m, model, IO_PAGE);
+}
+
+static uint64_t fusionCount(TestMachine* m, int index)
+{
+  return cpu65xxFusionCount(m->cpu, index);
+}
+
+/* run from pc until a branch or jump to itself. returns the cycles */
+static uint64_t runToTrap(TestMachine* m, uint16_t pc, bool blocks)
+{
+  cpu65xxSetPC(m->cpu, pc);
+  uint64_t cycles = 0;
+  while (cycles < CYCLE_LIMIT)
+  {
+    cycles += blocks ? testRunBlock(m, 1000) : testStep(m);
+    if (cpu65xxGetInstPC(m->cpu) == cpu65xxGetPC(m->cpu)) break;
+  }
+  return cycles;
+}
+
+/* run the block at pc from the same registers until it is hot. returns
+ * the cycles of the last run, which is the block's first */
+static uint32_t runHot(TestMachine* m, uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t p)
+{
+  uint32_t cycles = 0;
+  for (int i = 0; i < HOT_COUNT; ++i)
+  {
+    testSetRegs(m, pc, a, x, y, 0xff, p);
+    cycles = testRunBlock(m, 1000);
+  }
+  return cycles;
+}
+
+/* count instructions from the same state, interpreted on a fresh machine */
+static uint32_t runInterp(Cpu65xxModel model, const Program& program, int count,
+                          uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t p)
+{
+  machineInit(&interp, model, program);
+  testSetRegs(&interp, pc, a, x, y, 0xff, p);
+  uint32_t cycles = 0;
+  for (int i = 0; i < count; ++i) cycles += testStep(&interp);
+  return cycles;
+}
+
+static void checkSameRegs(const char* name)
+{
+  const char* differs = testRegsDiffer(&interp, &threaded);
+  CHECK(!*differs, "%s: %s differs from the interpreter", name, differs);
+  if (*differs)
+  {
+    testPrintRegs("interp", &interp);
+    testPrintRegs("threaded", &threaded);
+  }
+}
+
+
+/* ---- loops, interpreted against threaded ---- */
+
+/* the loop at pc, interpreted and threaded from the same state, must end
+ * the same. setup() prepares both machines. fusion (if not -1) must have
+ * run at least once */
+static void compareLoop(const char* name, Cpu65xxModel model, const Program& program,
+                        uint16_t pc, void (*setup)(TestMachine*), int fusion)
+{
+  machineInit(&interp, model, program);
+  machineInit(&threaded, model, program);
+  if (setup)
+  {
+    setup(&interp);
+    setup(&threaded);
+  }
+
+  uint64_t interpCycles = runToTrap(&interp, pc, false);
+  uint64_t threadedCycles = runToTrap(&threaded, pc, true);
+
+  checkSameRegs(name);
+  CHECK(interpCycles < CYCLE_LIMIT, "%s: never ended", name);
+  CHECK(interpCycles == threadedCycles, "%s: %llu cycles interpreted, %llu threaded", name,
+    (unsigned long long)interpCycles, (unsigned long long)threadedCycles);
+  CHECK(memcmp(interp.mem, threaded.mem, sizeof(interp.mem)) == 0, "%s: memory differs", name);
+  CHECK(interp.writeCount == threaded.writeCount &&
+        memcmp(interp.writes, threaded.writes, sizeof(interp.writes)) == 0, "%s: device writes differ", name);
+  CHECK(interp.ioReads == threaded.ioReads, "%s: %llu device reads interpreted, %llu threaded", name,
+    (unsigned long long)interp.ioReads, (unsigned long long)threaded.ioReads);
+
+  for (int i = 0; i < CPU65XX_FUSION_COUNT; ++i)
+  {
+    CHECK(fusionCount(&interp, i) == 0, "%s: the interpreter fused %s", name, cpu65xxFusionName(i));
+    if (i == fusion) CHECK(fusionCount(&threaded, i) > 0, "%s: %s never fused", name, cpu65xxFusionName(i));
+  }
+
+  testMachineDestroy(&interp);
+  testMachineDestroy(&threaded);
+}
+
+static void setupCopy(TestMachine* m)
+{
+  m->mem[0x10] = 0xf0; m->mem[0x11] = 0x06;     /* from $06F0: crosses a page at Y=$10 */
+  m->mem[0x12] = 0x00; m->mem[0x13] = 0x07;
+}
+
+static void setupCopyFromIo(TestMachine* m)
+{
+  m->mem[0x10] = 0xf0; m->mem[0x11] = IO_PAGE;
+  m->mem[0x12] = 0x00; m->mem[0x13] = 0x07;
+}
+
+static void setupCopyToIo(TestMachine* m)
+{
+  m->mem[0x10] = 0x00; m->mem[0x11] = 0x06;
+  m->mem[0x12] = 0xf0; m->mem[0x13] = IO_PAGE;
+}
+
+static void setupDecimal(TestMachine* m)
+{
+  cpu65xxSetStatus(m->cpu, FLAG_D);
+}
+
+static void testLoops(Cpu65xxModel model)
+{
+  /* DEX; BNE back across a page: 4 cycles taken */
+  compareLoop("DEX; BNE across a page", model, {
+    { 0x04f0, { 0xa2, 0x00,                     /* LDX #0         */
+                0x4c, 0xfd, 0x04 } },           /* JMP $04FD      */
+    { 0x04fd, { 0xca, 0xd0, 0xfd } },           /* DEX, BNE $04FD */
+    { 0x0500, { 0x4c, 0x00, 0x05 } } },         /* JMP *          */
+    0x04f0, NULL, DEX_BNE);
+
+  compareLoop("DEY; BNE", model, {
+    { 0x0310, { 0xa0, 0x00,                     /* LDY #0         */
+                0x88, 0xd0, 0xfd,               /* DEY, BNE $0312 */
+                0x4c, 0x15, 0x03 } } },         /* JMP *          */
+    0x0310, NULL, DEY_BNE);
+
+  /* count matches and misses of #$40 in $0600-$06FF */
+  compareLoop("CMP #; BNE", model, {
+    { 0x0320, { 0xa2, 0x00,                     /* LDX #0         */
+                0xbd, 0x00, 0x06,               /* LDA $0600,X    */
+                0xc9, 0x40, 0xd0, 0x02,         /* CMP #$40, BNE  */
+                0xe6, 0x20,                     /* INC $20        */
+                0xe8, 0xd0, 0xf4,               /* INX, BNE $0322 */
+                0x4c, 0x2e, 0x03 } } },         /* JMP *          */
+    0x0320, NULL, CMP_BNE);
+
+  compareLoop("CMP #; BEQ", model, {
+    { 0x0320, { 0xa2, 0x00,
+                0xbd, 0x00, 0x06,
+                0xc9, 0x40, 0xf0, 0x02,         /* CMP #$40, BEQ  */
+                0xe6, 0x21,
+                0xe8, 0xd0, 0xf4,
+                0x4c, 0x2e, 0x03 } } },
+    0x0320, NULL, CMP_BEQ);
+
+  /* copy 256 bytes through (zp),Y pointers */
+  const Program copy = {
+    { 0x0380, { 0xa0, 0x00,                     /* LDY #0         */
+                0xb1, 0x10, 0x91, 0x12, 0xc8,   /* LDA, STA, INY  */
+                0xd0, 0xf9,                     /* BNE $0382      */
+                0x4c, 0x89, 0x03 } } };         /* JMP *          */
+  compareLoop("copy", model, copy, 0x0380, setupCopy, COPY_INY);
+  compareLoop("copy from a device", model, copy, 0x0380, setupCopyFromIo, -1);
+  compareLoop("copy to a device", model, copy, 0x0380, setupCopyToIo, -1);
+
+  /* BCD adds in a loop, so the decimal cycle is counted in blocks */
+  compareLoop("decimal ADC", model, {
+    { 0x03a0, { 0xa2, 0x00, 0xa9, 0x00,         /* LDX #0, LDA #0 */
+                0x18, 0x69, 0x07,               /* CLC, ADC #7    */
+                0xe8, 0xd0, 0xfa,               /* INX, BNE $03A4 */
+                0x85, 0x22,                     /* STA $22        */
+                0x4c, 0xac, 0x03 } } },         /* JMP *          */
+    0x03a0, setupDecimal, -1);
+}
+
+
+/* ---- single blocks ---- */
+
+static void testTranslation(Cpu65xxModel model)
+{
+  machineInit(&threaded, model, { { 0x0300, { 0xe8, 0x4c, 0x00, 0x03 } } });  /* INX, JMP $0300 */
+
+  for (int i = 1; i < HOT_COUNT; ++i)
+  {
+    testSetRegs(&threaded, 0x0300, 0, 0, 0, 0xff, 0);
+    uint32_t cycles = testRunBlock(&threaded, 1000);
+    CHECK(cycles == 2 && cpu65xxGetPC(threaded.cpu) == 0x0301, "entry %d of cold code ran %u cycles, not one INX", i, cycles);
+  }
+  testSetRegs(&threaded, 0x0300, 0, 0, 0, 0xff, 0);
+  uint32_t cycles = testRunBlock(&threaded, 1000);
+  CHECK(cycles == 5 && cpu65xxGetPC(threaded.cpu) == 0x0300, "hot block ran %u cycles, not INX and JMP", cycles);
+
+  /* the block needs 5 cycles: with fewer left only the INX runs */
+  testSetRegs(&threaded, 0x0300, 0, 0, 0, 0xff, 0);
+  cycles = testRunBlock(&threaded, 4);
+  CHECK(cycles == 2 && cpu65xxGetPC(threaded.cpu) == 0x0301, "block ran past a 4 cycle budget (%u cycles)", cycles);
+  testSetRegs(&threaded, 0x0300, 0, 0, 0, 0xff, 0);
+  cycles = testRunBlock(&threaded, 5);
+  CHECK(cycles == 5, "block didn't run in a 5 cycle budget (%u cycles)", cycles);
+
+  testMachineDestroy(&threaded);
+
+  /* an instruction running over the page end never gets a block, however
+   * often it is entered */
+  machineInit(&threaded, model, { { 0x03fe, { 0xad, 0x00, 0x06 } } });  /* LDA $0600 */
+  for (int i = 0; i < 2 * HOT_COUNT + 1; ++i)
+  {
+    testSetRegs(&threaded, 0x03fe, 0, 0, 0, 0xff, 0);
+    cycles = testRunBlock(&threaded, 1000);
+    CHECK(cycles == 4 && cpu65xxGetPC(threaded.cpu) == 0x0401, "entry %d of an LDA across a page: %u cycles to $%04X",
+      i + 1, cycles, cpu65xxGetPC(threaded.cpu));
+  }
+  testMachineDestroy(&threaded);
+}
+
+static void testBlockExits(Cpu65xxModel model)
+{
+  /* the STA rewrites the last INX, which the block has already decoded,
+   * with the INY in A */
+  machineInit(&threaded, model, {
+    { 0x0300, { 0xe8,                           /* INX            */
+                0x8d, 0x06, 0x03,               /* STA $0306      */
+                0xe8, 0xe8, 0xe8,               /* INX, INX, INX  */
+                0x4c, 0x00, 0x03 } } });        /* JMP $0300      */
+  uint32_t cycles = runHot(&threaded, 0x0300, 0xc8, 0, 0, 0);
+  CHECK(cycles == 2 + 4 && cpu65xxGetPC(threaded.cpu) == 0x0304 && cpu65xxGetX(threaded.cpu) == 1,
+    "block ran on after writing its own page (%u cycles, PC=$%04X)", cycles, cpu65xxGetPC(threaded.cpu));
+  for (int i = 0; i < 3; ++i) testRunBlock(&threaded, 1000);
+  CHECK(cpu65xxGetX(threaded.cpu) == 3 && cpu65xxGetY(threaded.cpu) == 1, "the rewritten instruction didn't run");
+  testMachineDestroy(&threaded);
+
+  /* writing another page doesn't end it, a device read does */
+  machineInit(&threaded, model, {
+    { 0x0300, { 0x8d, 0x05, 0x04,               /* STA $0405      */
+                0xe8,                           /* INX            */
+                0xad, 0x00, IO_PAGE,            /* LDA $C000      */
+                0xe8,                           /* INX            */
+                0x4c, 0x00, 0x03 } } });        /* JMP $0300      */
+  cycles = runHot(&threaded, 0x0300, 0x55, 0, 0, 0);
+  CHECK(cycles == 4 + 2 + 4 && cpu65xxGetPC(threaded.cpu) == 0x0307 && cpu65xxGetX(threaded.cpu) == 1,
+    "block didn't stop after a device read (%u cycles, PC=$%04X)", cycles, cpu65xxGetPC(threaded.cpu));
+  CHECK(cpu65xxGetAcc(threaded.cpu) == testIoValue((uint16_t)(IO_PAGE << 8)), "device read returned the wrong value");
+  testMachineDestroy(&threaded);
+}
+
+/* the hot block at pc fuses exactly once, takes expected cycles and ends
+ * as count instructions do interpreted */
+static void checkFused(const char* name, Cpu65xxModel model, const Program& program, int fusion, int count,
+                       uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t p, uint32_t expected)
+{
+  machineInit(&threaded, model, program);
+  uint32_t cycles = runHot(&threaded, pc, a, x, y, p);
+  uint32_t interpCycles = runInterp(model, program, count, pc, a, x, y, p);
+
+  CHECK(fusionCount(&threaded, fusion) == 1, "%s: fused %llu times, not once", name,
+    (unsigned long long)fusionCount(&threaded, fusion));
+  CHECK(cycles == expected && interpCycles == expected, "%s: %u cycles fused, %u interpreted, expected %u",
+    name, cycles, interpCycles, expected);
+  checkSameRegs(name);
+  CHECK(cpu65xxGetInstPC(threaded.cpu) == cpu65xxGetInstPC(interp.cpu), "%s: last instruction $%04X, expected $%04X",
+    name, cpu65xxGetInstPC(threaded.cpu), cpu65xxGetInstPC(interp.cpu));
+  CHECK(memcmp(interp.mem, threaded.mem, sizeof(interp.mem)) == 0, "%s: memory differs", name);
+
+  testMachineDestroy(&interp);
+  testMachineDestroy(&threaded);
+}
+
+static void testFusions(Cpu65xxModel model)
+{
+  /* DEX; BNE back across a page */
+  const Program dex = { { 0x04fd, { 0xca, 0xd0, 0xfd } }, { 0x0500, { 0x4c, 0x00, 0x05 } } };
+  checkFused("DEX; BNE taken across a page", model, dex, DEX_BNE, 2, 0x04fd, 0, 2, 0, 0, 2 + 4);
+  checkFused("DEX; BNE not taken", model, dex, DEX_BNE, 2, 0x04fd, 0, 1, 0, 0, 2 + 2);
+
+  const Program dey = { { 0x0312, { 0x88, 0xd0, 0xfd, 0x4c, 0x15, 0x03 } } };
+  checkFused("DEY; BNE taken", model, dey, DEY_BNE, 2, 0x0312, 0, 0, 0x80, 0, 2 + 3);
+  checkFused("DEY; BNE not taken", model, dey, DEY_BNE, 2, 0x0312, 0, 0, 1, FLAG_N, 2 + 2);
+
+  /* CMP #$40; BEQ forward across a page */
+  const Program beq = {
+    { 0x05fa, { 0xc9, 0x40, 0xf0, 0x02, 0x4c, 0xfe, 0x05 } },
+    { 0x0600, { 0x4c, 0x00, 0x06 } } };
+  checkFused("CMP #; BEQ taken across a page", model, beq, CMP_BEQ, 2, 0x05fa, 0x40, 0, 0, 0, 2 + 4);
+  checkFused("CMP #; BEQ not taken, carry", model, beq, CMP_BEQ, 2, 0x05fa, 0x41, 0, 0, FLAG_Z, 2 + 2);
+  checkFused("CMP #; BEQ not taken, borrow", model, beq, CMP_BEQ, 2, 0x05fa, 0x30, 0, 0, FLAG_C, 2 + 2);
+
+  const Program bne = { { 0x0360, { 0xc9, 0x40, 0xd0, 0x02, 0x4c, 0x64, 0x03, 0x4c, 0x66, 0x03 } } };
+  checkFused("CMP #; BNE taken", model, bne, CMP_BNE, 2, 0x0360, 0xc0, 0, 0, 0, 2 + 3);
+  checkFused("CMP #; BNE not taken", model, bne, CMP_BNE, 2, 0x0360, 0x40, 0, 0, FLAG_N, 2 + 2);
+  checkFused("CMP #; BNE in decimal mode", model, bne, CMP_BNE, 2, 0x0360, 0x09, 0, 0, FLAG_D, 2 + 3);
+
+  /* LDA (zp),Y; STA (zp),Y; INY, then JMP *: 5 + 6 + 2 + 3, +1 when the
+   * source crosses a page */
+  const Program copy = {
+    { 0x0010, { 0xf0, 0x06, 0x00, 0x07 } },     /* $06F0, $0700   */
+    { 0x0380, { 0xb1, 0x10, 0x91, 0x12, 0xc8, 0x4c, 0x85, 0x03 } } };
+  checkFused("copy", model, copy, COPY_INY, 4, 0x0380, 0, 0, 0x0f, 0, 5 + 6 + 2 + 3);
+  checkFused("copy across a page", model, copy, COPY_INY, 4, 0x0380, 0, 0, 0x10, 0, 5 + 1 + 6 + 2 + 3);
+  checkFused("copy to Y=0", model, copy, COPY_INY, 4, 0x0380, 0, 0, 0xff, 0, 5 + 1 + 6 + 2 + 3);
+}
+
+/* a copy from a device runs the LDA alone, and a copy over its own INY
+ * stops before it */
+static void testCopyFallbacks(Cpu65xxModel model)
+{
+  const Program fromIo = {
+    { 0x0010, { 0x00, IO_PAGE, 0x00, 0x07 } },
+    { 0x0380, { 0xb1, 0x10, 0x91, 0x12, 0xc8, 0x4c, 0x85, 0x03 } } };
+  machineInit(&threaded, model, fromIo);
+  uint32_t cycles = runHot(&threaded, 0x0380, 0, 0, 4, 0);
+  CHECK(cycles == 5 && cpu65xxGetPC(threaded.cpu) == 0x0382 && fusionCount(&threaded, COPY_INY) == 0,
+    "copy from a device: %u cycles to $%04X, not the LDA alone", cycles, cpu65xxGetPC(threaded.cpu));
+  CHECK(cpu65xxGetAcc(threaded.cpu) == testIoValue((uint16_t)((IO_PAGE << 8) + 4)), "copy from a device read the wrong value");
+  testMachineDestroy(&threaded);
+
+  /* hot with a harmless destination, then pointed at the INY ($0384)
+   * with an INX to copy over it */
+  const Program over = {
+    { 0x0010, { 0x00, 0x06, 0x00, 0x07 } },
+    { 0x0380, { 0xb1, 0x10, 0x91, 0x12, 0xc8, 0x4c, 0x85, 0x03 } } };
+  machineInit(&threaded, model, over);
+  machineInit(&interp, model, over);
+  threaded.mem[0x0600] = interp.mem[0x0600] = 0xe8;
+  runHot(&threaded, 0x0380, 0, 0, 0, 0);
+  threaded.mem[0x12] = interp.mem[0x12] = 0x84;
+  threaded.mem[0x13] = interp.mem[0x13] = 0x03;
+
+  testSetRegs(&threaded, 0x0380, 0, 0, 0, 0xff, 0);
+  testSetRegs(&interp, 0x0380, 0, 0, 0, 0xff, 0);
+  uint64_t fused = fusionCount(&threaded, COPY_INY);
+  cycles = testRunBlock(&threaded, 1000);
+  uint32_t interpCycles = testStep(&interp);
+  interpCycles += testStep(&interp);
+  CHECK(fusionCount(&threaded, COPY_INY) == fused + 1, "copy over the INY didn't fuse");
+  CHECK(cycles == 5 + 6 && interpCycles == cycles && cpu65xxGetPC(threaded.cpu) == 0x0384,
+    "copy over the INY: %u cycles to $%04X, expected the LDA and STA (%u)", cycles, cpu65xxGetPC(threaded.cpu), interpCycles);
+  checkSameRegs("copy over the INY");
+
+  testRunBlock(&threaded, 1000);
+  testStep(&interp);
+  CHECK(cpu65xxGetX(threaded.cpu) == 1 && cpu65xxGetY(threaded.cpu) == 0, "the INX copied over the INY didn't run");
+  checkSameRegs("after the copy over the INY");
+
+  testMachineDestroy(&threaded);
+  testMachineDestroy(&interp);
+}
+
+/* a block's budget counts the decimal cycle of ADC/SBC on every model */
+static void testDecimalBlock(Cpu65xxModel model)
+{
+  const Program code = {
+    { 0x0340, { 0xf8, 0x18, 0xa9, 0x19,         /* SED, CLC, LDA #$19 */
+                0x69, 0x28, 0xd8,               /* ADC #$28, CLD      */
+                0x4c, 0x40, 0x03 } } };         /* JMP $0340          */
+  uint32_t expected = 2 + 2 + 2 + (cmos(model) ? 3 : 2) + 2 + 3;
+  uint8_t sum = model == CPU65XX_6502_NO_BCD ? 0x41 : 0x47;
+
+  machineInit(&threaded, model, code);
+  uint32_t cycles = runHot(&threaded, 0x0340, 0, 0, 0, 0);
+  uint32_t interpCycles = runInterp(model, code, 6, 0x0340, 0, 0, 0, 0);
+  CHECK(cycles == expected && interpCycles == expected, "decimal block: %u cycles, %u interpreted, expected %u",
+    cycles, interpCycles, expected);
+  CHECK(cpu65xxGetAcc(threaded.cpu) == sum, "decimal block: $19 + $28 = $%02X", cpu65xxGetAcc(threaded.cpu));
+  checkSameRegs("decimal block");
+
+  testSetRegs(&threaded, 0x0340, 0, 0, 0, 0xff, 0);
+  cycles = testRunBlock(&threaded, 13);
+  CHECK(cycles == 2, "decimal block ran in 13 cycles, one short of its budget (%u cycles)", cycles);
+
+  testMachineDestroy(&threaded);
+  testMachineDestroy(&interp);
+}
+
+int main()
+{
+  for (int i = 0; i < TEST_MODEL_COUNT; ++i)
+  {
+    modelName = testModels[i].name;
+    testLoops(testModels[i].model);
+    testTranslation(testModels[i].model);
+    testBlockExits(testModels[i].model);
+    testFusions(testModels[i].model);
+    testCopyFallbacks(testModels[i].model);
+    testDecimalBlock(testModels[i].model);
+  }
+
+  if (failures)
+  {
+    printf("cpu65xx_block: %d failures\n", failures);
+    return 1;
+  }
+  printf("cpu65xx_block: ok\n");
+  return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * DB6502 Emulator - cpu65xx ADC/SBC test
+ *
+ * Every accumulator, operand and carry, in binary and decimal mode, on every
+ * model, against the reference sequences of Bruce Clark's "Decimal Mode"
+ * tutorial (appendix B), which is also what Klaus Dormann's decimal test
+ * checks against. Invalid BCD operands are included: the NMOS and CMOS
+ * results for those are well defined, just different. The 6502 without
+ * decimal mode must give the binary result with D set.
+ */
+
+#include "cpu65xx_harness.h"
+
+#define FLAG_C  0x01
+#define FLAG_Z  0x02
+#define FLAG_D  0x08
+#define FLAG_U  0x20
+#define FLAG_V  0x40
+#define FLAG_N  0x80
+
+#define CODE_ADC  0x0200
+#define CODE_SBC  0x0210
+#define OPERAND   0x10
+
+static TestMachine machine;
+static int failures = 0;
+
+struct Expected
+{
+  uint8_t a;
+  uint8_t p;
+};
+
+static uint8_t nz(uint8_t val)
+{
+  return (val & FLAG_N) | (val ? 0 : FLAG_Z);
+}
+
+static Expected binaryAdc(uint8_t a, uint8_t b, int c)
+{
+  int sum = a + b + c;
+  uint8_t p = (sum > 0xff ? FLAG_C : 0) | nz((uint8_t)sum);
+  if (~(a ^ b) & (a ^ sum) & 0x80) p |= FLAG_V;
+  return { (uint8_t)sum, p };
+}
+
+static Expected binarySbc(uint8_t a, uint8_t b, int c)
+{
+  return binaryAdc(a, (uint8_t)~b, c);
+}
+
+/* sequences 1 (A, C) and 2 (N, V). the NMOS Z is the binary one; the
+ * 65C02 takes N and Z from the result */
+static Expected decimalAdc(uint8_t a, uint8_t b, int c, bool cmos)
+{
+  int al = (a & 0x0f) + (b & 0x0f) + c;
+  if (al >= 0x0a) al = ((al + 0x06) & 0x0f) + 0x10;
+
+  int seq2 = (int8_t)(a & 0xf0) + (int8_t)(b & 0xf0) + al;
+  int seq1 = (a & 0xf0) + (b & 0xf0) + al;
+  if (seq1 >= 0xa0) seq1 += 0x60;
+
+  uint8_t result = (uint8_t)seq1;
+  uint8_t p = (seq1 >= 0x100 ? FLAG_C : 0) | (seq2 < -128 || seq2 > 127 ? FLAG_V : 0);
+  if (cmos) p |= nz(result);
+  else p |= (seq2 & FLAG_N) | (binaryAdc(a, b, c).p & FLAG_Z);
+  return { result, p };
+}
+
+/* sequence 3 (NMOS: every flag from the binary difference) and 4 (65C02:
+ * N and Z from the result) */
+static Expected decimalSbc(uint8_t a, uint8_t b, int c, bool cmos)
+{
+  Expected binary = binarySbc(a, b, c);
+  int al = (a & 0x0f) - (b & 0x0f) + c - 1;
+  int diff;
+
+  if (cmos)
+  {
+    diff = a - b + c - 1;
+    if (diff < 0) diff -= 0x60;
+    if (al < 0) diff -= 0x06;
+    uint8_t result = (uint8_t)diff;
+    return { result, (uint8_t)((binary.p & (FLAG_C | FLAG_V)) | nz(result)) };
+  }
+
+  if (al < 0) al = ((al - 0x06) & 0x0f) - 0x10;
+  diff = (a & 0xf0) - (b & 0xf0) + al;
+  if (diff < 0) diff -= 0x60;
+  return { (uint8_t)diff, binary.p };
+}
+
+static void testModel(Cpu65xxModel model, const char* name)
+{
+  bool cmos = model == CPU65XX_65C02 || model == CPU65XX_W65C02;
+  bool bcd = model != CPU65XX_6502_NO_BCD;
+
+  memset(machine.mem, 0xea, sizeof(machine.mem));
+  machine.mem[CODE_ADC] = 0x65;     /* ADC zp */
+  machine.mem[CODE_ADC + 1] = OPERAND;
+  machine.mem[CODE_SBC] = 0xe5;     /* SBC zp */
+  machine.mem[CODE_SBC + 1] = OPERAND;
+  testMachineInit(&machine, model, 0);
+
+  int modelFailures = 0;
+  for (int sbc = 0; sbc < 2; ++sbc)
+  {
+    for (int d = 0; d < 2; ++d)
+    {
+      bool decimal = d && bcd;
+      uint8_t cycles = 3 + (decimal && cmos ? 1 : 0);
+
+      for (int a = 0; a < 256; ++a)
+      {
+        for (int b = 0; b < 256; ++b)
+        {
+          for (int c = 0; c < 2; ++c)
+          {
+            Expected e;
+            if (decimal) e = sbc ? decimalSbc(a, b, c, cmos) : decimalAdc(a, b, c, cmos);
+            else e = sbc ? binarySbc(a, b, c) : binaryAdc(a, b, c);
+            e.p |= FLAG_U | (d ? FLAG_D : 0);
+
+            machine.mem[OPERAND] = (uint8_t)b;
+            testSetRegs(&machine, sbc ? CODE_SBC : CODE_ADC, a, 0, 0, 0xff, FLAG_U | (d ? FLAG_D : 0) | c);
+            uint8_t ran = (uint8_t)testStep(&machine);
+
+            uint8_t gotA = cpu65xxGetAcc(machine.cpu);
+            uint8_t gotP = cpu65xxGetStatus(machine.cpu);
+            if (gotA != e.a || gotP != e.p || ran != cycles)
+            {
+              if (modelFailures < 10)
+              {
+                printf("%s: %s %s $%02X, #$%02X, C=%d: A=%02X P=%02X %u cycles, expected A=%02X P=%02X %u cycles\n",
+                  name, sbc ? "SBC" : "ADC", d ? "decimal" : "binary", a, b, c,
+                  gotA, gotP, ran, e.a, e.p, cycles);
+              }
+              ++modelFailures;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  testMachineDestroy(&machine);
+  failures += modelFailures;
+}
+
+int main()
+{
+  for (int i = 0; i < TEST_MODEL_COUNT; ++i)
+  {
+    testModel(testModels[i].model, testModels[i].name);
+  }
+
+  if (failures)
+  {
+    printf("cpu65xx_decimal: %d failures\n", failures);
+    return 1;
+  }
+  printf("cpu65xx_decimal: ok\n");
+  return 0;
+}
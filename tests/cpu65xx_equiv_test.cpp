@@ -0,0 +1,264 @@
+/*
+ * DB6502 Emulator - cpu65xx threaded against interpreted, on random programs
+ *
+ * Each program is a loop of random instructions with the superinstruction
+ * sequences mixed in, over random memory with one I/O page. It runs on two
+ * machines from the same state: one through cpu65xxRunBlock() with random
+ * cycle budgets, the other through cpu65xxInstCycle() until it has run as
+ * many cycles. At every such sync point the cycle totals, registers and
+ * device accesses must match, and memory every so often and at the end.
+ * The IRQ line is raised and dropped at random sync points on both.
+ * Every model is run.
+ */
+
+#include "cpu65xx_harness.h"
+
+#define IO_PAGE         0xc0
+#define CODE_START      0x08c0          /* runs across a page */
+#define CODE_END        0x0b00
+#define HANDLER         0x0200          /* IRQ and BRK: INC $F0, RTI */
+#define PROGRAMS        8
+#define CYCLES          2000000u
+#define MEMORY_SYNCS    256             /* syncs between memory compares */
+
+static TestMachine interp;
+static TestMachine threaded;
+static int failures = 0;
+
+static const uint8_t dataPages[] = { 0x04, 0x05, 0x06, 0x07, IO_PAGE };
+
+/* bytes in the instruction. only the opcodes testOpcodes() gives */
+static int length(uint8_t opcode)
+{
+  uint8_t lo = opcode & 0x0f;
+  if (opcode == 0x20) return 3;
+  if (opcode == 0x00 || opcode == 0x40 || opcode == 0x60 || lo == 0x08 || lo == 0x0a) return 1;
+  if (lo >= 0x0c || (lo == 0x09 && (opcode & 0x10))) return 3;
+  return 2;
+}
+
+/* a branch, taking a relative operand last */
+static bool relative(uint8_t opcode)
+{
+  return (opcode & 0x1f) == 0x10 || opcode == 0x80 || (opcode & 0x0f) == 0x0f;
+}
+
+/* control transfers out of the loop */
+static bool leavesLoop(uint8_t opcode)
+{
+  switch (opcode)
+  {
+    case 0x00: case 0x20: case 0x40: case 0x4c: case 0x60: case 0x6c: case 0x7c:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/* a random loop at CODE_START into m's memory, with the rest of memory
+ * random but the vectors and handler in place */
+static void generate(TestMachine* m, Cpu65xxModel model, uint32_t* seed)
+{
+  uint8_t opcodes[256];
+  int opcodeCount = testOpcodes(model, opcodes);
+
+  for (int i = 0; i < TEST_MEM_SIZE; ++i) m->mem[i] = (uint8_t)testRandom(seed);
+
+  /* zero page pointers mostly into the data pages */
+  for (int i = 1; i < 0x100; i += 2)
+  {
+    if (testRandom(seed) % 4) m->mem[i] = dataPages[testRandom(seed) % 4];
+  }
+
+  static const uint8_t handler[] = { 0xe6, 0xf0, 0x40 };
+  memcpy(m->mem + HANDLER, handler, sizeof(handler));
+  for (int v = 0xfffa; v < 0x10000; v += 2)
+  {
+    m->mem[v] = HANDLER & 0xff;
+    m->mem[v + 1] = HANDLER >> 8;
+  }
+
+  /* so that every pass ends, branches only go forward (to one of the next
+   * few instructions, once their addresses are known) but for DEX/DEY
+   * loops */
+  uint16_t starts[256];
+  int count = 0;
+  struct { uint16_t at; int from; } forward[256];
+  int forwardCount = 0;
+
+  uint16_t pc = CODE_START;
+  while (pc < CODE_END - 8 && count < 255)
+  {
+    starts[count++] = pc;
+    uint8_t* p = m->mem + pc;
+    uint32_t r = testRandom(seed);
+
+    switch (r % 16)
+    {
+      case 0:   /* DEX or DEY; BNE to itself: a delay loop */
+        p[0] = (r & 0x100) ? 0xca : 0x88;
+        p[1] = 0xd0;
+        p[2] = 0xfd;
+        pc += 3;
+        break;
+
+      case 1:   /* CMP #; BEQ or BNE forward */
+        p[0] = 0xc9;
+        p[1] = (uint8_t)testRandom(seed);
+        p[2] = (r & 0x100) ? 0xf0 : 0xd0;
+        forward[forwardCount++] = { (uint16_t)(pc + 3), count };
+        pc += 4;
+        break;
+
+      case 2:   /* LDA (zp),Y; STA (zp),Y; INY */
+        p[0] = 0xb1;
+        p[1] = (uint8_t)(0x10 + 2 * (testRandom(seed) % 8));
+        p[2] = 0x91;
+        p[3] = (uint8_t)(0x10 + 2 * (testRandom(seed) % 8));
+        p[4] = 0xc8;
+        pc += 5;
+        break;
+
+      default:
+      {
+        uint8_t opcode;
+        do opcode = opcodes[testRandom(seed) % opcodeCount];
+        while (leavesLoop(opcode));
+
+        int len = length(opcode);
+        p[0] = opcode;
+        if (len == 3 && !relative(opcode))
+        {
+          /* absolute: into the data pages, now and then the code itself */
+          p[1] = (uint8_t)testRandom(seed);
+          p[2] = (testRandom(seed) % 32) ? dataPages[testRandom(seed) % sizeof(dataPages)] : (uint8_t)(pc >> 8);
+        }
+        else if (len > 1)
+        {
+          p[1] = (uint8_t)testRandom(seed);
+          if (len == 3) p[2] = (uint8_t)testRandom(seed);
+        }
+        pc += len;
+        if (relative(opcode)) forward[forwardCount++] = { (uint16_t)(pc - 1), count };
+        break;
+      }
+    }
+  }
+
+  /* JMP CODE_START */
+  starts[count] = pc;
+  m->mem[pc] = 0x4c;
+  m->mem[pc + 1] = CODE_START & 0xff;
+  m->mem[pc + 2] = CODE_START >> 8;
+
+  for (int i = 0; i < forwardCount; ++i)
+  {
+    int to = forward[i].from + (int)(testRandom(seed) % 4);
+    if (to > count) to = count;
+    m->mem[forward[i].at] = (uint8_t)(starts[to] - (forward[i].at + 1));
+  }
+}
+
+/* returns true if the machines still agree */
+static bool compare(const char* name, int program, uint64_t cycles, uint64_t interpCycles, bool memory)
+{
+  const char* differs = testRegsDiffer(&interp, &threaded);
+  if (interpCycles != cycles) differs = "the cycle count";
+  else if (interp.ioReads != threaded.ioReads) differs = "the device read count";
+  else if (interp.writeCount != threaded.writeCount ||
+           memcmp(interp.writes, threaded.writes, sizeof(TestWrite) * (interp.writeCount < TEST_WRITE_LOG ? interp.writeCount : TEST_WRITE_LOG)) != 0)
+  {
+    differs = "the device writes";
+  }
+  else if (memory && memcmp(interp.mem, threaded.mem, sizeof(interp.mem)) != 0) differs = "memory";
+
+  interp.writeCount = 0;
+  threaded.writeCount = 0;
+  if (!*differs) return true;
+
+  printf("%s program %d: %s differs after %llu cycles threaded, %llu interpreted\n", name, program, differs,
+    (unsigned long long)cycles, (unsigned long long)interpCycles);
+  testPrintRegs("interp", &interp);
+  testPrintRegs("threaded", &threaded);
+  ++failures;
+  return false;
+}
+
+static void testModel(Cpu65xxModel model, const char* name, uint64_t* fused)
+{
+  uint32_t seed = 0x0b10c65u + (uint32_t)model;
+
+  for (int program = 0; program < PROGRAMS; ++program)
+  {
+    uint32_t programSeed = testRandom(&seed);
+    uint32_t s = programSeed;
+    generate(&interp, model, &s);
+    memcpy(threaded.mem, interp.mem, sizeof(interp.mem));
+    testMachineInit(&interp, model, IO_PAGE);
+    testMachineInit(&threaded, model, IO_PAGE);
+
+    uint8_t p = (uint8_t)testRandom(&seed) & 0xf3;   /* binary mode, IRQs on */
+    testSetRegs(&interp, CODE_START, 0, 0, 0, 0xff, p);
+    testSetRegs(&threaded, CODE_START, 0, 0, 0, 0xff, p);
+
+    uint64_t cycles = 0;
+    uint64_t interpCycles = 0;
+    bool irq = false;
+    for (int sync = 1; cycles < CYCLES; ++sync)
+    {
+      uint32_t r = testRandom(&seed);
+      cycles += testRunBlock(&threaded, (r % 8) ? 1 + (r >> 8) % 100 : 1000);
+      while (interpCycles < cycles) interpCycles += testStep(&interp);
+
+      if (!compare(name, program, cycles, interpCycles, sync % MEMORY_SYNCS == 0)) break;
+
+      if (testRandom(&seed) % 64 == 0)
+      {
+        irq = !irq;
+        cpu65xxSetIrq(interp.cpu, irq);
+        cpu65xxSetIrq(threaded.cpu, irq);
+      }
+    }
+    compare(name, program, cycles, interpCycles, true);
+
+    for (int i = 0; i < CPU65XX_FUSION_COUNT; ++i)
+    {
+      if (cpu65xxFusionCount(interp.cpu, i))
+      {
+        printf("%s program %d: the interpreter fused %s\n", name, program, cpu65xxFusionName(i));
+        ++failures;
+      }
+      fused[i] += cpu65xxFusionCount(threaded.cpu, i);
+    }
+
+    testMachineDestroy(&interp);
+    testMachineDestroy(&threaded);
+  }
+}
+
+int main()
+{
+  for (int i = 0; i < TEST_MODEL_COUNT; ++i)
+  {
+    uint64_t fused[CPU65XX_FUSION_COUNT] = { 0 };
+    testModel(testModels[i].model, testModels[i].name, fused);
+
+    /* the programs must have reached every superinstruction */
+    for (int f = 0; f < CPU65XX_FUSION_COUNT; ++f)
+    {
+      if (!fused[f])
+      {
+        printf("%s: %s never ran\n", testModels[i].name, cpu65xxFusionName(f));
+        ++failures;
+      }
+    }
+  }
+
+  if (failures)
+  {
+    printf("cpu65xx_equiv: %d failures\n", failures);
+    return 1;
+  }
+  printf("cpu65xx_equiv: ok\n");
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * DB6502 Emulator - Klaus Dormann's functional tests on cpu65xx
+ *
+ * usage: cpu65xx_functional_test <model> <interp|threaded> <image> <load> <start> <success>
+ *
+ * Loads a binary image of one of the 6502_65C02_functional_tests at load
+ * and runs it from start. Each test ends in a trap: a branch or jump to
+ * itself. Reaching the one at success passes; any other trap is the
+ * failed check, which the test's listing gives by address. Addresses are
+ * hex. The threaded core runs through cpu65xxRunBlock(), so blocks and
+ * fusions are covered too.
+ */
+
+#include "cpu65xx_harness.h"
+
+#include <stdlib.h>
+
+#define CYCLE_LIMIT   1000000000ull   /* the 6502 test takes about 100M */
+
+static TestMachine machine;
+
+static int modelByName(const char* name, Cpu65xxModel* model)
+{
+  for (int i = 0; i < TEST_MODEL_COUNT; ++i)
+  {
+    if (strcmp(name, testModels[i].name) == 0)
+    {
+      *model = testModels[i].model;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  Cpu65xxModel model;
+  if (argc != 7 || !modelByName(argv[1], &model) ||
+      (strcmp(argv[2], "interp") != 0 && strcmp(argv[2], "threaded") != 0))
+  {
+    printf("usage: %s <model> <interp|threaded> <image> <load> <start> <success>\n", argv[0]);
+    return 2;
+  }
+
+  bool threaded = strcmp(argv[2], "threaded") == 0;
+  uint16_t load = (uint16_t)strtoul(argv[4], NULL, 16);
+  uint16_t start = (uint16_t)strtoul(argv[5], NULL, 16);
+  uint16_t success = (uint16_t)strtoul(argv[6], NULL, 16);
+
+  FILE* f = fopen(argv[3], "rb");
+  if (!f)
+  {
+    printf("can't open %s\n", argv[3]);
+    return 2;
+  }
+  memset(machine.mem, 0, sizeof(machine.mem));
+  size_t size = fread(machine.mem + load, 1, sizeof(machine.mem) - load, f);
+  fclose(f);
+
+  testMachineInit(&machine, model, 0);
+  testSetRegs(&machine, start, 0, 0, 0, 0xff, 0x24);
+
+  uint64_t cycles = 0;
+  while (cycles < CYCLE_LIMIT)
+  {
+    cycles += threaded ? testRunBlock(&machine, 1000) : testStep(&machine);
+
+    uint16_t pc = cpu65xxGetPC(machine.cpu);
+    if (cpu65xxGetInstPC(machine.cpu) != pc) continue;
+
+    if (pc == success)
+    {
+      printf("%s (%s, %s): passed in %llu cycles\n", argv[3], argv[1], argv[2], (unsigned long long)cycles);
+      testMachineDestroy(&machine);
+      return 0;
+    }
+
+    printf("%s (%s, %s): trapped at $%04X after %llu cycles (%zu byte image)\n",
+      argv[3], argv[1], argv[2], pc, (unsigned long long)cycles, size);
+    testPrintRegs("", &machine);
+    testMachineDestroy(&machine);
+    return 1;
+  }
+
+  printf("%s (%s, %s): no trap after %llu cycles, PC=$%04X\n",
+    argv[3], argv[1], argv[2], (unsigned long long)cycles, cpu65xxGetPC(machine.cpu));
+  testMachineDestroy(&machine);
+  return 1;
+}
@@ -0,0 +1,181 @@
+/*
+ * DB6502 Emulator - cpu65xx test harness
+ *
+ * A core on flat 64K memory. Every page is plain host memory except the
+ * ones marked as I/O, which go through the memory callbacks the way the
+ * bus's device pages do. The callbacks carry no context, so they act on
+ * whichever machine is current.
+ */
+
+#ifndef _DB6502_CPU65XX_HARNESS_H_
+#define _DB6502_CPU65XX_HARNESS_H_
+
+#include "cpu/cpu65xx.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define TEST_MEM_SIZE     0x10000
+#define TEST_WRITE_LOG    64
+
+static const struct { Cpu65xxModel model; const char* name; } testModels[] = {
+  { CPU65XX_6502,        "6502" },
+  { CPU65XX_6502_NO_BCD, "6502-nobcd" },
+  { CPU65XX_65C02,       "65C02" },
+  { CPU65XX_W65C02,      "W65C02" },
+};
+#define TEST_MODEL_COUNT  (int)(sizeof(testModels) / sizeof(testModels[0]))
+
+struct TestWrite
+{
+  uint16_t addr;
+  uint8_t  val;
+};
+
+struct TestMachine
+{
+  Cpu65xx*        cpu;
+  uint8_t         mem[TEST_MEM_SIZE];
+  const uint8_t*  readPages[256];
+  uint8_t*        writePages[256];
+
+  /* callback writes (I/O pages) since the log was last cleared */
+  TestWrite       writes[TEST_WRITE_LOG];
+  int             writeCount;
+  uint64_t        ioReads;
+};
+
+static TestMachine* testCurrent = NULL;
+
+/* an I/O page reads back a fixed function of the address, so two runs of
+ * the same code see the same values whatever the core */
+static inline uint8_t testIoValue(uint16_t addr)
+{
+  return (uint8_t)((addr * 0x9d) ^ (addr >> 8) ^ 0x5a);
+}
+
+static inline uint8_t testMemRead(uint16_t addr, bool dbg)
+{
+  if (!dbg) ++testCurrent->ioReads;
+  return testIoValue(addr);
+}
+
+static inline void testMemWrite(uint16_t addr, uint8_t val)
+{
+  TestMachine* m = testCurrent;
+  if (m->writeCount < TEST_WRITE_LOG) m->writes[m->writeCount] = { addr, val };
+  ++m->writeCount;
+}
+
+/* all pages plain memory except ioPage (0 for none: page 0 is always RAM) */
+static inline void testMachineInit(TestMachine* m, Cpu65xxModel model, uint8_t ioPage)
+{
+  for (int page = 0; page < 256; ++page)
+  {
+    bool io = ioPage && page == ioPage;
+    m->readPages[page] = io ? NULL : m->mem + (page << 8);
+    m->writePages[page] = io ? NULL : m->mem + (page << 8);
+  }
+  m->writeCount = 0;
+  m->ioReads = 0;
+  m->cpu = cpu65xxNew(model, testMemRead, testMemWrite, m->readPages, m->writePages);
+}
+
+static inline void testMachineDestroy(TestMachine* m)
+{
+  cpu65xxDestroy(m->cpu);
+  m->cpu = NULL;
+}
+
+/* memory changed behind the core's back */
+static inline void testMachineLoaded(TestMachine* m)
+{
+  cpu65xxInvalidateCode(m->cpu);
+}
+
+static inline uint32_t testStep(TestMachine* m)
+{
+  testCurrent = m;
+  return cpu65xxInstCycle(m->cpu);
+}
+
+static inline uint32_t testRunBlock(TestMachine* m, uint32_t maxCycles)
+{
+  testCurrent = m;
+  return cpu65xxRunBlock(m->cpu, maxCycles);
+}
+
+static inline void testSetRegs(TestMachine* m, uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t sp, uint8_t p)
+{
+  cpu65xxSetPC(m->cpu, pc);
+  cpu65xxSetAcc(m->cpu, a);
+  cpu65xxSetX(m->cpu, x);
+  cpu65xxSetY(m->cpu, y);
+  cpu65xxSetStackPointer(m->cpu, sp);
+  cpu65xxSetStatus(m->cpu, p);
+}
+
+/* "" if a and b have the same registers, else the first that differs */
+static inline const char* testRegsDiffer(TestMachine* a, TestMachine* b)
+{
+  if (cpu65xxGetPC(a->cpu) != cpu65xxGetPC(b->cpu)) return "PC";
+  if (cpu65xxGetAcc(a->cpu) != cpu65xxGetAcc(b->cpu)) return "A";
+  if (cpu65xxGetX(a->cpu) != cpu65xxGetX(b->cpu)) return "X";
+  if (cpu65xxGetY(a->cpu) != cpu65xxGetY(b->cpu)) return "Y";
+  if (cpu65xxGetStackPointer(a->cpu) != cpu65xxGetStackPointer(b->cpu)) return "SP";
+  if (cpu65xxGetStatus(a->cpu) != cpu65xxGetStatus(b->cpu)) return "P";
+  return "";
+}
+
+static inline void testPrintRegs(const char* label, TestMachine* m)
+{
+  printf("  %-8s PC=%04X A=%02X X=%02X Y=%02X SP=%02X P=%02X\n", label,
+    cpu65xxGetPC(m->cpu), cpu65xxGetAcc(m->cpu), cpu65xxGetX(m->cpu),
+    cpu65xxGetY(m->cpu), cpu65xxGetStackPointer(m->cpu), cpu65xxGetStatus(m->cpu));
+}
+
+/* the documented opcodes of model into opcodes[256] (not the NMOS
+ * undocumented ones, the CMOS reserved NOPs or WAI/STP). returns how many */
+static inline int testOpcodes(Cpu65xxModel model, uint8_t* opcodes)
+{
+  static const uint8_t nmos[] = {
+    0x00, 0x01, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0d, 0x0e, 0x10, 0x11, 0x15, 0x16, 0x18, 0x19, 0x1d, 0x1e,
+    0x20, 0x21, 0x24, 0x25, 0x26, 0x28, 0x29, 0x2a, 0x2c, 0x2d, 0x2e, 0x30, 0x31, 0x35, 0x36, 0x38, 0x39, 0x3d, 0x3e,
+    0x40, 0x41, 0x45, 0x46, 0x48, 0x49, 0x4a, 0x4c, 0x4d, 0x4e, 0x50, 0x51, 0x55, 0x56, 0x58, 0x59, 0x5d, 0x5e,
+    0x60, 0x61, 0x65, 0x66, 0x68, 0x69, 0x6a, 0x6c, 0x6d, 0x6e, 0x70, 0x71, 0x75, 0x76, 0x78, 0x79, 0x7d, 0x7e,
+    0x81, 0x84, 0x85, 0x86, 0x88, 0x8a, 0x8c, 0x8d, 0x8e, 0x90, 0x91, 0x94, 0x95, 0x96, 0x98, 0x99, 0x9a, 0x9d,
+    0xa0, 0xa1, 0xa2, 0xa4, 0xa5, 0xa6, 0xa8, 0xa9, 0xaa, 0xac, 0xad, 0xae, 0xb0, 0xb1, 0xb4, 0xb5, 0xb6, 0xb8, 0xb9, 0xba, 0xbc, 0xbd, 0xbe,
+    0xc0, 0xc1, 0xc4, 0xc5, 0xc6, 0xc8, 0xc9, 0xca, 0xcc, 0xcd, 0xce, 0xd0, 0xd1, 0xd5, 0xd6, 0xd8, 0xd9, 0xdd, 0xde,
+    0xe0, 0xe1, 0xe4, 0xe5, 0xe6, 0xe8, 0xe9, 0xea, 0xec, 0xed, 0xee, 0xf0, 0xf1, 0xf5, 0xf6, 0xf8, 0xf9, 0xfd, 0xfe
+  };
+  static const uint8_t cmos[] = {
+    0x04, 0x0c, 0x12, 0x14, 0x1a, 0x1c, 0x32, 0x34, 0x3a, 0x3c, 0x52, 0x5a, 0x64, 0x72, 0x74, 0x7a, 0x7c,
+    0x80, 0x89, 0x92, 0x9c, 0x9e, 0xb2, 0xd2, 0xda, 0xf2, 0xfa
+  };
+
+  int count = 0;
+  for (size_t i = 0; i < sizeof(nmos); ++i) opcodes[count++] = nmos[i];
+  if (model == CPU65XX_65C02 || model == CPU65XX_W65C02)
+  {
+    for (size_t i = 0; i < sizeof(cmos); ++i) opcodes[count++] = cmos[i];
+  }
+  if (model == CPU65XX_W65C02)
+  {
+    /* RMBn, SMBn, BBRn, BBSn */
+    for (int op = 0x07; op < 0x100; op += 0x08) opcodes[count++] = (uint8_t)op;
+  }
+  return count;
+}
+
+/* xorshift: the same sequence on every host */
+static inline uint32_t testRandom(uint32_t* state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+#endif
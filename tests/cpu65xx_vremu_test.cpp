@@ -0,0 +1,173 @@
+/*
+ * DB6502 Emulator - cpu65xx against vrEmu6502, one instruction at a time
+ *
+ * Random instructions from random states run on both cores, which start
+ * each one with the same registers and memory. Afterwards the registers
+ * (P without B and the unused bit), the cycle count and memory must match,
+ * and so must the ordered list of writes to the I/O page (where cpu65xx
+ * calls out to the bus rather than writing host memory). Memory is compared
+ * whole, so a stray write anywhere shows up too.
+ *
+ * Left out, as neither core claims the other's behaviour for them: NMOS
+ * undocumented opcodes (NOPs here), the CMOS reserved NOPs and WAI/STP.
+ * Decimal mode only runs ADC/SBC # on valid BCD, and there only A, C and
+ * the cycles are compared; the flags vrEmu6502 doesn't document are
+ * covered against Bruce Clark's reference by cpu65xx_decimal_test.
+ */
+
+#include "cpu65xx_harness.h"
+
+#include "vrEmu6502.h"
+
+#define IO_PAGE       0xc0
+#define STEPS         200000
+#define P_COMPARED    0xcf          /* not B or the unused bit */
+#define FLAG_C        0x01
+#define FLAG_D        0x08
+
+static TestMachine machine;
+static VrEmu6502* ref = NULL;
+static uint8_t refMem[TEST_MEM_SIZE];
+static TestWrite refWrites[TEST_WRITE_LOG];
+static int refWriteCount = 0;
+
+static uint8_t refRead(uint16_t addr, bool dbg)
+{
+  (void)dbg;
+  return (addr >> 8) == IO_PAGE ? testIoValue(addr) : refMem[addr];
+}
+
+static void refWrite(uint16_t addr, uint8_t val)
+{
+  if ((addr >> 8) != IO_PAGE)
+  {
+    refMem[addr] = val;
+    return;
+  }
+  if (refWriteCount < TEST_WRITE_LOG) refWrites[refWriteCount] = { addr, val };
+  ++refWriteCount;
+}
+
+static uint8_t randomBcd(uint32_t* seed)
+{
+  uint32_t r = testRandom(seed);
+  return (uint8_t)((((r >> 4) % 10) << 4) | (r % 10));
+}
+
+static int testModel(Cpu65xxModel model, const char* name, vrEmu6502Model refModel)
+{
+  bool bcd = model != CPU65XX_6502_NO_BCD;
+
+  uint8_t opcodes[256];
+  int opcodeCount = testOpcodes(model, opcodes);
+
+  uint32_t seed = 0x6502c0de;
+  for (int i = 0; i < TEST_MEM_SIZE; ++i) machine.mem[i] = (uint8_t)testRandom(&seed);
+  memcpy(refMem, machine.mem, sizeof(refMem));
+
+  testMachineInit(&machine, model, IO_PAGE);
+  ref = vrEmu6502New(refModel, refRead, refWrite);
+  vrEmu6502Reset(ref);
+
+  int failures = 0;
+  for (int step = 0; step < STEPS && failures < 10; ++step)
+  {
+    uint8_t opcode = opcodes[testRandom(&seed) % opcodeCount];
+    uint8_t a = (uint8_t)testRandom(&seed);
+    uint8_t x = (uint8_t)testRandom(&seed);
+    uint8_t y = (uint8_t)testRandom(&seed);
+    uint8_t sp = (uint8_t)testRandom(&seed);
+    uint8_t p = (uint8_t)testRandom(&seed) & ~FLAG_D;
+    uint8_t operand[2] = { (uint8_t)testRandom(&seed), (uint8_t)testRandom(&seed) };
+
+    /* decimal mode: ADC/SBC # with valid BCD only */
+    bool decimal = bcd && (opcode == 0x69 || opcode == 0xe9) && (testRandom(&seed) & 1);
+    if (decimal)
+    {
+      p |= FLAG_D;
+      a = randomBcd(&seed);
+      operand[0] = randomBcd(&seed);
+    }
+
+    /* anywhere but the I/O page, not running into it */
+    uint16_t pc;
+    do pc = (uint16_t)testRandom(&seed);
+    while (((pc >> 8) == IO_PAGE) || (((pc + 2) >> 8) & 0xff) == IO_PAGE || pc > 0xfffd);
+
+    for (int i = 0; i < 3; ++i)
+    {
+      uint8_t val = i ? operand[i - 1] : opcode;
+      machine.mem[pc + i] = val;
+      refMem[pc + i] = val;
+    }
+    cpu65xxInvalidatePage(machine.cpu, (uint8_t)(pc >> 8));
+    cpu65xxInvalidatePage(machine.cpu, (uint8_t)((pc + 2) >> 8));
+
+    testSetRegs(&machine, pc, a, x, y, sp, p);
+    vrEmu6502SetPC(ref, pc);
+    vrEmu6502SetAcc(ref, a);
+    vrEmu6502SetX(ref, x);
+    vrEmu6502SetY(ref, y);
+    vrEmu6502SetStackPointer(ref, sp);
+    vrEmu6502SetStatus(ref, p);
+    machine.writeCount = 0;
+    refWriteCount = 0;
+
+    uint8_t cycles = (uint8_t)testStep(&machine);
+    uint8_t refCycles = vrEmu6502InstCycle(ref);
+
+    uint8_t pMask = decimal ? FLAG_C : P_COMPARED;
+    const char* differs = NULL;
+    if (cpu65xxGetPC(machine.cpu) != vrEmu6502GetPC(ref)) differs = "PC";
+    else if (cpu65xxGetAcc(machine.cpu) != vrEmu6502GetAcc(ref)) differs = "A";
+    else if (cpu65xxGetX(machine.cpu) != vrEmu6502GetX(ref)) differs = "X";
+    else if (cpu65xxGetY(machine.cpu) != vrEmu6502GetY(ref)) differs = "Y";
+    else if (cpu65xxGetStackPointer(machine.cpu) != vrEmu6502GetStackPointer(ref)) differs = "SP";
+    else if ((cpu65xxGetStatus(machine.cpu) ^ vrEmu6502GetStatus(ref)) & pMask) differs = "P";
+    else if (cycles != refCycles) differs = "cycles";
+    else if (machine.writeCount != refWriteCount) differs = "I/O write count";
+    else if (memcmp(machine.writes, refWrites, sizeof(TestWrite) * (refWriteCount < TEST_WRITE_LOG ? refWriteCount : TEST_WRITE_LOG)) != 0)
+    {
+      differs = "I/O writes";
+    }
+    else if (memcmp(machine.mem, refMem, sizeof(refMem)) != 0) differs = "memory";
+
+    if (differs)
+    {
+      printf("%s: %s differs after $%02X %02X %02X at $%04X (A=%02X X=%02X Y=%02X SP=%02X P=%02X)\n",
+        name, differs, opcode, operand[0], operand[1], pc, a, x, y, sp, p);
+      testPrintRegs("cpu65xx", &machine);
+      printf("  %-8s PC=%04X A=%02X X=%02X Y=%02X SP=%02X P=%02X\n", "vrEmu",
+        vrEmu6502GetPC(ref), vrEmu6502GetAcc(ref), vrEmu6502GetX(ref),
+        vrEmu6502GetY(ref), vrEmu6502GetStackPointer(ref), vrEmu6502GetStatus(ref));
+      printf("  cycles %u vs %u, I/O writes %d vs %d\n", cycles, refCycles, machine.writeCount, refWriteCount);
+      ++failures;
+
+      /* carry on from the same memory */
+      memcpy(refMem, machine.mem, sizeof(refMem));
+    }
+  }
+
+  vrEmu6502Destroy(ref);
+  testMachineDestroy(&machine);
+  return failures;
+}
+
+int main()
+{
+  static const vrEmu6502Model refModels[] = { CPU_6502, CPU_6502, CPU_65C02, CPU_W65C02 };
+
+  int failures = 0;
+  for (int i = 0; i < TEST_MODEL_COUNT; ++i)
+  {
+    failures += testModel(testModels[i].model, testModels[i].name, refModels[i]);
+  }
+
+  if (failures)
+  {
+    printf("cpu65xx_vremu: %d failures\n", failures);
+    return 1;
+  }
+  printf("cpu65xx_vremu: ok\n");
+  return 0;
+}
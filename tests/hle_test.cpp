@@ -0,0 +1,457 @@
+/*
+ * DB6502 Emulator - HLE traps against the ROM routines they replace
+ *
+ * Loads the ROM and its label file, then calls FMULT, FDIV and BLTU2 on two
+ * machines from the same state: one with the traps installed (taken before
+ * the instruction at a trapped address, as 6502_device.c takes them), the
+ * other running the ROM's code. Afterwards FAC, FACSIGN, FACEXTENSION, ARG,
+ * ARGSIGN, SGNCPR, the registers and P must match, and for BLTU2 all of
+ * RAM. A call the ROM doesn't return from (an overflow or division by zero
+ * error) mustn't return with the traps on either.
+ *
+ * The operands include mantissas that round up or carry out, extension
+ * bytes either side of $80 and exponents either side of the cutoffs where
+ * the handlers leave the work to the ROM. Last, traps registered with
+ * hleRegisterTrap() must be installed from the label file too.
+ *
+ * usage: hle_test <rom image> <label file>
+ */
+
+#include "cpu65xx_harness.h"
+
+#include "hle.h"
+#include "hbc56emu.h"
+#include "devices/6502_device.h"
+
+#include <stdlib.h>
+
+#define RAM_END         0x8000          /* the ROM above */
+#define STOP            0x0300          /* the routines return here */
+#define OPERAND         0x0400          /* (Y,A) for FMULT and FDIV */
+#define CALL_LIMIT      50000           /* instructions: an error never returns */
+#define FLOAT_CASES     4000
+#define MOVE_CASES      1000
+#define MAX_REPORTS     20
+
+static TestMachine romMachine;
+static TestMachine trapMachine;
+static uint8_t rom[HBC56_ROM_SIZE];
+static int failures = 0;
+
+static HBC56Device cpuDevice;
+static HBC56TrapFn trapHandler = NULL;
+static uint8_t trapMap[0x10000 / 8];
+
+
+/* ---- fakes of the bus and CPU device ---- */
+
+uint8_t hbc56MemRead(uint16_t addr, bool dbg)
+{
+  (void)dbg;
+  return testCurrent->mem[addr];
+}
+
+void hbc56MemWrite(uint16_t addr, uint8_t val)
+{
+  if (addr < RAM_END) testCurrent->mem[addr] = val;
+}
+
+void set6502TrapHandler(HBC56Device* device, HBC56TrapFn trap)
+{
+  (void)device;
+  trapHandler = trap;
+}
+
+void set6502Trap(HBC56Device* device, uint16_t addr, int enabled)
+{
+  (void)device;
+  if (enabled) trapMap[addr >> 3] |= 1 << (addr & 7);
+  else trapMap[addr >> 3] &= ~(1 << (addr & 7));
+}
+
+void clear6502Traps(HBC56Device* device)
+{
+  (void)device;
+  memset(trapMap, 0, sizeof(trapMap));
+}
+
+
+/* ---- calls ---- */
+
+struct Symbols
+{
+  uint16_t fac, facsign, facextension, arg, argsign, sgncpr;
+  uint16_t lowtr, hightr, highds;
+};
+
+static Symbols sym;
+
+/* the trap handler in place of the instruction at PC, as runTrap() does.
+ * returns false if it declined */
+static bool runTrap(TestMachine* m)
+{
+  HBC56CpuRegs regs = {
+    cpu65xxGetPC(m->cpu), cpu65xxGetAcc(m->cpu), cpu65xxGetX(m->cpu),
+    cpu65xxGetY(m->cpu), cpu65xxGetStackPointer(m->cpu), cpu65xxGetStatus(m->cpu) };
+
+  testCurrent = m;
+  if (trapHandler(regs.pc, &regs) < 0) return false;
+  testSetRegs(m, regs.pc, regs.a, regs.x, regs.y, regs.sp, regs.p);
+  return true;
+}
+
+/* JSR addr from STOP - 3 with the registers already set. returns true if
+ * it came back within CALL_LIMIT instructions */
+static bool call(TestMachine* m, uint16_t addr, bool traps)
+{
+  uint8_t sp = cpu65xxGetStackPointer(m->cpu);
+  m->mem[0x100 | sp] = (STOP - 1) >> 8;
+  m->mem[0x100 | (uint8_t)(sp - 1)] = (STOP - 1) & 0xff;
+  cpu65xxSetStackPointer(m->cpu, (uint8_t)(sp - 2));
+  cpu65xxSetPC(m->cpu, addr);
+  testMachineLoaded(m);
+
+  for (int i = 0; i < CALL_LIMIT; ++i)
+  {
+    uint16_t pc = cpu65xxGetPC(m->cpu);
+    if (pc == STOP) return true;
+    if (traps && (trapMap[pc >> 3] & (1 << (pc & 7))) && runTrap(m)) continue;
+    testStep(m);
+  }
+  return false;
+}
+
+/* both machines from the same random RAM and registers. the caller then
+ * sets its operands in romMachine, which are copied over by run() */
+static void setup(uint32_t* seed)
+{
+  for (int i = 0; i < RAM_END; ++i) romMachine.mem[i] = (uint8_t)testRandom(seed);
+  uint8_t p = (uint8_t)testRandom(seed) & ~0x08;   /* BASIC runs in binary mode */
+  testSetRegs(&romMachine, 0, (uint8_t)testRandom(seed), (uint8_t)testRandom(seed),
+    (uint8_t)testRandom(seed), 0xf0 | (testRandom(seed) & 0x0f), p);
+}
+
+/* returns the name of the first thing that differs after calling addr on
+ * both machines ("" for none), with all of RAM compared if ram */
+static const char* run(uint16_t addr, bool ram)
+{
+  memcpy(trapMachine.mem, romMachine.mem, RAM_END);
+  testSetRegs(&trapMachine, 0, cpu65xxGetAcc(romMachine.cpu), cpu65xxGetX(romMachine.cpu),
+    cpu65xxGetY(romMachine.cpu), cpu65xxGetStackPointer(romMachine.cpu), cpu65xxGetStatus(romMachine.cpu));
+
+  bool romReturned = call(&romMachine, addr, false);
+  bool trapReturned = call(&trapMachine, addr, true);
+  if (romReturned != trapReturned) return romReturned ? "the return (traps on)" : "the return (ROM)";
+  if (!romReturned) return "";
+
+  const char* differs = testRegsDiffer(&romMachine, &trapMachine);
+  if (*differs) return differs;
+
+  const struct { const char* name; uint16_t addr; int size; } fields[] = {
+    { "FAC", sym.fac, 5 }, { "FACSIGN", sym.facsign, 1 }, { "FACEXTENSION", sym.facextension, 1 },
+    { "ARG", sym.arg, 5 }, { "ARGSIGN", sym.argsign, 1 }, { "SGNCPR", sym.sgncpr, 1 },
+  };
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+  {
+    if (memcmp(romMachine.mem + fields[i].addr, trapMachine.mem + fields[i].addr, fields[i].size) != 0)
+    {
+      return fields[i].name;
+    }
+  }
+  if (ram && memcmp(romMachine.mem, trapMachine.mem, RAM_END) != 0) return "RAM";
+  return "";
+}
+
+static void printBytes(const char* label, uint16_t addr, int size)
+{
+  printf("  %-12s", label);
+  for (int i = 0; i < size; ++i) printf(" %02X", romMachine.mem[addr + i]);
+  printf("  /");
+  for (int i = 0; i < size; ++i) printf(" %02X", trapMachine.mem[addr + i]);
+  printf("\n");
+}
+
+
+/* ---- FMULT and FDIV ---- */
+
+static const uint32_t edgeMantissas[] = {
+  0x80000000, 0x80000001, 0x800000ff, 0xbfffffff, 0xc0000000,
+  0xaaaaaaab, 0xfffffeff, 0xfffffffe, 0xffffffff
+};
+
+static const uint8_t edgeExtensions[] = { 0x00, 0x01, 0x7f, 0x80, 0x81, 0xff };
+
+static uint32_t randomMantissa(uint32_t* seed)
+{
+  if (testRandom(seed) & 1) return edgeMantissas[testRandom(seed) % (sizeof(edgeMantissas) / sizeof(edgeMantissas[0]))];
+  return testRandom(seed) | 0x80000000;
+}
+
+/* an exponent pair whose result exponent (before normalising) is mostly
+ * near the handlers' cutoffs of 2 and 255: argExp + facExp - 128 for FMULT
+ * and argExp - facExp + 129 for FDIV */
+static void randomExponents(uint32_t* seed, bool divide, int* argExp, int* facExp)
+{
+  static const int targets[] = { -1, 0, 1, 2, 3, 4, 253, 254, 255, 256, 257, 258 };
+  uint32_t r = testRandom(seed);
+
+  if (r % 32 == 0)
+  {
+    /* zero operands */
+    *argExp = (r & 0x100) ? 0 : 1 + (int)(testRandom(seed) % 255);
+    *facExp = (r & 0x100) ? 1 + (int)(testRandom(seed) % 255) : 0;
+    return;
+  }
+  if (r % 4 == 0)
+  {
+    *argExp = 1 + (int)(testRandom(seed) % 255);
+    *facExp = 1 + (int)(testRandom(seed) % 255);
+    return;
+  }
+
+  int target = targets[testRandom(seed) % (sizeof(targets) / sizeof(targets[0]))];
+  for (;;)
+  {
+    *facExp = 1 + (int)(testRandom(seed) % 255);
+    *argExp = divide ? target + *facExp - 129 : target - *facExp + 128;
+    if (*argExp >= 1 && *argExp <= 255) return;
+  }
+}
+
+static void putMantissa(uint8_t* at, uint32_t mant)
+{
+  for (int i = 0; i < 4; ++i) at[i] = (uint8_t)(mant >> (24 - 8 * i));
+}
+
+static void testFloat(const char* name, uint16_t addr, bool divide)
+{
+  uint32_t seed = divide ? 0xfd1f0001u : 0xf3a1f001u;
+  int reports = 0;
+
+  for (int i = 0; i < FLOAT_CASES; ++i)
+  {
+    setup(&seed);
+    uint8_t* mem = romMachine.mem;
+
+    int argExp, facExp;
+    randomExponents(&seed, divide, &argExp, &facExp);
+    uint32_t argMant = randomMantissa(&seed);
+    uint32_t facMant = randomMantissa(&seed);
+    uint8_t extension = (testRandom(&seed) & 1) ? edgeExtensions[testRandom(&seed) % sizeof(edgeExtensions)]
+                                                : (uint8_t)testRandom(&seed);
+
+    /* rounding FAC up into the next exponent */
+    if (divide && testRandom(&seed) % 16 == 0)
+    {
+      facMant = 0xffffffff;
+      extension |= 0x80;
+      if (testRandom(&seed) & 1) facExp = 255;
+    }
+
+    uint8_t argSign = (uint8_t)testRandom(&seed) & 0x80;
+    mem[OPERAND] = (uint8_t)argExp;
+    putMantissa(mem + OPERAND + 1, argMant);
+    mem[OPERAND + 1] = (mem[OPERAND + 1] & 0x7f) | argSign;
+
+    mem[sym.fac] = (uint8_t)facExp;
+    putMantissa(mem + sym.fac + 1, facMant);
+    mem[sym.facsign] = (uint8_t)testRandom(&seed);
+    mem[sym.facextension] = extension;
+
+    cpu65xxSetAcc(romMachine.cpu, OPERAND & 0xff);
+    cpu65xxSetY(romMachine.cpu, OPERAND >> 8);
+
+    const char* differs = run(addr, false);
+    if (!*differs) continue;
+
+    ++failures;
+    if (++reports > MAX_REPORTS) continue;
+    printf("%s: %s differs for %02X %08X (sign %02X) and FAC %02X %08X %02X\n", name, differs,
+      argExp, argMant, argSign, facExp, facMant, extension);
+    testPrintRegs("ROM", &romMachine);
+    testPrintRegs("traps", &trapMachine);
+    printBytes("FAC", sym.fac, 5);
+    printBytes("FACSIGN", sym.facsign, 1);
+    printBytes("FACEXTENSION", sym.facextension, 1);
+    printBytes("ARG", sym.arg, 5);
+  }
+}
+
+
+/* ---- BLTU2 ---- */
+
+static void poke16(uint16_t addr, uint16_t val)
+{
+  romMachine.mem[addr] = val & 0xff;
+  romMachine.mem[addr + 1] = val >> 8;
+}
+
+static void testMove(uint16_t addr)
+{
+  static const uint16_t edgeCounts[] = { 0, 1, 2, 0xff, 0x100, 0x101, 0x1ff, 0x200 };
+  static const uint16_t edgeGaps[] = { 0, 1, 0xff, 0x100 };
+
+  uint32_t seed = 0xb1702u;
+  int reports = 0;
+
+  for (int i = 0; i < MOVE_CASES; ++i)
+  {
+    setup(&seed);
+
+    /* LOWTR..HIGHTR-1 up to end at HIGHDS-1, overlapping or not */
+    uint16_t lowtr = (uint16_t)(0x1000 + testRandom(&seed) % 0x3000);
+    uint16_t count = (testRandom(&seed) & 1) ? edgeCounts[testRandom(&seed) % (sizeof(edgeCounts) / sizeof(edgeCounts[0]))]
+                                             : (uint16_t)(testRandom(&seed) % 0x400);
+    uint16_t gap = (testRandom(&seed) & 1) ? edgeGaps[testRandom(&seed) % (sizeof(edgeGaps) / sizeof(edgeGaps[0]))]
+                                           : (uint16_t)(testRandom(&seed) % 0x800);
+    poke16(sym.lowtr, lowtr);
+    poke16(sym.hightr, (uint16_t)(lowtr + count));
+    poke16(sym.highds, (uint16_t)(lowtr + count + gap));
+
+    const char* differs = run(addr, true);
+    if (!*differs) continue;
+
+    ++failures;
+    if (++reports > MAX_REPORTS) continue;
+    printf("BLTU2: %s differs moving $%04X bytes from $%04X by $%04X\n", differs, count, lowtr, gap);
+    testPrintRegs("ROM", &romMachine);
+    testPrintRegs("traps", &trapMachine);
+    printBytes("LOWTR", sym.lowtr, 2);
+    printBytes("HIGHTR", sym.hightr, 2);
+    printBytes("HIGHDS", sym.highds, 2);
+  }
+}
+
+
+/* ---- registry ---- */
+
+static int registeredCalls = 0;
+
+static int countCall(uint16_t addr, HBC56CpuRegs* regs)
+{
+  (void)addr;
+  (void)regs;
+  ++registeredCalls;
+  return 1;
+}
+
+/* a registered symbol is resolved from the label file like the built in
+ * ones, and registering a built in again replaces its handler */
+static void testRegistry(const char* labels)
+{
+  uint16_t lowtr = sym.lowtr;
+  uint16_t fmult = hleAddress("FMULT");
+
+  if (!hleRegisterTrap("LOWTR", countCall, 0, 3) || !hleRegisterTrap("FMULT", countCall, 1, 7))
+  {
+    printf("hle: registering LOWTR and FMULT failed\n");
+    ++failures;
+    return;
+  }
+  hleLoadTraps(labels);
+
+  if (hleAddress("LOWTR") != lowtr || !(trapMap[lowtr >> 3] & (1 << (lowtr & 7))))
+  {
+    printf("hle: the registered LOWTR trap isn't installed at $%04X\n", lowtr);
+    ++failures;
+    return;
+  }
+
+  /* FMULT returns to STOP */
+  testCurrent = &trapMachine;
+  trapMachine.mem[0x1ff] = (STOP - 1) >> 8;
+  trapMachine.mem[0x1fe] = (STOP - 1) & 0xff;
+  HBC56CpuRegs regs = { lowtr, 0, 0, 0, 0xfd, 0 };
+  int32_t lowtrCycles = trapHandler(lowtr, &regs);
+  regs.pc = fmult;
+  int32_t fmultCycles = trapHandler(fmult, &regs);
+
+  if (lowtrCycles != 3 || fmultCycles != 7 + 6 || registeredCalls != 2 || regs.pc != STOP || regs.sp != 0xff)
+  {
+    printf("hle: registered traps ran %d times for %d and %d cycles, returning to $%04X\n",
+      registeredCalls, lowtrCycles, fmultCycles, regs.pc);
+    ++failures;
+  }
+}
+
+
+/* ---- setup ---- */
+
+static long readFile(const char* filename, void* buffer, long size)
+{
+  FILE* file = fopen(filename, "rb");
+  if (!file) return -1;
+  long read = (long)fread(buffer, 1, (size_t)size, file);
+  fclose(file);
+  return read;
+}
+
+static uint16_t address(const char* name)
+{
+  int32_t addr = hleAddress(name);
+  if (addr < 0)
+  {
+    printf("hle: %s isn't in the label file (or its trap isn't installed)\n", name);
+    exit(1);
+  }
+  return (uint16_t)addr;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 3)
+  {
+    printf("usage: hle_test <rom image> <label file>\n");
+    return 2;
+  }
+
+  if (readFile(argv[1], rom, sizeof(rom)) != (long)sizeof(rom))
+  {
+    printf("hle: %s isn't a %d byte ROM\n", argv[1], HBC56_ROM_SIZE);
+    return 1;
+  }
+
+  static char labels[1 << 20];
+  long labelSize = readFile(argv[2], labels, sizeof(labels) - 1);
+  if (labelSize < 0)
+  {
+    printf("hle: can't read %s\n", argv[2]);
+    return 1;
+  }
+  labels[labelSize] = 0;
+
+  hleInit(&cpuDevice);
+  hleLoadTraps(labels);
+
+  sym.fac = address("FAC");
+  sym.facsign = address("FACSIGN");
+  sym.facextension = address("FACEXTENSION");
+  sym.arg = address("ARG");
+  sym.argsign = address("ARGSIGN");
+  sym.sgncpr = address("SGNCPR");
+  sym.lowtr = address("LOWTR");
+  sym.hightr = address("HIGHTR");
+  sym.highds = address("HIGHDS");
+
+  /* the ROM's 6502 code on the 65C02 it runs on */
+  memcpy(romMachine.mem + HBC56_ROM_START, rom, sizeof(rom));
+  memcpy(trapMachine.mem + HBC56_ROM_START, rom, sizeof(rom));
+  testMachineInit(&romMachine, CPU65XX_W65C02, 0);
+  testMachineInit(&trapMachine, CPU65XX_W65C02, 0);
+
+  testFloat("FMULT", address("FMULT"), false);
+  testFloat("FDIV", address("FDIV"), true);
+  testMove(address("BLTU2"));
+  testRegistry(labels);
+
+  testMachineDestroy(&romMachine);
+  testMachineDestroy(&trapMachine);
+
+  if (failures)
+  {
+    printf("hle: %d failures\n", failures);
+    return 1;
+  }
+  printf("hle: ok\n");
+  return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * DB6502 Emulator - VIA1 port A keyboard test
+ *
+ * Runs kbport.c against a fake keyboard device and VIA. A guest polls IFR
+ * for CA1 and reads ORA, and pasted strokes are fed the way
+ * doKeyboardInput() feeds them: only while the keyboard device's queue is
+ * empty, and (as hbc56MemRead() arranges) straight after the read that
+ * acknowledged the last code of a stroke. The whole paste must arrive, in
+ * order, with nothing else moving it along.
+ */
+
+#include "kbport.h"
+#include "devices/keyboard_device.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define KB_ADDR       0x9000
+#define VIA_ADDR      0x9000
+#define VIA_ORA       (VIA_ADDR + 0x01)
+#define VIA_IFR       (VIA_ADDR + 0x0d)
+#define VIA_IER       (VIA_ADDR + 0x0e)
+#define VIA_ORA_NH    (VIA_ADDR + 0x0f)
+
+#define STROKE_UP     0x8000
+#define CODE_SHIFT    0x12
+#define CODE_BREAK    0xf0
+
+static HBC56Device kb;
+static HBC56Device via;
+static uint8_t viaRegs[16];
+
+static uint8_t kbQueue[64];
+static int kbHead = 0;
+static int kbTail = 0;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); ++failures; } } while (0)
+
+
+/* ---- fakes of the HBC-56 device layer ---- */
+
+uint8_t readDevice(HBC56Device* device, uint16_t addr, uint8_t* val, uint8_t dbg)
+{
+  if (device == &kb && addr == KB_ADDR)
+  {
+    *val = 0;
+    if (kbHead != kbTail)
+    {
+      *val = kbQueue[kbTail];
+      if (!dbg) ++kbTail;
+    }
+    return 1;
+  }
+  if (device == &via && (uint16_t)(addr - VIA_ADDR) < 16)
+  {
+    *val = viaRegs[addr - VIA_ADDR];
+    return 1;
+  }
+  return 0;
+}
+
+int keyboardDeviceQueueEmpty(HBC56Device* device)
+{
+  return device != &kb || kbHead == kbTail;
+}
+
+/* a PS/2 keyboard in miniature: one code per key, F0 before a release */
+static void kbStroke(uint16_t stroke)
+{
+  uint8_t code = (uint8_t)stroke;
+  if (stroke & STROKE_UP) kbQueue[kbHead++] = CODE_BREAK;
+  kbQueue[kbHead++] = code;
+}
+
+
+/* ---- tests ---- */
+
+/* the guest reads register addr. returns what it saw */
+static uint8_t guestRead(uint16_t addr, int* taken)
+{
+  return kbPortRead(addr, viaRegs[addr - VIA_ADDR], 0, taken);
+}
+
+static void resetAll()
+{
+  memset(viaRegs, 0, sizeof(viaRegs));
+  kbHead = kbTail = 0;
+  kbPortInit(&kb, KB_ADDR, &via, VIA_ADDR);
+}
+
+/* "Hi" then Return, with Shift for the H */
+static void testPasteFinishes()
+{
+  static const uint16_t strokes[] = {
+    CODE_SHIFT, 0x33, 0x33 | STROKE_UP, CODE_SHIFT | STROKE_UP,
+    0x43, 0x43 | STROKE_UP, 0x5a, 0x5a | STROKE_UP };
+  const int strokeCount = sizeof(strokes) / sizeof(strokes[0]);
+
+  uint8_t expected[32];
+  int expectedCount = 0;
+  for (int i = 0; i < strokeCount; ++i)
+  {
+    if (strokes[i] & STROKE_UP) expected[expectedCount++] = CODE_BREAK;
+    expected[expectedCount++] = (uint8_t)strokes[i];
+  }
+
+  resetAll();
+
+  uint8_t received[32];
+  int receivedCount = 0;
+  int next = 0;
+  int feed = 1;
+
+  /* the guest spins on IFR. strokes are only fed at the start and when a
+   * read ends the run, never on a timer */
+  for (int reads = 0; reads < 10000 && receivedCount < expectedCount; ++reads)
+  {
+    while (feed && next < strokeCount && keyboardDeviceQueueEmpty(&kb)) kbStroke(strokes[next++]);
+    feed = 0;
+
+    int taken;
+    if (!(guestRead(VIA_IFR, &taken) & 0x02)) continue;
+    CHECK(!taken, "IFR read acknowledged a code");
+
+    uint8_t code = guestRead(VIA_ORA, &taken);
+    CHECK(taken, "ORA read with CA1 set didn't acknowledge its code");
+    if (receivedCount < (int)sizeof(received)) received[receivedCount++] = code;
+
+    if (taken && next < strokeCount && keyboardDeviceQueueEmpty(&kb)) feed = 1;
+  }
+
+  CHECK(next == strokeCount, "paste stalled: %d of %d strokes fed", next, strokeCount);
+  CHECK(receivedCount == expectedCount, "paste stalled: %d of %d codes read", receivedCount, expectedCount);
+  for (int i = 0; i < receivedCount && i < expectedCount; ++i)
+  {
+    CHECK(received[i] == expected[i], "code %d: read $%02X, expected $%02X", i, received[i], expected[i]);
+  }
+
+  int taken;
+  CHECK(!(guestRead(VIA_IFR, &taken) & 0x02), "CA1 still set after the paste");
+}
+
+/* only an ORA read acknowledges. ORA without handshake and debugger reads
+ * leave the code where it is */
+static void testHandshake()
+{
+  resetAll();
+  kbStroke(0x1c);
+  kbStroke(0x32);
+
+  int taken;
+  uint8_t val = kbPortRead(VIA_ORA, 0, 1, &taken);
+  CHECK(!taken && val == 0x00, "debugger read took a code");
+  CHECK(!(kbPortRead(VIA_IFR, 0, 1, &taken) & 0x02), "debugger read latched a code");
+
+  CHECK(guestRead(VIA_ORA_NH, &taken) == 0x1c && !taken, "ORA without handshake acknowledged");
+  CHECK(guestRead(VIA_IFR, &taken) == 0x02, "IFR doesn't show CA1, or shows an IRQ with CA1 disabled");
+
+  viaRegs[VIA_IER - VIA_ADDR] = 0x82;
+  CHECK(guestRead(VIA_IFR, &taken) == 0x82, "IFR doesn't show the IRQ with CA1 enabled");
+
+  CHECK(kbPortRead(VIA_ORA, 0, 1, &taken) == 0x1c && !taken, "debugger read of ORA acknowledged");
+  CHECK(guestRead(VIA_ORA, &taken) == 0x1c && taken, "first code lost");
+  CHECK(guestRead(VIA_ORA, &taken) == 0x32 && taken, "second code lost");
+  CHECK(guestRead(VIA_ORA, &taken) == 0x32 && !taken, "ORA doesn't hold the last code");
+  CHECK(!(guestRead(VIA_IFR, &taken) & 0x02), "CA1 set with nothing waiting");
+
+  CHECK(guestRead(VIA_ADDR, &taken) == viaRegs[0] && !taken, "ORB changed by the keyboard");
+}
+
+int main()
+{
+  testPasteFinishes();
+  testHandshake();
+
+  if (failures)
+  {
+    printf("kbport: %d failures\n", failures);
+    return 1;
+  }
+  printf("kbport: ok\n");
+  return 0;
+}